@@ -21,6 +21,7 @@
 #include <math.h>
 #include <stdlib.h>
 #include <GL/glew.h>
+#include "../../lib/mathGL.h"
 
 #define M_00 0x00
 #define M_10 0x01
@@ -172,29 +173,10 @@ GLint mtxGetShaderAttribute(GLuint program, const char *attribute_name) {
 }
 
 GLfloat* mtxCreateIdentity() {
-	
+
 	GLfloat *mtx = malloc(16*sizeof(GLfloat));
 
-	mtx[0] = 1.0;
-	mtx[1] = 0.0;
-	mtx[2] = 0.0;
-	mtx[3] = 0.0;
-
-	mtx[4] = 0.0;
-	mtx[5] = 1.0;
-	mtx[6] = 0.0;
-	mtx[7] = 0.0;
-
-	mtx[8] = 0.0;
-	mtx[9] = 0.0;
-	mtx[10] = 1.0;
-	mtx[11] = 0.0;
-
-	mtx[12] = 0.0;
-	mtx[13] = 0.0;
-	mtx[14] = 0.0;
-	mtx[15] = 1.0;
-	
+	mthMat4Identity(mtx);
 	return mtx;
 
 }
@@ -211,39 +193,9 @@ GLfloat* mtxCreateOrtho2d(GLint width, GLint height) {
 		exit(1);
 	}
 
-	GLfloat right = (GLfloat)width;
-	GLfloat top = (GLfloat)height;
-	
-	const GLfloat left = 0.0;
-	const GLfloat bottom = 0.0;
-	const GLfloat zNear = -.10f;
-	const GLfloat zFar = 1.0f;
-	const GLfloat inv_z = 1.0f / (zFar - zNear);
-	const GLfloat inv_y = 1.0f / (top - bottom);
-	const GLfloat inv_x = 1.0f / (right - left);
-
 	GLfloat *m = (GLfloat*)malloc(16 * sizeof(GLfloat));
 
-	m[M_00] = 2.0f * inv_x;
-	m[M_10] = 0.0f;
-	m[M_20] = 0.0f;
-	m[M_30] = 0.0f;
-
-	m[M_01] = 0.0f;
-	m[M_11] = 2.0f * inv_y;
-	m[M_21] = 0.0f;
-	m[M_31] = 0.0f;
-
-	m[M_02] = 0.0f;
-	m[M_12] = 0.0f;
-	m[M_22] = -2.0f * inv_z;
-	m[M_32] = 0.0f;
-
-	m[M_03] = -(right + left)*inv_x;
-	m[M_13] = -(top + bottom)*inv_y;
-	m[M_23] = -(zFar + zNear)*inv_z;
-	m[M_33] = 1.0f;
-
+	mthMat4Ortho(m, 0.0f, (GLfloat)width, 0.0f, (GLfloat)height, -.10f, 1.0f);
 	return m;
 
 }
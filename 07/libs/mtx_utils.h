@@ -21,6 +21,7 @@
 #include <math.h>
 #include <stdlib.h>
 #include <GL/glew.h>
+#include "../../lib/mathGL.h"
 
 #define M_00 0x00
 #define M_10 0x01
@@ -179,27 +180,9 @@ GLint mtxGetShaderAttribute(GLuint program, const char *attribute_name) {
 }
 
 void mtxSetIdentity(GLfloat *mtx) {
-	
-	mtx[0] = 1.0;
-	mtx[1] = 0.0;
-	mtx[2] = 0.0;
-	mtx[3] = 0.0;
-
-	mtx[4] = 0.0;
-	mtx[5] = 1.0;
-	mtx[6] = 0.0;
-	mtx[7] = 0.0;
-
-	mtx[8] = 0.0;
-	mtx[9] = 0.0;
-	mtx[10] = 1.0;
-	mtx[11] = 0.0;
-
-	mtx[12] = 0.0;
-	mtx[13] = 0.0;
-	mtx[14] = 0.0;
-	mtx[15] = 1.0;
-	
+
+	mthMat4Identity(mtx);
+
 }
 
 void mtxCreateOrtho2d(GLfloat *mtx, GLint width, GLint height) {
@@ -214,148 +197,45 @@ void mtxCreateOrtho2d(GLfloat *mtx, GLint width, GLint height) {
 		exit(1);
 	}
 
-	GLfloat right = (GLfloat)width;
-	GLfloat top = (GLfloat)height;
-	
-	const GLfloat left = 0.0;
-	const GLfloat bottom = 0.0;
-	const GLfloat zNear = -.10f;
-	const GLfloat zFar = 1.0f;
-	const GLfloat inv_z = 1.0f / (zFar - zNear);
-	const GLfloat inv_y = 1.0f / (top - bottom);
-	const GLfloat inv_x = 1.0f / (right - left);
-
-	mtx[M_00] = 2.0f * inv_x;
-	mtx[M_10] = 0.0f;
-	mtx[M_20] = 0.0f;
-	mtx[M_30] = 0.0f;
-
-	mtx[M_01] = 0.0f;
-	mtx[M_11] = 2.0f * inv_y;
-	mtx[M_21] = 0.0f;
-	mtx[M_31] = 0.0f;
-
-	mtx[M_02] = 0.0f;
-	mtx[M_12] = 0.0f;
-	mtx[M_22] = -2.0f * inv_z;
-	mtx[M_32] = 0.0f;
-
-	mtx[M_03] = -(right + left)*inv_x;
-	mtx[M_13] = -(top + bottom)*inv_y;
-	mtx[M_23] = -(zFar + zNear)*inv_z;
-	mtx[M_33] = 1.0f;
+	mthMat4Ortho(mtx, 0.0f, (GLfloat)width, 0.0f, (GLfloat)height, -.10f, 1.0f);
 
 }
 
 void mtxMultiplyMatrix(GLfloat *a, GLfloat *b){
 
-	GLfloat *p = (GLfloat*)malloc(16*sizeof(GLfloat));
-	
-	// First Row
-	p[M_00] = a[M_00]*b[M_00]+a[M_01]*b[M_10]+a[M_02]*b[M_20]+a[M_03]*b[M_30];
-	p[M_01] = a[M_00]*b[M_01]+a[M_01]*b[M_11]+a[M_02]*b[M_21]+a[M_03]*b[M_31];
-	p[M_02] = a[M_00]*b[M_02]+a[M_01]*b[M_12]+a[M_02]*b[M_22]+a[M_03]*b[M_32];
-	p[M_03] = a[M_00]*b[M_03]+a[M_01]*b[M_13]+a[M_02]*b[M_23]+a[M_03]*b[M_33];
-	
-	// Second Row
-	p[M_10] = a[M_10]*b[M_00]+a[M_11]*b[M_10]+a[M_12]*b[M_20]+a[M_03]*b[M_30];
-	p[M_11] = a[M_10]*b[M_01]+a[M_11]*b[M_11]+a[M_12]*b[M_21]+a[M_13]*b[M_31];
-	p[M_12] = a[M_10]*b[M_02]+a[M_11]*b[M_12]+a[M_12]*b[M_22]+a[M_13]*b[M_32];
-	p[M_13] = a[M_10]*b[M_03]+a[M_11]*b[M_13]+a[M_12]*b[M_23]+a[M_13]*b[M_33];
-
-	// Third Row
-	p[M_20] = a[M_20]*b[M_00]+a[M_21]*b[M_10]+a[M_22]*b[M_20]+a[M_23]*b[M_30];
-	p[M_21] = a[M_20]*b[M_01]+a[M_21]*b[M_11]+a[M_22]*b[M_21]+a[M_23]*b[M_31];
-	p[M_22] = a[M_20]*b[M_02]+a[M_21]*b[M_12]+a[M_22]*b[M_22]+a[M_23]*b[M_32];
-	p[M_23] = a[M_20]*b[M_03]+a[M_21]*b[M_13]+a[M_22]*b[M_23]+a[M_23]*b[M_33];
-
-	// Fourth Row
-	p[M_30] = a[M_30]*b[M_00]+a[M_31]*b[M_10]+a[M_32]*b[M_20]+a[M_33]*b[M_30];
-	p[M_31] = a[M_30]*b[M_01]+a[M_31]*b[M_11]+a[M_32]*b[M_21]+a[M_33]*b[M_31];
-	p[M_32] = a[M_30]*b[M_02]+a[M_31]*b[M_12]+a[M_32]*b[M_22]+a[M_33]*b[M_32];
-	p[M_33] = a[M_30]*b[M_03]+a[M_31]*b[M_13]+a[M_32]*b[M_23]+a[M_33]*b[M_33];
-	
-	a[0] = p[0]; a[1] = p[1]; a[2] = p[2]; a[3] = p[3];
-	a[4] = p[4]; a[5] = p[5]; a[6] = p[6]; a[7] = a[7];
-	a[8] = p[8]; a[9] = p[9]; a[10] = p[10]; a[11] = p[11]; 
-	a[12] = p[12]; a[13] = p[13]; a[14] = p[14]; a[15] = p[15];
-
-	free(p);
+	mthMat4Multiply(a, a, b);
 
 }
 
 void mtxTranslateMatrix(GLfloat *mtx, GLfloat x, GLfloat y, GLfloat z) {
 
-	GLfloat *t_matrix = (GLfloat*)malloc(16 * sizeof(GLfloat));
-	mtxSetIdentity(t_matrix);
-	t_matrix[M_03] = x;
-	t_matrix[M_13] = y;
-	t_matrix[M_23] = z;
-	mtxMultiplyMatrix(mtx, t_matrix);
-	free(t_matrix);
+	mthMat4Translate(mtx, x, y, z);
 
 }
 
 void mtxScaleMatrix(GLfloat *mtx, GLfloat x, GLfloat y, GLfloat z) {
 
-	GLfloat *s_matrix = (GLfloat*)malloc(16 * sizeof(GLfloat));
-	mtxSetIdentity(s_matrix);
-	s_matrix[M_00] = x;
-	s_matrix[M_11] = y;
-	s_matrix[M_22] = z;
-	mtxMultiplyMatrix(mtx, s_matrix);
-	free(s_matrix);
+	mthMat4Scale(mtx, x, y, z);
 
 }
 
 void mtxRotateXMatrix(GLfloat *mtx, GLfloat angle) {
 
-	GLfloat *r_matrix = (GLfloat*)malloc(16 * sizeof(GLfloat));
-	mtxSetIdentity(r_matrix);
-	
 	GLfloat radians = angle / 180 * M_PI;
-	const GLfloat c = cos(radians);
-	const GLfloat s = sin(radians);
-	r_matrix[M_11] = c;
-	r_matrix[M_12] = -s;
-	r_matrix[M_21] = s;
-	r_matrix[M_22] = c;
-	mtxMultiplyMatrix(mtx, r_matrix);
-	free(r_matrix);
+	mthMat4RotateX(mtx, cos(radians), sin(radians));
 
 }
 
 void mtxRotateYMatrix(GLfloat *mtx, GLfloat angle) {
 
-	GLfloat *r_matrix = (GLfloat*)malloc(16 * sizeof(GLfloat));
-	mtxSetIdentity(r_matrix);
-	
 	GLfloat radians = angle / 180 * M_PI;
-	const GLfloat c = cos(radians);
-	const GLfloat s = sin(radians);
-	r_matrix[M_00] = c;
-	r_matrix[M_02] = s;
-	r_matrix[M_20] = -s;
-	r_matrix[M_22] = c;
-	mtxMultiplyMatrix(mtx, r_matrix);
-	free(r_matrix);
+	mthMat4RotateY(mtx, cos(radians), sin(radians));
 
 }
 
 void mtxRotateZMatrix(GLfloat *mtx, GLfloat angle) {
 
-	GLfloat *r_matrix = (GLfloat*)malloc(16 * sizeof(GLfloat));
-	mtxSetIdentity(r_matrix);
-	
 	GLfloat radians = angle / 180 * M_PI;
-	const GLfloat c = cos(radians);
-	const GLfloat s = sin(radians);
-	r_matrix[M_00] = c;
-	r_matrix[M_01] = -s;
-	r_matrix[M_10] = s;
-	r_matrix[M_11] = c;
-	mtxMultiplyMatrix(mtx, r_matrix);
-	free(r_matrix);
+	mthMat4RotateZ(mtx, cos(radians), sin(radians));
 
 }
-
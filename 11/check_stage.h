@@ -0,0 +1,41 @@
+/*
+ * Included by math_check.c once per tutorial stage, with CHECK_STAGE set
+ * to a prefix and CHECK_STAGE_HEADER to that stage's libs/mtx_utils.h.
+ * Every mtx function the stages define is renamed to the prefix, so each
+ * stage's matrix code builds side by side with the others and with
+ * stage 11's instead of clashing on the mtx names.
+ */
+
+#define mtxCreateShader CHECK_NAME(CreateShader)
+#define mtxCreateProgram CHECK_NAME(CreateProgram)
+#define mtxGetShaderUniform CHECK_NAME(GetShaderUniform)
+#define mtxGetShaderAttribute CHECK_NAME(GetShaderAttribute)
+#define mtxCreateIdentity CHECK_NAME(CreateIdentity)
+#define mtxResetIdentity CHECK_NAME(ResetIdentity)
+#define mtxSetIdentity CHECK_NAME(SetIdentity)
+#define mtxCreateOrtho2d CHECK_NAME(CreateOrtho2d)
+#define mtxMultiplyMatrix CHECK_NAME(MultiplyMatrix)
+#define mtxTranslateMatrix CHECK_NAME(TranslateMatrix)
+#define mtxScaleMatrix CHECK_NAME(ScaleMatrix)
+#define mtxRotateXMatrix CHECK_NAME(RotateXMatrix)
+#define mtxRotateYMatrix CHECK_NAME(RotateYMatrix)
+#define mtxRotateZMatrix CHECK_NAME(RotateZMatrix)
+
+#include CHECK_STAGE_HEADER
+
+#undef mtxCreateShader
+#undef mtxCreateProgram
+#undef mtxGetShaderUniform
+#undef mtxGetShaderAttribute
+#undef mtxCreateIdentity
+#undef mtxResetIdentity
+#undef mtxSetIdentity
+#undef mtxCreateOrtho2d
+#undef mtxMultiplyMatrix
+#undef mtxTranslateMatrix
+#undef mtxScaleMatrix
+#undef mtxRotateXMatrix
+#undef mtxRotateYMatrix
+#undef mtxRotateZMatrix
+#undef CHECK_STAGE
+#undef CHECK_STAGE_HEADER
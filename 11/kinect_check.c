@@ -0,0 +1,349 @@
+/*
+ * Depth pipeline tools, built apart from the game so nothing here ships
+ * in prgm.c. --depth-synth FILE writes a synthetic depth recording (make
+ * depth.kir), --cloud FILE checks and times the point cloud conversion
+ * on one (make cloud), exiting 1 when the fast paths differ from the
+ * scalar reference, --gesture FILE runs it through the gesture
+ * controller, checked against a trace with --golden (make gesture), and
+ * --upload FILE streams it through kiSourceUpload on an offscreen
+ * context and reads every frame back (make upload).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <GL/glew.h>
+#include "libs/job_utils.h"
+#include "libs/offscreen_utils.h"
+#include "../lib/kinectGL.h"
+#include "../lib/kinectFrames.h"
+#include "../lib/kinectCloud.h"
+#include "../lib/kinectGesture.h"
+
+#define DEPTH_SYNTH_FRAMES 90
+#define CLOUD_LEAF 0.02
+#define CAMERA_HEIGHT 1.0
+#define GESTURE_BUDGET_MS 2.0
+
+double get_time_ms() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+
+}
+
+/*
+ * Synthetic depth scene for testing without a camera: a back wall that
+ * tilts away towards the top, a band above it beyond the sensor range,
+ * a sphere at 1.5 m circling around the middle that pushes 40 cm towards
+ * the camera for 10 of every 45 frames, and a sprinkling of dropped
+ * pixels (0) like a real sensor has around edges.
+ */
+
+void synth_depth(uint16_t *depth, int width, int height, unsigned int frame) {
+
+	float bx = width * (0.5f + 0.25f * sinf(frame * 0.1f)), by = height * (0.55f + 0.2f * sinf(frame * 0.07f));
+	float r = height * 0.15f, near = frame % 45 >= 35 ? 1100.0f : 1500.0f, dx, dy, q;
+	int u, v;
+
+	for(v = 0; v < height; v++) {
+		for(u = 0; u < width; u++) {
+
+			uint16_t d = v < height / 10 ? 5000 : (uint16_t)(3000 + (height - v) * 2);
+
+			dx = u - bx;
+			dy = v - by;
+			q = r * r - dx * dx - dy * dy;
+			if(q > 0.0f){
+				d = (uint16_t)(near - sqrtf(q) * 1000.0f / r * 0.25f);
+			}
+
+			if((u * 7 + v * 13 + frame) % 61 == 0){
+				d = 0;
+			}
+
+			depth[v * width + u] = d;
+
+		}
+	}
+
+}
+
+/*
+ * Write DEPTH_SYNTH_FRAMES synthetic depth frames as a recording that
+ * the file source can replay.
+ */
+
+int run_depth_synth(const char *filename) {
+
+	struct kiRecorder rec;
+	uint16_t *depth = (uint16_t*)malloc(KI_DEPTH_WIDTH * KI_DEPTH_HEIGHT * sizeof(uint16_t));
+	unsigned int f;
+
+	if(kiRecordCreate(&rec, filename, KI_DEPTH_WIDTH, KI_DEPTH_HEIGHT, 30, 0) < 0){
+		free(depth);
+		return 1;
+	}
+
+	for(f = 0; f < DEPTH_SYNTH_FRAMES; f++) {
+		synth_depth(depth, KI_DEPTH_WIDTH, KI_DEPTH_HEIGHT, f);
+		kiRecordFrame(&rec, depth, NULL);
+	}
+
+	kiRecordClose(&rec);
+	free(depth);
+	fprintf(stderr, "Depth: wrote %u synthetic %dx%d frames to %s\n", f, KI_DEPTH_WIDTH, KI_DEPTH_HEIGHT, filename);
+	return 0;
+
+}
+
+/*
+ * Convert every frame of a depth recording with the scalar reference,
+ * the SIMD path on one thread and the SIMD path over the job system.
+ * The fast paths must match the reference exactly. Voxel downsampling is
+ * timed on the result.
+ */
+
+int run_cloud_bench(const char *filename) {
+
+	struct kiSource src;
+	struct kiCloud cloud;
+	struct kiIntrinsics intr;
+	const struct kiFrame *frame;
+	double start, scalar_ms = 0.0, simd_ms = 0.0, jobs_ms = 0.0, voxel_ms = 0.0;
+	unsigned long points = 0, voxels = 0;
+	unsigned int frames = 0, n, mismatches = 0;
+	float *ref;
+
+	if(kiSourceOpenFile(&src, filename, 0) < 0){
+		return 1;
+	}
+	kiSourceStart(&src, 0);
+
+	kiDefaultIntrinsics(&intr, src.width, src.height);
+	kiCloudCreate(&cloud, src.width, src.height, &intr);
+	ref = (float*)malloc((size_t)src.width * src.height * 3 * sizeof(float));
+
+	// y up, camera CAMERA_HEIGHT above the floor
+	cloud.matrix[M_11] = -1.0f;
+	cloud.matrix[M_13] = CAMERA_HEIGHT;
+
+	while(kiSourceAcquire(&src)) {
+
+		frame = kiSourceFrame(&src);
+
+		start = get_time_ms();
+		n = kiCloudConvertScalar(&cloud, frame->depth, ref);
+		scalar_ms += get_time_ms() - start;
+
+		cloud.parallel_for = NULL;
+		start = get_time_ms();
+		kiCloudConvert(&cloud, frame->depth);
+		simd_ms += get_time_ms() - start;
+		mismatches += cloud.count != n || memcmp(cloud.points, ref, n * 3 * sizeof(float)) != 0;
+
+		cloud.parallel_for = jobParallelFor;
+		start = get_time_ms();
+		kiCloudConvert(&cloud, frame->depth);
+		jobs_ms += get_time_ms() - start;
+		mismatches += cloud.count != n || memcmp(cloud.points, ref, n * 3 * sizeof(float)) != 0;
+
+		start = get_time_ms();
+		voxels += kiCloudVoxelize(&cloud, CLOUD_LEAF);
+		voxel_ms += get_time_ms() - start;
+
+		points += n;
+		frames++;
+
+	}
+
+	if(frames > 0){
+		fprintf(stderr, "Cloud: %u frames, %.0f points/frame, scalar %.3f ms, SIMD %.3f ms (%.2fx), SIMD + %u threads %.3f ms (%.2fx)\n",
+			frames, (double)points / frames, scalar_ms / frames, simd_ms / frames, scalar_ms / simd_ms,
+			jobs.num_threads, jobs_ms / frames, scalar_ms / jobs_ms);
+		fprintf(stderr, "Cloud: %.0f voxels/frame at %.0f mm, %.3f ms/frame, %u mismatched frames\n",
+			(double)voxels / frames, CLOUD_LEAF * 1000.0, voxel_ms / frames, mismatches);
+	}
+
+	free(ref);
+	kiCloudDestroy(&cloud);
+	kiSourceClose(&src);
+	return mismatches ? 1 : 0;
+
+}
+
+/*
+ * Feed every frame of a depth recording through the gesture controller
+ * and print the input trace, one hex mask per frame. --capture writes
+ * the trace and --golden compares it with an expected one; any
+ * differing frame fails. Frames over the 2 ms budget are reported.
+ */
+
+int run_gesture(const char *filename, const char *capture_file, const char *golden_file) {
+
+	struct kiSource src;
+	struct kiGesture g;
+	FILE *out = NULL, *expected = NULL;
+	unsigned int frames = 0, mismatches = 0, over = 0, mask, want;
+	double last_ms = 0.0;
+
+	if(kiSourceOpenFile(&src, filename, 0) < 0){
+		return 1;
+	}
+	kiSourceStart(&src, 0);
+	kiGestureCreate(&g, src.width, src.height);
+
+	if(capture_file != NULL && (out = fopen(capture_file, "w")) == NULL){
+		fprintf(stderr, "Could not open %s\n", capture_file);
+	}
+	if(golden_file != NULL && (expected = fopen(golden_file, "r")) == NULL){
+		fprintf(stderr, "Could not open %s\n", golden_file);
+		mismatches++;
+	}
+
+	while(kiSourceAcquire(&src)) {
+
+		mask = kiGestureUpdate(&g, kiSourceFrame(&src)->depth);
+		over += g.total_ms - last_ms > GESTURE_BUDGET_MS;
+		last_ms = g.total_ms;
+
+		if(out != NULL){
+			fprintf(out, "%u 0x%03x\n", frames, mask);
+		}
+		if(expected != NULL && (fscanf(expected, "%*u %x", &want) != 1 || want != mask)){
+			if(mismatches++ < 10){
+				fprintf(stderr, "Gesture: frame %u gave 0x%03x\n", frames, mask);
+			}
+		}
+		frames++;
+
+	}
+
+	fprintf(stderr, "Gesture: %u frames, %.3f ms/frame, max %.3f ms, %u over %.0f ms budget\n",
+		frames, frames ? g.total_ms / frames : 0.0, g.max_ms, over, GESTURE_BUDGET_MS);
+	if(golden_file != NULL){
+		fprintf(stderr, "Gesture: %u frames differ from %s\n", mismatches, golden_file);
+	}
+
+	if(out != NULL){
+		fclose(out);
+	}
+	if(expected != NULL){
+		fclose(expected);
+	}
+	kiGestureDestroy(&g);
+	kiSourceClose(&src);
+	return mismatches ? 1 : 0;
+
+}
+
+/*
+ * Upload every frame of a depth recording through the PBO path on an
+ * offscreen context and read the texture back. Any frame that doesn't
+ * come back as recorded, or any GL error, fails.
+ */
+
+int run_upload_check(const char *filename) {
+
+	struct ofsContext ofs;
+	struct kiSource src;
+	const struct kiFrame *frame;
+	uint16_t *readback;
+	unsigned int frames = 0, mismatches = 0, errors = 0;
+	double start, upload_ms = 0.0;
+	GLenum glew_status;
+
+	if(ofsCreate(&ofs, 16, 16) < 0){
+		return 1;
+	}
+	glew_status = glewInit();
+	#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	// GLX builds of GLEW complain under an EGL context but still load GL
+	if(glew_status == GLEW_ERROR_NO_GLX_DISPLAY){
+		glew_status = GLEW_OK;
+	}
+	#endif
+	if(glew_status != GLEW_OK){
+		fprintf(stderr, "Error: %s\n", glewGetErrorString(glew_status));
+		ofsDestroy(&ofs);
+		return 1;
+	}
+
+	if(kiSourceOpenFile(&src, filename, 0) < 0){
+		ofsDestroy(&ofs);
+		return 1;
+	}
+	kiSourceStart(&src, 0);
+	readback = (uint16_t*)malloc((size_t)src.width * src.height * sizeof(uint16_t));
+
+	while(kiSourceAcquire(&src)) {
+
+		frame = kiSourceFrame(&src);
+
+		start = get_time_ms();
+		kiSourceUpload(&src);
+		upload_ms += get_time_ms() - start;
+
+		glBindTexture(GL_TEXTURE_2D, src.depth_tex);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_LUMINANCE, GL_UNSIGNED_SHORT, readback);
+		mismatches += memcmp(readback, frame->depth, (size_t)src.width * src.height * sizeof(uint16_t)) != 0;
+		while(glGetError() != GL_NO_ERROR) {
+			errors++;
+		}
+		frames++;
+
+	}
+
+	fprintf(stderr, "Upload: %u frames, %lu uploads, %.3f ms/upload, %u frames read back wrong, %u GL errors\n",
+		frames, src.uploads, frames ? upload_ms / frames : 0.0, mismatches, errors);
+
+	free(readback);
+	kiSourceClose(&src);
+	ofsDestroy(&ofs);
+	return frames == 0 || mismatches || errors ? 1 : 0;
+
+}
+
+int main(int argc, char *argv[]) {
+
+	const char *capture_file = NULL;
+	const char *golden_file = NULL;
+	int i, status;
+
+	for(i = 3; i + 1 < argc; i += 2) {
+		if(strcmp(argv[i], "--capture") == 0){
+			capture_file = argv[i + 1];
+		} else if(strcmp(argv[i], "--golden") == 0){
+			golden_file = argv[i + 1];
+		}
+	}
+
+	if(argc > 2 && strcmp(argv[1], "--depth-synth") == 0){
+		return run_depth_synth(argv[2]);
+	}
+
+	if(argc > 2 && strcmp(argv[1], "--gesture") == 0){
+		return run_gesture(argv[2], capture_file, golden_file);
+	}
+
+	if(argc > 2 && strcmp(argv[1], "--upload") == 0){
+		return run_upload_check(argv[2]);
+	}
+
+	if(argc > 2 && strcmp(argv[1], "--cloud") == 0){
+		jobCreate(jobDefaultWorkers());
+		status = run_cloud_bench(argv[2]);
+		jobDestroy();
+		return status;
+	}
+
+	fprintf(stderr, "usage: %s --depth-synth FILE | --cloud FILE | --upload FILE | --gesture FILE [--capture FILE] [--golden FILE]\n", argv[0]);
+	return 1;
+
+}
@@ -0,0 +1,114 @@
+/*
+
+	Allocation Guard Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Counts heap calls made by the program so a frame that allocates after
+ * warmup can be caught. Build with -DALLOC_GUARD and link with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free (see
+ * 'make alloccheck'). Only calls from our own code are counted; allocations
+ * made inside libc or the GL driver are not wrapped. Without ALLOC_GUARD
+ * the counters stay at zero.
+ **/
+
+#define ALC_WARMUP_FRAMES 		60
+
+unsigned long alc_allocs = 0;
+unsigned long alc_frees = 0;
+unsigned long alc_bytes = 0;
+unsigned long alc_frame_start = 0;
+unsigned int alc_frame = 0;
+unsigned int alc_failed_frames = 0;
+
+void alcFrameBegin();
+unsigned long alcFrameEnd();
+
+#ifdef ALLOC_GUARD
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void* __wrap_malloc(size_t size) {
+
+	alc_allocs++;
+	alc_bytes += size;
+	return __real_malloc(size);
+
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+
+	alc_allocs++;
+	alc_bytes += count * size;
+	return __real_calloc(count, size);
+
+}
+
+void* __wrap_realloc(void *ptr, size_t size) {
+
+	alc_allocs++;
+	alc_bytes += size;
+	return __real_realloc(ptr, size);
+
+}
+
+void __wrap_free(void *ptr) {
+
+	if(ptr != NULL){
+		alc_frees++;
+	}
+	__real_free(ptr);
+
+}
+
+#endif
+
+/*
+ * alc frame begin
+ */
+
+void alcFrameBegin() {
+
+	alc_frame_start = alc_allocs;
+
+}
+
+/*
+ * alc frame end (returns allocations made since alcFrameBegin and
+ * records a failure for any frame past warmup that allocated)
+ */
+
+unsigned long alcFrameEnd() {
+
+	unsigned long count = alc_allocs - alc_frame_start;
+
+	if(count > 0 && alc_frame >= ALC_WARMUP_FRAMES){
+		alc_failed_frames++;
+		fprintf(stderr, "alloc guard: frame %u made %lu allocations\n", alc_frame, count);
+	}
+
+	alc_frame++;
+	return count;
+
+}
@@ -0,0 +1,126 @@
+/*
+
+	Arena Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Linear (bump) allocator for data that only lives for one frame. Memory
+ * is reserved once with arnCreate, handed out with arnAlloc and released
+ * all at once with arnReset at the start of the next frame. Build with
+ * -DARENA_DEBUG to poison released memory and report the high-water mark.
+ **/
+
+#define ARN_ALIGN 				16
+#define ARN_POISON 				0xdd
+
+struct arnArena {
+	unsigned char *base;
+	size_t size;
+	size_t used;
+	size_t high_water;
+	unsigned int frame;
+};
+
+void arnCreate(struct arnArena *arena, size_t size);
+void arnDestroy(struct arnArena *arena);
+void* arnAlloc(struct arnArena *arena, size_t size);
+void arnReset(struct arnArena *arena);
+
+/*
+ * arn create
+ */
+
+void arnCreate(struct arnArena *arena, size_t size) {
+
+	memset(arena, 0, sizeof(struct arnArena));
+	arena->base = (unsigned char*)malloc(size);
+
+	if(arena->base == NULL){
+		fprintf(stderr, "arnCreate could not reserve %lu bytes\n", (unsigned long)size);
+		exit(1);
+	}
+
+	arena->size = size;
+
+	#ifdef ARENA_DEBUG
+	memset(arena->base, ARN_POISON, size);
+	#endif
+
+}
+
+/*
+ * arn destroy
+ */
+
+void arnDestroy(struct arnArena *arena) {
+
+	#ifdef ARENA_DEBUG
+	fprintf(stderr, "arena: %u frames, high-water %lu of %lu bytes\n",
+		arena->frame, (unsigned long)arena->high_water, (unsigned long)arena->size);
+	#endif
+
+	free(arena->base);
+	memset(arena, 0, sizeof(struct arnArena));
+
+}
+
+/*
+ * arn alloc (16 byte aligned, exits when the arena is exhausted)
+ */
+
+void* arnAlloc(struct arnArena *arena, size_t size) {
+
+	size_t offset = (arena->used + ARN_ALIGN - 1) & ~(size_t)(ARN_ALIGN - 1);
+
+	if(offset + size > arena->size){
+		fprintf(stderr, "arnAlloc out of memory (%lu + %lu > %lu bytes)\n",
+			(unsigned long)offset, (unsigned long)size, (unsigned long)arena->size);
+		exit(1);
+	}
+
+	arena->used = offset + size;
+	return arena->base + offset;
+
+}
+
+/*
+ * arn reset (release everything allocated this frame)
+ */
+
+void arnReset(struct arnArena *arena) {
+
+	if(arena->used > arena->high_water){
+		arena->high_water = arena->used;
+		#ifdef ARENA_DEBUG
+		fprintf(stderr, "arena: frame %u new high-water %lu of %lu bytes\n",
+			arena->frame, (unsigned long)arena->high_water, (unsigned long)arena->size);
+		#endif
+	}
+
+	#ifdef ARENA_DEBUG
+	memset(arena->base, ARN_POISON, arena->used);
+	#endif
+
+	arena->used = 0;
+	arena->frame++;
+
+}
@@ -0,0 +1,419 @@
+/*
+
+	Bloom Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Glow post-process. The scene is drawn into a texture, a bright-pass
+ * writes what is over the threshold at half resolution, and each further
+ * level halves again and blurs with a separable 9 tap gaussian. The
+ * levels are then added back up the chain (bilinear upsample) and the
+ * result is composited over the scene into whatever framebuffer was bound
+ * before blmBeginScene. Every level costs a quarter of the one above, so
+ * the wide blur never runs at full resolution. levels is the quality
+ * knob. Passes are timed with GL_TIME_ELAPSED queries when the driver
+ * has ARB_timer_query, read back two frames late so they never stall.
+ **/
+
+#define BLM_MAX_LEVELS 			6
+#define BLM_PASS_SCENE 			0
+#define BLM_PASS_BRIGHT 		1
+#define BLM_PASS_BLUR 			2
+#define BLM_PASS_UPSAMPLE 		3
+#define BLM_PASS_COMPOSITE 		4
+#define BLM_PASSES 				5
+
+struct blmProgram {
+	GLuint id;
+	GLint attribute_coord2d;
+	GLint uniform_source;
+	GLint uniform_param;
+};
+
+struct blmChain {
+	int levels;
+	int width;
+	int height;
+	float threshold;
+	float intensity;
+	GLint target;
+	GLuint scene_fbo;
+	GLuint scene_tex;
+	GLuint fbo[BLM_MAX_LEVELS][2];
+	GLuint tex[BLM_MAX_LEVELS][2];
+	int level_width[BLM_MAX_LEVELS];
+	int level_height[BLM_MAX_LEVELS];
+	GLuint quad;
+	struct blmProgram bright;
+	struct blmProgram blur;
+	struct blmProgram copy;
+	struct blmProgram composite;
+	GLint uniform_bloom;
+	int timed;
+	GLuint queries[2][BLM_PASSES];
+	unsigned int frame;
+	unsigned int resized;
+	double pass_ms[BLM_PASSES];
+	unsigned int timed_frames;
+};
+
+int blmCreate(struct blmChain *chain, int levels, float threshold, float intensity);
+void blmDestroy(struct blmChain *chain);
+void blmBeginScene(struct blmChain *chain);
+void blmComposite(struct blmChain *chain);
+
+/*
+ * blm load program (every post shader shares post_vertex.glsl and has a
+ * source sampler plus one float or vec2 parameter)
+ */
+
+static void blmLoadProgram(struct blmProgram *prog, const char *fragment, const char *source, const char *param) {
+
+	prog->id = mtxCreateProgram("shdr/post_vertex.glsl", fragment);
+	prog->attribute_coord2d = mtxGetShaderAttribute(prog->id, "coord2d");
+	prog->uniform_source = mtxGetShaderUniform(prog->id, source);
+	prog->uniform_param = mtxGetShaderUniform(prog->id, param);
+
+}
+
+/*
+ * blm texture (linear filtered, clamped, no mips)
+ */
+
+static GLuint blmTexture(int width, int height) {
+
+	GLuint tex;
+
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	return tex;
+
+}
+
+static GLuint blmFramebuffer(GLuint tex) {
+
+	GLuint fbo;
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+	return fbo;
+
+}
+
+/*
+ * blm release targets
+ */
+
+static void blmReleaseTargets(struct blmChain *chain) {
+
+	int i;
+
+	if(chain->scene_fbo == 0){
+		return;
+	}
+
+	glDeleteFramebuffers(1, &chain->scene_fbo);
+	glDeleteTextures(1, &chain->scene_tex);
+	for(i = 0; i < chain->levels; i++) {
+		glDeleteFramebuffers(2, chain->fbo[i]);
+		glDeleteTextures(2, chain->tex[i]);
+	}
+	chain->scene_fbo = 0;
+
+}
+
+/*
+ * blm resize (scene target at full size, level i at size >> (i + 1))
+ */
+
+static int blmResize(struct blmChain *chain, int width, int height) {
+
+	int i, k;
+
+	blmReleaseTargets(chain);
+	chain->width = width;
+	chain->height = height;
+
+	chain->scene_tex = blmTexture(width, height);
+	chain->scene_fbo = blmFramebuffer(chain->scene_tex);
+
+	for(i = 0; i < chain->levels; i++) {
+		chain->level_width[i] = width >> (i + 1) > 0 ? width >> (i + 1) : 1;
+		chain->level_height[i] = height >> (i + 1) > 0 ? height >> (i + 1) : 1;
+		for(k = 0; k < 2; k++) {
+			chain->tex[i][k] = blmTexture(chain->level_width[i], chain->level_height[i]);
+			chain->fbo[i][k] = blmFramebuffer(chain->tex[i][k]);
+		}
+	}
+
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+		fprintf(stderr, "blmResize: framebuffer incomplete at %dx%d\n", width, height);
+		return -1;
+	}
+
+	return 0;
+
+}
+
+/*
+ * blm create (levels is clamped to BLM_MAX_LEVELS, targets are made on
+ * the first blmBeginScene once the viewport size is known)
+ */
+
+int blmCreate(struct blmChain *chain, int levels, float threshold, float intensity) {
+
+	const GLfloat quad[] = {
+		-1.0, -1.0, 1.0, -1.0, -1.0, 1.0,
+		-1.0, 1.0, 1.0, -1.0, 1.0, 1.0
+	};
+
+	memset(chain, 0, sizeof(struct blmChain));
+	chain->levels = levels < BLM_MAX_LEVELS ? levels : BLM_MAX_LEVELS;
+	chain->threshold = threshold;
+	chain->intensity = intensity;
+
+	if(!GLEW_VERSION_3_0 && !GLEW_ARB_framebuffer_object){
+		fprintf(stderr, "blmCreate: no framebuffer objects, bloom disabled\n");
+		chain->levels = 0;
+		return -1;
+	}
+
+	blmLoadProgram(&chain->bright, "shdr/post_bright.glsl", "source", "threshold");
+	blmLoadProgram(&chain->blur, "shdr/post_blur.glsl", "source", "direction");
+	blmLoadProgram(&chain->copy, "shdr/post_copy.glsl", "source", "scale");
+	blmLoadProgram(&chain->composite, "shdr/post_composite.glsl", "scene", "intensity");
+	chain->uniform_bloom = mtxGetShaderUniform(chain->composite.id, "bloom");
+
+	glGenBuffers(1, &chain->quad);
+	glBindBuffer(GL_ARRAY_BUFFER, chain->quad);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+
+	chain->timed = GLEW_ARB_timer_query;
+	if(chain->timed){
+		glGenQueries(2 * BLM_PASSES, &chain->queries[0][0]);
+	}
+
+	return 0;
+
+}
+
+/*
+ * blm destroy
+ */
+
+void blmDestroy(struct blmChain *chain) {
+
+	if(chain->quad == 0){
+		return;
+	}
+
+	blmReleaseTargets(chain);
+	glDeleteProgram(chain->bright.id);
+	glDeleteProgram(chain->blur.id);
+	glDeleteProgram(chain->copy.id);
+	glDeleteProgram(chain->composite.id);
+	glDeleteBuffers(1, &chain->quad);
+	if(chain->timed){
+		glDeleteQueries(2 * BLM_PASSES, &chain->queries[0][0]);
+	}
+	chain->quad = 0;
+
+}
+
+/*
+ * blm pass begin / end (timer query bracket, one per pass per frame)
+ */
+
+static void blmPassBegin(struct blmChain *chain, int pass) {
+
+	if(chain->timed){
+		glBeginQuery(GL_TIME_ELAPSED, chain->queries[chain->frame & 1][pass]);
+	}
+
+}
+
+static void blmPassEnd(struct blmChain *chain) {
+
+	if(chain->timed){
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+
+}
+
+/*
+ * blm collect (results for the query set about to be reused, issued two
+ * frames ago, skipped if that frame rebuilt the targets)
+ */
+
+static void blmCollect(struct blmChain *chain) {
+
+	GLuint64 ns;
+	int pass;
+
+	if(!chain->timed || chain->frame < 2){
+		return;
+	}
+
+	if(chain->frame - 2 == chain->resized){
+		return;
+	}
+
+	for(pass = 0; pass < BLM_PASSES; pass++) {
+		glGetQueryObjectui64v(chain->queries[chain->frame & 1][pass], GL_QUERY_RESULT, &ns);
+		chain->pass_ms[pass] += ns / 1000000.0;
+	}
+	chain->timed_frames++;
+
+}
+
+/*
+ * blm draw (fullscreen quad from source into the bound target)
+ */
+
+static void blmDraw(struct blmChain *chain, struct blmProgram *prog, GLuint source) {
+
+	glUseProgram(prog->id);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, source);
+	glUniform1i(prog->uniform_source, 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, chain->quad);
+	glEnableVertexAttribArray(prog->attribute_coord2d);
+	glVertexAttribPointer(prog->attribute_coord2d, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+	glDisableVertexAttribArray(prog->attribute_coord2d);
+
+}
+
+/*
+ * blm begin scene (redirect drawing into the scene texture, resizing the
+ * chain if the viewport changed)
+ */
+
+void blmBeginScene(struct blmChain *chain) {
+
+	GLint viewport[4];
+
+	if(chain->levels == 0){
+		return;
+	}
+
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &chain->target);
+
+	if(viewport[2] != chain->width || viewport[3] != chain->height){
+		if(blmResize(chain, viewport[2], viewport[3]) < 0){
+			chain->levels = 0;
+			glBindFramebuffer(GL_FRAMEBUFFER, chain->target);
+			return;
+		}
+		chain->resized = chain->frame;
+	}
+
+	blmCollect(chain);
+	glBindFramebuffer(GL_FRAMEBUFFER, chain->scene_fbo);
+	blmPassBegin(chain, BLM_PASS_SCENE);
+
+}
+
+/*
+ * blm composite
+ */
+
+void blmComposite(struct blmChain *chain) {
+
+	int i;
+
+	if(chain->levels == 0){
+		return;
+	}
+
+	blmPassEnd(chain);
+
+	// bright-pass, scene to level 0
+	blmPassBegin(chain, BLM_PASS_BRIGHT);
+	glBindFramebuffer(GL_FRAMEBUFFER, chain->fbo[0][0]);
+	glViewport(0, 0, chain->level_width[0], chain->level_height[0]);
+	glUseProgram(chain->bright.id);
+	glUniform1f(chain->bright.uniform_param, chain->threshold);
+	blmDraw(chain, &chain->bright, chain->scene_tex);
+	blmPassEnd(chain);
+
+	// down the chain: halve (except level 0), blur across, blur down
+	blmPassBegin(chain, BLM_PASS_BLUR);
+	for(i = 0; i < chain->levels; i++) {
+
+		glViewport(0, 0, chain->level_width[i], chain->level_height[i]);
+
+		if(i > 0){
+			glBindFramebuffer(GL_FRAMEBUFFER, chain->fbo[i][0]);
+			glUseProgram(chain->copy.id);
+			glUniform1f(chain->copy.uniform_param, 1.0);
+			blmDraw(chain, &chain->copy, chain->tex[i - 1][0]);
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, chain->fbo[i][1]);
+		glUseProgram(chain->blur.id);
+		glUniform2f(chain->blur.uniform_param, 1.0 / chain->level_width[i], 0.0);
+		blmDraw(chain, &chain->blur, chain->tex[i][0]);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, chain->fbo[i][0]);
+		glUniform2f(chain->blur.uniform_param, 0.0, 1.0 / chain->level_height[i]);
+		blmDraw(chain, &chain->blur, chain->tex[i][1]);
+
+	}
+	blmPassEnd(chain);
+
+	// back up the chain, each level added onto the one above
+	blmPassBegin(chain, BLM_PASS_UPSAMPLE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	glUseProgram(chain->copy.id);
+	glUniform1f(chain->copy.uniform_param, 1.0);
+	for(i = chain->levels - 1; i > 0; i--) {
+		glBindFramebuffer(GL_FRAMEBUFFER, chain->fbo[i - 1][0]);
+		glViewport(0, 0, chain->level_width[i - 1], chain->level_height[i - 1]);
+		blmDraw(chain, &chain->copy, chain->tex[i][0]);
+	}
+	glDisable(GL_BLEND);
+	blmPassEnd(chain);
+
+	blmPassBegin(chain, BLM_PASS_COMPOSITE);
+	glBindFramebuffer(GL_FRAMEBUFFER, chain->target);
+	glViewport(0, 0, chain->width, chain->height);
+	glUseProgram(chain->composite.id);
+	glUniform1f(chain->composite.uniform_param, chain->intensity);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, chain->tex[0][0]);
+	glUniform1i(chain->uniform_bloom, 1);
+	blmDraw(chain, &chain->composite, chain->scene_tex);
+	blmPassEnd(chain);
+
+	chain->frame++;
+
+}
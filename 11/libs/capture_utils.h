@@ -0,0 +1,301 @@
+/*
+
+	Capture Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/**
+ * Dumps every rendered frame to disk without stalling GL. capFrame starts
+ * an asynchronous glReadPixels of frame N into one of CAP_RING pixel
+ * buffer objects and maps the one holding frame N-2, which the GPU has
+ * long finished. The mapped pixels are copied into a preallocated queue
+ * slot and a writer thread flips, converts and writes them. Files ending
+ * in .y4m get YUV4MPEG2 4:2:0 (BT.601), anything else raw bottom-up RGBA.
+ **/
+
+#define CAP_RING 				3
+#define CAP_QUEUE 				8
+#define CAP_RAW 				0
+#define CAP_Y4M 				1
+
+struct capQueue {
+	unsigned char *slots[CAP_QUEUE];
+	unsigned int head;
+	unsigned int tail;
+	int quit;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	pthread_cond_t space;
+};
+
+struct capRing {
+	FILE *fp;
+	int format;
+	int width;
+	int height;
+	GLuint pbo[CAP_RING];
+	unsigned int issued;
+	unsigned int retired;
+	struct capQueue queue;
+	pthread_t writer;
+	unsigned char *yuv;
+	unsigned long bytes_written;
+	unsigned int stalls;
+};
+
+int capCreate(struct capRing *cap, const char *filename, int width, int height, int fps);
+void capFrame(struct capRing *cap);
+void capFinish(struct capRing *cap);
+void capDestroy(struct capRing *cap);
+
+/*
+ * cap write y4m (flip, RGBA to full range 4:2:0, one FRAME). Chroma
+ * planes round up, so an odd width or height gets a last column or row
+ * sampled from the last pixel, which is what 4:2:0 readers expect.
+ */
+
+static void capWriteY4M(struct capRing *cap, const unsigned char *rgba) {
+
+	int w = cap->width, h = cap->height, x, y, cw = (w + 1) / 2, ch = (h + 1) / 2;
+	unsigned char *Y = cap->yuv, *U = Y + w * h, *V = U + cw * ch;
+	const unsigned char *p;
+	int r, g, b;
+
+	for(y = 0; y < h; y++) {
+		p = &rgba[(size_t)(h - 1 - y) * w * 4];
+		for(x = 0; x < w; x++, p += 4){
+			Y[y * w + x] = (unsigned char)((77 * p[0] + 150 * p[1] + 29 * p[2]) >> 8);
+		}
+	}
+
+	for(y = 0; y < ch; y++) {
+		for(x = 0; x < cw; x++) {
+			p = &rgba[((size_t)(h - 1 - y * 2) * w + x * 2) * 4];
+			r = p[0]; g = p[1]; b = p[2];
+			U[y * cw + x] = (unsigned char)(((-43 * r - 85 * g + 128 * b) >> 8) + 128);
+			V[y * cw + x] = (unsigned char)(((128 * r - 107 * g - 21 * b) >> 8) + 128);
+		}
+	}
+
+	fwrite("FRAME\n", 1, 6, cap->fp);
+	fwrite(cap->yuv, 1, w * h + cw * ch * 2, cap->fp);
+	cap->bytes_written += 6 + w * h + cw * ch * 2;
+
+}
+
+/*
+ * cap writer (thread, drains the queue until told to quit and empty)
+ */
+
+static void* capWriter(void *arg) {
+
+	struct capRing *cap = (struct capRing*)arg;
+	struct capQueue *q = &cap->queue;
+	unsigned char *frame;
+	size_t size = (size_t)cap->width * cap->height * 4;
+
+	while(1) {
+
+		pthread_mutex_lock(&q->lock);
+		while(q->head == q->tail && !q->quit){
+			pthread_cond_wait(&q->ready, &q->lock);
+		}
+		if(q->head == q->tail){
+			pthread_mutex_unlock(&q->lock);
+			break;
+		}
+		frame = q->slots[q->head % CAP_QUEUE];
+		pthread_mutex_unlock(&q->lock);
+
+		if(cap->format == CAP_Y4M){
+			capWriteY4M(cap, frame);
+		} else {
+			fwrite(frame, 1, size, cap->fp);
+			cap->bytes_written += size;
+		}
+
+		pthread_mutex_lock(&q->lock);
+		q->head++;
+		pthread_cond_signal(&q->space);
+		pthread_mutex_unlock(&q->lock);
+
+	}
+
+	return NULL;
+
+}
+
+/*
+ * cap create (needs a current GL context with pixel buffer objects)
+ */
+
+int capCreate(struct capRing *cap, const char *filename, int width, int height, int fps) {
+
+	size_t size = (size_t)width * height * 4;
+	const char *ext = strrchr(filename, '.');
+	int i;
+
+	memset(cap, 0, sizeof(struct capRing));
+	cap->width = width;
+	cap->height = height;
+	cap->format = ext != NULL && strcmp(ext, ".y4m") == 0 ? CAP_Y4M : CAP_RAW;
+
+	cap->fp = fopen(filename, "wb");
+	if(cap->fp == NULL){
+		fprintf(stderr, "Could not open %s\n", filename);
+		return -1;
+	}
+
+	if(cap->format == CAP_Y4M){
+		fprintf(cap->fp, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+		cap->yuv = (unsigned char*)malloc(width * height + ((width + 1) / 2) * ((height + 1) / 2) * 2);
+	}
+
+	for(i = 0; i < CAP_QUEUE; i++) {
+		cap->queue.slots[i] = (unsigned char*)malloc(size);
+		if(cap->queue.slots[i] == NULL){
+			fprintf(stderr, "capCreate out of memory\n");
+			exit(1);
+		}
+	}
+
+	glGenBuffers(CAP_RING, cap->pbo);
+	for(i = 0; i < CAP_RING; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, cap->pbo[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	pthread_mutex_init(&cap->queue.lock, NULL);
+	pthread_cond_init(&cap->queue.ready, NULL);
+	pthread_cond_init(&cap->queue.space, NULL);
+	pthread_create(&cap->writer, NULL, capWriter, cap);
+
+	return 0;
+
+}
+
+/*
+ * cap retire (map the oldest pending PBO and queue its pixels, blocks
+ * only if the writer has fallen CAP_QUEUE frames behind)
+ */
+
+static void capRetire(struct capRing *cap) {
+
+	struct capQueue *q = &cap->queue;
+	const unsigned char *src;
+	size_t size = (size_t)cap->width * cap->height * 4;
+
+	pthread_mutex_lock(&q->lock);
+	if(q->tail - q->head == CAP_QUEUE){
+		cap->stalls++;
+		while(q->tail - q->head == CAP_QUEUE){
+			pthread_cond_wait(&q->space, &q->lock);
+		}
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, cap->pbo[cap->retired % CAP_RING]);
+	src = (const unsigned char*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+	if(src != NULL){
+		memcpy(q->slots[q->tail % CAP_QUEUE], src, size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	cap->retired++;
+
+	if(src != NULL){
+		pthread_mutex_lock(&q->lock);
+		q->tail++;
+		pthread_cond_signal(&q->ready);
+		pthread_mutex_unlock(&q->lock);
+	}
+
+}
+
+/*
+ * cap frame (call after drawing, before the swap)
+ */
+
+void capFrame(struct capRing *cap) {
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, cap->pbo[cap->issued % CAP_RING]);
+	glReadPixels(0, 0, cap->width, cap->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	cap->issued++;
+
+	if(cap->issued - cap->retired == CAP_RING){
+		capRetire(cap);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+}
+
+/*
+ * cap finish (retire the frames still in flight, GL context must be
+ * current)
+ */
+
+void capFinish(struct capRing *cap) {
+
+	while(cap->retired < cap->issued){
+		capRetire(cap);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if(cap->pbo[0]){
+		glDeleteBuffers(CAP_RING, cap->pbo);
+		memset(cap->pbo, 0, sizeof(cap->pbo));
+	}
+
+}
+
+/*
+ * cap destroy (waits for the writer to drain, no GL calls)
+ */
+
+void capDestroy(struct capRing *cap) {
+
+	int i;
+
+	if(cap->fp == NULL){
+		return;
+	}
+
+	pthread_mutex_lock(&cap->queue.lock);
+	cap->queue.quit = 1;
+	pthread_cond_signal(&cap->queue.ready);
+	pthread_mutex_unlock(&cap->queue.lock);
+	pthread_join(cap->writer, NULL);
+
+	pthread_mutex_destroy(&cap->queue.lock);
+	pthread_cond_destroy(&cap->queue.ready);
+	pthread_cond_destroy(&cap->queue.space);
+
+	for(i = 0; i < CAP_QUEUE; i++){
+		free(cap->queue.slots[i]);
+	}
+	free(cap->yuv);
+	fclose(cap->fp);
+	cap->fp = NULL;
+
+}
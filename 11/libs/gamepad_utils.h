@@ -33,6 +33,15 @@
 #define GAMEPAD_BUTTON_SELECT_MASK 	0x40
 #define GAMEPAD_BUTTON_START_MASK 	0x80
 
+/**
+ * Define Directional Masks (packed input only)
+ **/
+
+#define GAMEPAD_LEFT_MASK 			0x100
+#define GAMEPAD_RIGHT_MASK 			0x200
+#define GAMEPAD_UP_MASK 			0x400
+#define GAMEPAD_DOWN_MASK 			0x800
+
 /**
  * Define Directional Buttons
  **/
@@ -81,3 +90,51 @@ void gamepad_callback( unsigned int btn_mask, int x, int y, int z ) {
 
 }
 
+
+/**
+ * Pack current gamepad state into a single mask (for recording)
+ **/
+
+unsigned int gamepad_get_mask() {
+
+	unsigned int mask = 0;
+
+	mask |= GAMEPAD_LEFT 	? GAMEPAD_LEFT_MASK : 0;
+	mask |= GAMEPAD_RIGHT 	? GAMEPAD_RIGHT_MASK : 0;
+	mask |= GAMEPAD_UP 		? GAMEPAD_UP_MASK : 0;
+	mask |= GAMEPAD_DOWN 	? GAMEPAD_DOWN_MASK : 0;
+
+	mask |= GAMEPAD_BUTTON_A ? GAMEPAD_BUTTON_A_MASK : 0;
+	mask |= GAMEPAD_BUTTON_B ? GAMEPAD_BUTTON_B_MASK : 0;
+	mask |= GAMEPAD_BUTTON_X ? GAMEPAD_BUTTON_X_MASK : 0;
+	mask |= GAMEPAD_BUTTON_Y ? GAMEPAD_BUTTON_Y_MASK : 0;
+	mask |= GAMEPAD_BUTTON_L ? GAMEPAD_BUTTON_L_MASK : 0;
+	mask |= GAMEPAD_BUTTON_R ? GAMEPAD_BUTTON_R_MASK : 0;
+	mask |= GAMEPAD_BUTTON_SELECT ? GAMEPAD_BUTTON_SELECT_MASK : 0;
+	mask |= GAMEPAD_BUTTON_START ? GAMEPAD_BUTTON_START_MASK : 0;
+
+	return mask;
+
+}
+
+/**
+ * Restore gamepad state from a packed mask (for playback)
+ **/
+
+void gamepad_set_mask(unsigned int mask) {
+
+	GAMEPAD_LEFT 	= mask & GAMEPAD_LEFT_MASK ? true : false;
+	GAMEPAD_RIGHT 	= mask & GAMEPAD_RIGHT_MASK ? true : false;
+	GAMEPAD_UP 		= mask & GAMEPAD_UP_MASK ? true : false;
+	GAMEPAD_DOWN 	= mask & GAMEPAD_DOWN_MASK ? true : false;
+
+	GAMEPAD_BUTTON_A = mask & GAMEPAD_BUTTON_A_MASK ? true : false;
+	GAMEPAD_BUTTON_B = mask & GAMEPAD_BUTTON_B_MASK ? true : false;
+	GAMEPAD_BUTTON_X = mask & GAMEPAD_BUTTON_X_MASK ? true : false;
+	GAMEPAD_BUTTON_Y = mask & GAMEPAD_BUTTON_Y_MASK ? true : false;
+	GAMEPAD_BUTTON_L = mask & GAMEPAD_BUTTON_L_MASK ? true : false;
+	GAMEPAD_BUTTON_R = mask & GAMEPAD_BUTTON_R_MASK ? true : false;
+	GAMEPAD_BUTTON_SELECT = mask & GAMEPAD_BUTTON_SELECT_MASK ? true : false;
+	GAMEPAD_BUTTON_START = mask & GAMEPAD_BUTTON_START_MASK ? true : false;
+
+}
@@ -0,0 +1,334 @@
+/*
+
+	Job Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/**
+ * Work-stealing job scheduler. Every thread (the calling thread is slot
+ * 0, workers are 1..n) owns a deque: it pushes and pops at the bottom,
+ * idle threads steal from the top of someone else's. jobParallelFor
+ * splits an index range into grain sized jobs on the caller's deque and
+ * helps run them until all are done, so it behaves like a plain loop
+ * when there are no workers. Deques are small mutex-protected rings;
+ * jobs are coarse so the lock is never contended for long.
+ **/
+
+#define JOB_MAX_THREADS 		33
+#define JOB_DEQUE_SIZE 			4096
+#define JOB_SPIN 				2000
+
+typedef void (*jobFunc)(void *data, unsigned int begin, unsigned int end);
+
+struct jobTask {
+	jobFunc func;
+	void *data;
+	unsigned int begin;
+	unsigned int end;
+	volatile unsigned int *remaining;
+};
+
+struct jobDeque {
+	pthread_mutex_t lock;
+	unsigned int top;
+	unsigned int bottom;
+	struct jobTask tasks[JOB_DEQUE_SIZE];
+};
+
+struct jobSystem {
+	unsigned int num_threads;
+	int initialized;
+	volatile int quit;
+	unsigned int wake;
+	pthread_mutex_t sleep_lock;
+	pthread_cond_t sleep_cond;
+	pthread_t threads[JOB_MAX_THREADS];
+	struct jobDeque deques[JOB_MAX_THREADS];
+};
+
+struct jobSystem jobs;
+static __thread unsigned int job_thread_index = 0;
+
+void jobCreate(unsigned int num_workers);
+void jobDestroy();
+unsigned int jobDefaultWorkers();
+void jobParallelFor(unsigned int count, unsigned int grain, jobFunc func, void *data);
+
+/*
+ * job push / pop (bottom, owner only) and steal (top, anyone)
+ */
+
+static int jobPush(struct jobDeque *dq, struct jobTask *task) {
+
+	int ok = 0;
+
+	pthread_mutex_lock(&dq->lock);
+	if(dq->bottom - dq->top < JOB_DEQUE_SIZE){
+		dq->tasks[dq->bottom % JOB_DEQUE_SIZE] = *task;
+		dq->bottom++;
+		ok = 1;
+	}
+	pthread_mutex_unlock(&dq->lock);
+	return ok;
+
+}
+
+static int jobPop(struct jobDeque *dq, struct jobTask *task) {
+
+	int ok = 0;
+
+	pthread_mutex_lock(&dq->lock);
+	if(dq->bottom != dq->top){
+		dq->bottom--;
+		*task = dq->tasks[dq->bottom % JOB_DEQUE_SIZE];
+		ok = 1;
+	}
+	pthread_mutex_unlock(&dq->lock);
+	return ok;
+
+}
+
+static int jobSteal(struct jobDeque *dq, struct jobTask *task) {
+
+	int ok = 0;
+
+	pthread_mutex_lock(&dq->lock);
+	if(dq->bottom != dq->top){
+		*task = dq->tasks[dq->top % JOB_DEQUE_SIZE];
+		dq->top++;
+		ok = 1;
+	}
+	pthread_mutex_unlock(&dq->lock);
+	return ok;
+
+}
+
+/*
+ * job find (own deque first, then steal round robin from the others)
+ */
+
+static int jobFind(unsigned int self, struct jobTask *task) {
+
+	unsigned int i, victim;
+
+	if(jobPop(&jobs.deques[self], task)){
+		return 1;
+	}
+
+	for(i = 1; i < jobs.num_threads; i++) {
+		victim = (self + i) % jobs.num_threads;
+		if(jobSteal(&jobs.deques[victim], task)){
+			return 1;
+		}
+	}
+
+	return 0;
+
+}
+
+static void jobRun(struct jobTask *task) {
+
+	task->func(task->data, task->begin, task->end);
+	__sync_fetch_and_sub(task->remaining, 1);
+
+}
+
+/*
+ * job worker (spins briefly when idle, then sleeps until new work)
+ */
+
+static void* jobWorker(void *arg) {
+
+	struct jobTask task;
+	unsigned int spin = 0, seen;
+
+	job_thread_index = (unsigned int)(size_t)arg;
+
+	while(!jobs.quit) {
+
+		if(jobFind(job_thread_index, &task)){
+			jobRun(&task);
+			spin = 0;
+			continue;
+		}
+
+		if(++spin < JOB_SPIN){
+			continue;
+		}
+
+		// take the wake count before the last look, so work pushed after
+		// that look has bumped it and the wait below falls through
+		pthread_mutex_lock(&jobs.sleep_lock);
+		seen = jobs.wake;
+		pthread_mutex_unlock(&jobs.sleep_lock);
+
+		if(jobFind(job_thread_index, &task)){
+			jobRun(&task);
+			spin = 0;
+			continue;
+		}
+
+		pthread_mutex_lock(&jobs.sleep_lock);
+		while(seen == jobs.wake && !jobs.quit){
+			pthread_cond_wait(&jobs.sleep_cond, &jobs.sleep_lock);
+		}
+		pthread_mutex_unlock(&jobs.sleep_lock);
+		spin = 0;
+
+	}
+
+	return NULL;
+
+}
+
+/*
+ * job default workers (one per core besides the calling thread)
+ */
+
+unsigned int jobDefaultWorkers() {
+
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if(cores < 1){
+		cores = 1;
+	}
+	if(cores > JOB_MAX_THREADS){
+		cores = JOB_MAX_THREADS;
+	}
+	return (unsigned int)cores - 1;
+
+}
+
+/*
+ * job create
+ */
+
+void jobCreate(unsigned int num_workers) {
+
+	unsigned int i;
+
+	if(num_workers > JOB_MAX_THREADS - 1){
+		num_workers = JOB_MAX_THREADS - 1;
+	}
+
+	memset(&jobs, 0, sizeof(struct jobSystem));
+	jobs.num_threads = num_workers + 1;
+	jobs.initialized = 1;
+	pthread_mutex_init(&jobs.sleep_lock, NULL);
+	pthread_cond_init(&jobs.sleep_cond, NULL);
+
+	for(i = 0; i < jobs.num_threads; i++){
+		pthread_mutex_init(&jobs.deques[i].lock, NULL);
+	}
+
+	job_thread_index = 0;
+	for(i = 1; i < jobs.num_threads; i++) {
+		if(pthread_create(&jobs.threads[i], NULL, jobWorker, (void*)(size_t)i) != 0){
+			fprintf(stderr, "jobCreate could not start worker %u\n", i);
+			exit(1);
+		}
+	}
+
+}
+
+/*
+ * job destroy (safe to call again, or without jobCreate)
+ */
+
+void jobDestroy() {
+
+	unsigned int i;
+
+	if(jobs.num_threads == 0 || !jobs.initialized){
+		return;
+	}
+
+	pthread_mutex_lock(&jobs.sleep_lock);
+	jobs.quit = 1;
+	pthread_cond_broadcast(&jobs.sleep_cond);
+	pthread_mutex_unlock(&jobs.sleep_lock);
+
+	for(i = 1; i < jobs.num_threads; i++){
+		pthread_join(jobs.threads[i], NULL);
+	}
+
+	for(i = 0; i < jobs.num_threads; i++){
+		pthread_mutex_destroy(&jobs.deques[i].lock);
+	}
+	pthread_mutex_destroy(&jobs.sleep_lock);
+	pthread_cond_destroy(&jobs.sleep_cond);
+	jobs.num_threads = 0;
+	jobs.initialized = 0;
+
+}
+
+/*
+ * job parallel for
+ * Runs func over [0, count) in grain sized pieces and returns when every
+ * piece has finished. The caller runs jobs too (its own or stolen ones),
+ * so nested calls from inside a job are fine.
+ */
+
+void jobParallelFor(unsigned int count, unsigned int grain, jobFunc func, void *data) {
+
+	struct jobTask task;
+	volatile unsigned int remaining = 0;
+	unsigned int self = job_thread_index, begin;
+
+	if(grain == 0){
+		grain = 1;
+	}
+
+	if(jobs.num_threads <= 1 || count <= grain){
+		if(count > 0){
+			func(data, 0, count);
+		}
+		return;
+	}
+
+	task.func = func;
+	task.data = data;
+	task.remaining = &remaining;
+
+	for(begin = 0; begin < count; begin += grain) {
+		task.begin = begin;
+		task.end = begin + grain < count ? begin + grain : count;
+		__sync_fetch_and_add(&remaining, 1);
+		if(!jobPush(&jobs.deques[self], &task)){
+			func(data, task.begin, task.end);
+			__sync_fetch_and_sub(&remaining, 1);
+		}
+	}
+
+	pthread_mutex_lock(&jobs.sleep_lock);
+	jobs.wake++;
+	pthread_cond_broadcast(&jobs.sleep_cond);
+	pthread_mutex_unlock(&jobs.sleep_lock);
+
+	while(remaining > 0) {
+		if(jobFind(self, &task)){
+			jobRun(&task);
+		}
+	}
+
+}
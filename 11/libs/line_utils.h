@@ -0,0 +1,248 @@
+/*
+
+	Line Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ * Batched anti-aliased lines. Polylines are transformed by their 2D
+ * affine model transform (A_xx layout from mathGL.h) on the CPU and
+ * each segment is expanded into a screen space quad one pixel wider
+ * than the stroke on each side, with the distance in pixels from the
+ * center line as a vertex attribute. lnBegin takes the pixels per
+ * projection unit on each axis, so the stroke and its AA ramp stay the
+ * same number of pixels however the window scales the projection.
+ * shdr/line_fragment.glsl turns that distance into coverage. Everything
+ * queued between lnBegin and lnFlush goes out through one streaming
+ * buffer in one draw call.
+ **/
+
+#define LN_FLOATS 				3
+#define LN_SEGMENT_VERTS 		6
+
+struct lnBatch {
+	GLuint vbo;
+	GLuint program;
+	GLint attribute_coord2d;
+	GLint attribute_edge;
+	GLint uniform_matrixOrtho2d;
+	GLint uniform_halfWidth;
+	float half_width;
+	float scale_x;
+	float scale_y;
+	GLfloat *verts;
+	unsigned int count;
+	unsigned int capacity;
+	unsigned long total_segments;
+	unsigned int draw_calls;
+};
+
+void lnCreate(struct lnBatch *batch, GLuint program, unsigned int max_segments, float width);
+void lnDestroy(struct lnBatch *batch);
+void lnBegin(struct lnBatch *batch, float scale_x, float scale_y);
+void lnLoop(struct lnBatch *batch, const GLfloat *model, const GLfloat *coords, unsigned int count);
+void lnSegment(struct lnBatch *batch, float x0, float y0, float x1, float y1);
+void lnFlush(struct lnBatch *batch, const GLfloat *projection);
+
+/*
+ * ln create (program built from shdr/line_vertex.glsl and
+ * shdr/line_fragment.glsl)
+ */
+
+void lnCreate(struct lnBatch *batch, GLuint program, unsigned int max_segments, float width) {
+
+	memset(batch, 0, sizeof(struct lnBatch));
+	batch->program = program;
+	batch->half_width = width * 0.5f;
+	batch->scale_x = 1.0f;
+	batch->scale_y = 1.0f;
+	batch->capacity = max_segments;
+	batch->verts = (GLfloat*)malloc(max_segments * LN_SEGMENT_VERTS * LN_FLOATS * sizeof(GLfloat));
+
+	if(batch->verts == NULL){
+		fprintf(stderr, "lnCreate could not reserve %u segments\n", max_segments);
+		exit(1);
+	}
+
+	batch->attribute_coord2d = mtxGetShaderAttribute(program, "coord2d");
+	batch->attribute_edge = mtxGetShaderAttribute(program, "edge");
+	batch->uniform_matrixOrtho2d = mtxGetShaderUniform(program, "matrixOrtho2d");
+	batch->uniform_halfWidth = mtxGetShaderUniform(program, "halfWidth");
+
+	glGenBuffers(1, &batch->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, batch->vbo);
+	glBufferData(GL_ARRAY_BUFFER, max_segments * LN_SEGMENT_VERTS * LN_FLOATS * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+
+}
+
+/*
+ * ln destroy
+ */
+
+void lnDestroy(struct lnBatch *batch) {
+
+	if(batch->vbo){
+		glDeleteBuffers(1, &batch->vbo);
+	}
+	free(batch->verts);
+	memset(batch, 0, sizeof(struct lnBatch));
+
+}
+
+/*
+ * ln begin (scale is pixels per projection unit, viewport size over
+ * projection size)
+ */
+
+void lnBegin(struct lnBatch *batch, float scale_x, float scale_y) {
+
+	batch->count = 0;
+	batch->scale_x = scale_x > 0.0f ? scale_x : 1.0f;
+	batch->scale_y = scale_y > 0.0f ? scale_y : 1.0f;
+
+}
+
+/*
+ * ln segment (projection units in, expanded in pixels and extended by
+ * the half width past each end so joints in a loop overlap instead of
+ * leaving notches, dropped once the batch is full)
+ */
+
+void lnSegment(struct lnBatch *batch, float x0, float y0, float x1, float y1) {
+
+	float sx = batch->scale_x, sy = batch->scale_y;
+	float dx, dy, len;
+	float w = batch->half_width + 1.0f;
+	float nx, ny, ex, ey;
+	GLfloat *v;
+
+	if(batch->count == batch->capacity){
+		return;
+	}
+
+	x0 *= sx; y0 *= sy;
+	x1 *= sx; y1 *= sy;
+	dx = x1 - x0;
+	dy = y1 - y0;
+	len = sqrtf(dx * dx + dy * dy);
+
+	if(len < 1e-6f){
+		dx = 1.0f;
+		dy = 0.0f;
+		len = 1.0f;
+	}
+
+	dx /= len;
+	dy /= len;
+	nx = -dy * w;
+	ny = dx * w;
+	ex = dx * batch->half_width;
+	ey = dy * batch->half_width;
+	x0 -= ex; y0 -= ey;
+	x1 += ex; y1 += ey;
+
+	v = &batch->verts[batch->count * LN_SEGMENT_VERTS * LN_FLOATS];
+	#define LN_VERT(i, x, y, e) v[i * 3 + 0] = (x) / sx; v[i * 3 + 1] = (y) / sy; v[i * 3 + 2] = e;
+	LN_VERT(0, x0 + nx, y0 + ny, w);
+	LN_VERT(1, x0 - nx, y0 - ny, -w);
+	LN_VERT(2, x1 + nx, y1 + ny, w);
+	LN_VERT(3, x1 + nx, y1 + ny, w);
+	LN_VERT(4, x0 - nx, y0 - ny, -w);
+	LN_VERT(5, x1 - nx, y1 - ny, -w);
+	#undef LN_VERT
+
+	batch->count++;
+
+}
+
+/*
+ * ln loop (count model space vertices as GL_LINE_LOOP would draw them,
+ * model is a six float affine transform)
+ */
+
+void lnLoop(struct lnBatch *batch, const GLfloat *model, const GLfloat *coords, unsigned int count) {
+
+	float px, py, fx, fy, x, y;
+	unsigned int i;
+
+	if(count < 2){
+		return;
+	}
+
+	fx = model[A_00] * coords[0] + model[A_01] * coords[1] + model[A_02];
+	fy = model[A_10] * coords[0] + model[A_11] * coords[1] + model[A_12];
+	px = fx;
+	py = fy;
+
+	for(i = 1; i < count; i++) {
+		x = model[A_00] * coords[i * 2] + model[A_01] * coords[i * 2 + 1] + model[A_02];
+		y = model[A_10] * coords[i * 2] + model[A_11] * coords[i * 2 + 1] + model[A_12];
+		lnSegment(batch, px, py, x, y);
+		px = x;
+		py = y;
+	}
+
+	lnSegment(batch, px, py, fx, fy);
+
+}
+
+/*
+ * ln flush
+ * Orphans the buffer and uploads only what was queued, then draws it all
+ * with additive blending so overlapping strokes glow. Leaves the line
+ * program bound.
+ */
+
+void lnFlush(struct lnBatch *batch, const GLfloat *projection) {
+
+	GLsizeiptr size = batch->count * LN_SEGMENT_VERTS * LN_FLOATS * sizeof(GLfloat);
+
+	if(batch->count == 0){
+		return;
+	}
+
+	glUseProgram(batch->program);
+	glUniformMatrix4fv(batch->uniform_matrixOrtho2d, 1, GL_FALSE, projection);
+	glUniform1f(batch->uniform_halfWidth, batch->half_width);
+
+	glBindBuffer(GL_ARRAY_BUFFER, batch->vbo);
+	glBufferData(GL_ARRAY_BUFFER, batch->capacity * LN_SEGMENT_VERTS * LN_FLOATS * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, batch->verts);
+
+	glEnableVertexAttribArray(batch->attribute_coord2d);
+	glEnableVertexAttribArray(batch->attribute_edge);
+	glVertexAttribPointer(batch->attribute_coord2d, 2, GL_FLOAT, GL_FALSE, LN_FLOATS * sizeof(GLfloat), 0);
+	glVertexAttribPointer(batch->attribute_edge, 1, GL_FLOAT, GL_FALSE, LN_FLOATS * sizeof(GLfloat),
+		(const GLvoid*)(2 * sizeof(GLfloat)));
+
+	glEnable(GL_BLEND);
+	glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE, GL_ZERO, GL_ONE);
+	glDrawArrays(GL_TRIANGLES, 0, batch->count * LN_SEGMENT_VERTS);
+	glDisable(GL_BLEND);
+
+	glDisableVertexAttribArray(batch->attribute_coord2d);
+	glDisableVertexAttribArray(batch->attribute_edge);
+
+	batch->total_segments += batch->count;
+	batch->draw_calls++;
+
+}
@@ -0,0 +1,509 @@
+/*
+
+	Network Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/**
+ * Unreliable UDP transport for the client/server modes. Every packet is
+ * NET_PACKET_SIZE bytes and starts with a header carrying the sender's
+ * sequence number, the newest sequence it has received from the other
+ * side and a bitfield of the NET_ACK_BITS before that. Nothing is ever
+ * resent; a netPeer just learns which of its packets got through (for
+ * loss and round trip stats) and callers put redundancy in the payload
+ * where it matters, like the last few inputs in every input packet.
+ *
+ * Sockets can hold outgoing packets back to simulate a bad network:
+ * each is dropped with probability loss or released latency ms (plus up
+ * to jitter ms, so packets can arrive out of order) after it was sent.
+ * Times are whatever clock the caller passes in, so a test can run on
+ * simulated time. All integers go on the wire little-endian.
+ **/
+
+#define NET_PACKET_SIZE 		1400
+#define NET_HEADER_SIZE 		8
+#define NET_ACK_BITS 			32
+#define NET_ACK_WINDOW 			256
+#define NET_QUEUE 				512
+#define NET_INPUT_BUFFER 		128
+
+struct netHeld {
+	double release_ms;
+	struct sockaddr_in addr;
+	unsigned char data[NET_PACKET_SIZE];
+};
+
+struct netSocket {
+	int fd;
+	double latency_ms;
+	double jitter_ms;
+	float loss;
+	unsigned int rng;
+	struct netHeld *held;
+	unsigned int num_held;
+	unsigned long packets_sent;
+	unsigned long packets_dropped;
+	unsigned long packets_received;
+};
+
+struct netPeer {
+	struct sockaddr_in addr;
+	uint16_t local_seq;
+	uint16_t remote_seq;
+	uint32_t recv_bits;
+	int have_remote;
+	double sent_ms[NET_ACK_WINDOW];
+	uint16_t sent_seq[NET_ACK_WINDOW];
+	unsigned char acked[NET_ACK_WINDOW];
+	uint16_t newest_acked;
+	int have_acked;
+	double last_recv_ms;
+	float rtt_ms;
+	unsigned long sent;
+	unsigned long received;
+	unsigned long acked_count;
+	unsigned long stale;
+	unsigned long bytes_sent;
+	unsigned long bytes_received;
+};
+
+struct netInputBuffer {
+	uint32_t tick[NET_INPUT_BUFFER];
+	uint32_t mask[NET_INPUT_BUFFER];
+	unsigned char valid[NET_INPUT_BUFFER];
+};
+
+int netOpen(struct netSocket *sock, int port);
+void netClose(struct netSocket *sock);
+int netPort(const struct netSocket *sock);
+int netResolve(struct sockaddr_in *addr, const char *host, int port);
+void netSetConditions(struct netSocket *sock, double latency_ms, double jitter_ms, float loss, unsigned int seed);
+void netSend(struct netSocket *sock, const struct sockaddr_in *addr, const unsigned char *packet, double now_ms);
+void netFlush(struct netSocket *sock, double now_ms);
+int netRecv(struct netSocket *sock, struct sockaddr_in *addr, unsigned char *packet);
+void netPeerInit(struct netPeer *peer, const struct sockaddr_in *addr);
+void netPeerStamp(struct netPeer *peer, unsigned char *packet, double now_ms);
+int netPeerAccept(struct netPeer *peer, const unsigned char *packet, double now_ms);
+void netInputClear(struct netInputBuffer *buf);
+void netInputPut(struct netInputBuffer *buf, uint32_t tick, uint32_t mask);
+int netInputGet(const struct netInputBuffer *buf, uint32_t tick, uint32_t *mask);
+
+/*
+ * net put / get (little-endian fields, return the position after them)
+ */
+
+static inline unsigned char* netPut16(unsigned char *p, uint16_t v) {
+	p[0] = v & 0xff;
+	p[1] = v >> 8;
+	return p + 2;
+}
+
+static inline unsigned char* netPut32(unsigned char *p, uint32_t v) {
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = v >> 24;
+	return p + 4;
+}
+
+static inline unsigned char* netPutFloat(unsigned char *p, float f) {
+	uint32_t v;
+	memcpy(&v, &f, sizeof(v));
+	return netPut32(p, v);
+}
+
+static inline const unsigned char* netGet16(const unsigned char *p, uint16_t *v) {
+	*v = (uint16_t)(p[0] | (p[1] << 8));
+	return p + 2;
+}
+
+static inline const unsigned char* netGet32(const unsigned char *p, uint32_t *v) {
+	*v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	return p + 4;
+}
+
+static inline const unsigned char* netGetFloat(const unsigned char *p, float *f) {
+	uint32_t v;
+	p = netGet32(p, &v);
+	memcpy(f, &v, sizeof(v));
+	return p;
+}
+
+/*
+ * net seq newer (a came after b, allowing for wrap around)
+ */
+
+static inline int netSeqNewer(uint16_t a, uint16_t b) {
+	return (a > b && a - b <= 32768) || (a < b && b - a > 32768);
+}
+
+/*
+ * net open (non-blocking UDP socket on port, 0 picks a free one)
+ */
+
+int netOpen(struct netSocket *sock, int port) {
+
+	struct sockaddr_in addr;
+
+	memset(sock, 0, sizeof(struct netSocket));
+	sock->fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if(sock->fd < 0){
+		fprintf(stderr, "netOpen could not create a socket\n");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons((uint16_t)port);
+
+	if(bind(sock->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+		fcntl(sock->fd, F_SETFL, fcntl(sock->fd, F_GETFL) | O_NONBLOCK) < 0){
+		fprintf(stderr, "netOpen could not bind port %d\n", port);
+		close(sock->fd);
+		sock->fd = -1;
+		return -1;
+	}
+
+	sock->held = (struct netHeld*)malloc(NET_QUEUE * sizeof(struct netHeld));
+	if(sock->held == NULL){
+		fprintf(stderr, "netOpen out of memory\n");
+		exit(1);
+	}
+	sock->rng = 0x2545f491;
+
+	return 0;
+
+}
+
+/*
+ * net close (held packets are dropped)
+ */
+
+void netClose(struct netSocket *sock) {
+
+	if(sock->fd >= 0){
+		close(sock->fd);
+	}
+	free(sock->held);
+	memset(sock, 0, sizeof(struct netSocket));
+	sock->fd = -1;
+
+}
+
+/*
+ * net port (the port a socket ended up bound to)
+ */
+
+int netPort(const struct netSocket *sock) {
+
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+
+	if(getsockname(sock->fd, (struct sockaddr*)&addr, &len) < 0){
+		return -1;
+	}
+	return ntohs(addr.sin_port);
+
+}
+
+/*
+ * net resolve (host name or dotted address)
+ */
+
+int netResolve(struct sockaddr_in *addr, const char *host, int port) {
+
+	struct addrinfo hints, *res;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	if(getaddrinfo(host, NULL, &hints, &res) != 0){
+		fprintf(stderr, "netResolve could not resolve %s\n", host);
+		return -1;
+	}
+
+	memcpy(addr, res->ai_addr, sizeof(struct sockaddr_in));
+	addr->sin_port = htons((uint16_t)port);
+	freeaddrinfo(res);
+	return 0;
+
+}
+
+/*
+ * net set conditions (applies to packets sent from now on)
+ */
+
+void netSetConditions(struct netSocket *sock, double latency_ms, double jitter_ms, float loss, unsigned int seed) {
+
+	sock->latency_ms = latency_ms;
+	sock->jitter_ms = jitter_ms;
+	sock->loss = loss;
+	sock->rng = seed ? seed : 0x2545f491;
+
+}
+
+static float netRandom(struct netSocket *sock) {
+
+	sock->rng ^= sock->rng << 13;
+	sock->rng ^= sock->rng >> 17;
+	sock->rng ^= sock->rng << 5;
+	return (sock->rng >> 8) * (1.0f / 16777216.0f);
+
+}
+
+static void netSendNow(struct netSocket *sock, const struct sockaddr_in *addr, const unsigned char *packet) {
+
+	if(sendto(sock->fd, packet, NET_PACKET_SIZE, 0, (const struct sockaddr*)addr, sizeof(struct sockaddr_in)) == NET_PACKET_SIZE){
+		sock->packets_sent++;
+	} else {
+		sock->packets_dropped++;
+	}
+
+}
+
+/*
+ * net send (one NET_PACKET_SIZE packet, straight out unless the socket
+ * has conditions set, dropped if the hold queue is full)
+ */
+
+void netSend(struct netSocket *sock, const struct sockaddr_in *addr, const unsigned char *packet, double now_ms) {
+
+	struct netHeld *h;
+
+	if(sock->loss > 0.0f && netRandom(sock) < sock->loss){
+		sock->packets_dropped++;
+		return;
+	}
+
+	if(sock->latency_ms <= 0.0 && sock->jitter_ms <= 0.0){
+		netSendNow(sock, addr, packet);
+		return;
+	}
+
+	if(sock->num_held == NET_QUEUE){
+		sock->packets_dropped++;
+		return;
+	}
+
+	h = &sock->held[sock->num_held++];
+	h->release_ms = now_ms + sock->latency_ms + netRandom(sock) * sock->jitter_ms;
+	h->addr = *addr;
+	memcpy(h->data, packet, NET_PACKET_SIZE);
+
+}
+
+/*
+ * net flush (sends held packets whose time has come)
+ */
+
+void netFlush(struct netSocket *sock, double now_ms) {
+
+	unsigned int i = 0;
+
+	while(i < sock->num_held) {
+		if(sock->held[i].release_ms <= now_ms){
+			netSendNow(sock, &sock->held[i].addr, sock->held[i].data);
+			sock->held[i] = sock->held[--sock->num_held];
+		} else {
+			i++;
+		}
+	}
+
+}
+
+/*
+ * net recv (next whole packet if there is one, returns -1 when there
+ * isn't and skips anything that isn't NET_PACKET_SIZE)
+ */
+
+int netRecv(struct netSocket *sock, struct sockaddr_in *addr, unsigned char *packet) {
+
+	socklen_t len = sizeof(struct sockaddr_in);
+	ssize_t n;
+
+	while(1) {
+		n = recvfrom(sock->fd, packet, NET_PACKET_SIZE, 0, (struct sockaddr*)addr, &len);
+		if(n < 0){
+			return -1;
+		}
+		if(n == NET_PACKET_SIZE){
+			sock->packets_received++;
+			return 0;
+		}
+	}
+
+}
+
+/*
+ * net peer init
+ */
+
+void netPeerInit(struct netPeer *peer, const struct sockaddr_in *addr) {
+
+	memset(peer, 0, sizeof(struct netPeer));
+	if(addr != NULL){
+		peer->addr = *addr;
+	}
+
+}
+
+/*
+ * net peer stamp (writes the header for the next outgoing packet)
+ */
+
+void netPeerStamp(struct netPeer *peer, unsigned char *packet, double now_ms) {
+
+	unsigned int slot = peer->local_seq % NET_ACK_WINDOW;
+	unsigned char *p = packet;
+
+	p = netPut16(p, peer->local_seq);
+	p = netPut16(p, peer->remote_seq);
+	netPut32(p, peer->recv_bits);
+
+	peer->sent_ms[slot] = now_ms;
+	peer->sent_seq[slot] = peer->local_seq;
+	peer->acked[slot] = 0;
+	peer->local_seq++;
+	peer->sent++;
+	peer->bytes_sent += NET_PACKET_SIZE;
+
+}
+
+/*
+ * net peer ack (one of our packets got through, round trip smoothed over
+ * roughly the last ten)
+ */
+
+static void netPeerAck(struct netPeer *peer, uint16_t seq, double now_ms) {
+
+	unsigned int slot = seq % NET_ACK_WINDOW;
+	float rtt;
+
+	if(peer->sent_seq[slot] != seq || peer->acked[slot] || (uint16_t)(peer->local_seq - seq) > NET_ACK_WINDOW){
+		return;
+	}
+
+	peer->acked[slot] = 1;
+	peer->acked_count++;
+	if(!peer->have_acked || netSeqNewer(seq, peer->newest_acked)){
+		peer->newest_acked = seq;
+		peer->have_acked = 1;
+	}
+	rtt = (float)(now_ms - peer->sent_ms[slot]);
+	peer->rtt_ms = peer->acked_count == 1 ? rtt : peer->rtt_ms + 0.1f * (rtt - peer->rtt_ms);
+
+}
+
+/*
+ * net peer accept (reads the header of a received packet, returns 0 if
+ * it is the newest from this peer so far, 1 if it is older but new to
+ * us, -1 for a duplicate)
+ */
+
+int netPeerAccept(struct netPeer *peer, const unsigned char *packet, double now_ms) {
+
+	const unsigned char *p = packet;
+	uint16_t seq, ack, shift;
+	uint32_t bits;
+	int i, result = 0;
+
+	p = netGet16(p, &seq);
+	p = netGet16(p, &ack);
+	netGet32(p, &bits);
+
+	if(!peer->have_remote){
+		peer->have_remote = 1;
+		peer->remote_seq = seq;
+		peer->recv_bits = 0;
+	} else if(netSeqNewer(seq, peer->remote_seq)){
+		shift = seq - peer->remote_seq;
+		if(shift > NET_ACK_BITS){
+			peer->recv_bits = 0;
+		} else {
+			peer->recv_bits = (shift == NET_ACK_BITS ? 0 : peer->recv_bits << shift) | (1u << (shift - 1));
+		}
+		peer->remote_seq = seq;
+	} else {
+		shift = peer->remote_seq - seq;
+		if(shift == 0 || shift > NET_ACK_BITS || (peer->recv_bits & (1u << (shift - 1)))){
+			peer->stale++;
+			return -1;
+		}
+		peer->recv_bits |= 1u << (shift - 1);
+		result = 1;
+	}
+
+	netPeerAck(peer, ack, now_ms);
+	for(i = 0; i < NET_ACK_BITS; i++) {
+		if(bits & (1u << i)){
+			netPeerAck(peer, (uint16_t)(ack - 1 - i), now_ms);
+		}
+	}
+
+	peer->received++;
+	peer->bytes_received += NET_PACKET_SIZE;
+	peer->last_recv_ms = now_ms;
+	return result;
+
+}
+
+/*
+ * net input buffer (per client inputs keyed by the client's tick, a ring
+ * NET_INPUT_BUFFER ticks deep)
+ */
+
+void netInputClear(struct netInputBuffer *buf) {
+
+	memset(buf, 0, sizeof(struct netInputBuffer));
+
+}
+
+void netInputPut(struct netInputBuffer *buf, uint32_t tick, uint32_t mask) {
+
+	unsigned int slot = tick % NET_INPUT_BUFFER;
+
+	buf->tick[slot] = tick;
+	buf->mask[slot] = mask;
+	buf->valid[slot] = 1;
+
+}
+
+int netInputGet(const struct netInputBuffer *buf, uint32_t tick, uint32_t *mask) {
+
+	unsigned int slot = tick % NET_INPUT_BUFFER;
+
+	if(!buf->valid[slot] || buf->tick[slot] != tick){
+		return 0;
+	}
+	*mask = buf->mask[slot];
+	return 1;
+
+}
@@ -0,0 +1,210 @@
+/*
+
+	Offscreen Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+/**
+ * Desktop GL context without a window, for CI machines with no display
+ * server. Uses the Mesa surfaceless EGL platform when it is there (render
+ * target is an FBO we create) and falls back to the default display with
+ * a pbuffer. Under Mesa either one ends up on llvmpipe when there is no
+ * GPU. Must be created before glewInit.
+ **/
+
+struct ofsContext {
+	EGLDisplay display;
+	EGLContext context;
+	EGLSurface surface;
+	GLuint fbo;
+	GLuint color;
+	int width;
+	int height;
+};
+
+int ofsCreate(struct ofsContext *ofs, int width, int height);
+int ofsCreateTarget(struct ofsContext *ofs);
+void ofsDestroy(struct ofsContext *ofs);
+
+/*
+ * ofs get display (surfaceless platform first, then the default display)
+ */
+
+static EGLDisplay ofsGetDisplay(int *surfaceless) {
+
+	const char *ext = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	EGLDisplay display = EGL_NO_DISPLAY;
+
+	*surfaceless = 0;
+
+	#ifdef EGL_PLATFORM_SURFACELESS_MESA
+	if(ext != NULL && strstr(ext, "EGL_MESA_platform_surfaceless") != NULL){
+		PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if(get_platform_display != NULL){
+			display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+			*surfaceless = display != EGL_NO_DISPLAY;
+		}
+	}
+	#endif
+
+	if(display == EGL_NO_DISPLAY){
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	return display;
+
+}
+
+/*
+ * ofs create
+ * Returns 0 with the context current, or -1. On the surfaceless path the
+ * caller finishes with ofsCreateTarget once GL entry points are loaded.
+ */
+
+int ofsCreate(struct ofsContext *ofs, int width, int height) {
+
+	EGLint major, minor, num_configs;
+	EGLConfig config;
+	int surfaceless;
+
+	EGLint config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_ALPHA_SIZE, 8,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+
+	const EGLint pbuffer_attribs[] = {
+		EGL_WIDTH, width,
+		EGL_HEIGHT, height,
+		EGL_NONE
+	};
+
+	memset(ofs, 0, sizeof(struct ofsContext));
+	ofs->width = width;
+	ofs->height = height;
+	ofs->surface = EGL_NO_SURFACE;
+
+	ofs->display = ofsGetDisplay(&surfaceless);
+	if(ofs->display == EGL_NO_DISPLAY || !eglInitialize(ofs->display, &major, &minor)){
+		fprintf(stderr, "ofsCreate: no EGL display\n");
+		return -1;
+	}
+
+	if(!eglBindAPI(EGL_OPENGL_API)){
+		fprintf(stderr, "ofsCreate: EGL %d.%d has no desktop GL\n", major, minor);
+		return -1;
+	}
+
+	// surfaceless displays may not offer pbuffer configs, we never use one
+	config_attribs[1] = surfaceless ? 0 : EGL_PBUFFER_BIT;
+	if(!eglChooseConfig(ofs->display, config_attribs, &config, 1, &num_configs) ||
+		num_configs == 0){
+		fprintf(stderr, "ofsCreate: no matching EGL config\n");
+		return -1;
+	}
+
+	ofs->context = eglCreateContext(ofs->display, config, EGL_NO_CONTEXT, NULL);
+	if(ofs->context == EGL_NO_CONTEXT){
+		fprintf(stderr, "ofsCreate: could not create GL context (0x%x)\n", eglGetError());
+		return -1;
+	}
+
+	if(!surfaceless){
+		ofs->surface = eglCreatePbufferSurface(ofs->display, config, pbuffer_attribs);
+		if(ofs->surface == EGL_NO_SURFACE){
+			fprintf(stderr, "ofsCreate: could not create %dx%d pbuffer\n", width, height);
+			return -1;
+		}
+	}
+
+	if(!eglMakeCurrent(ofs->display, ofs->surface, ofs->surface, ofs->context)){
+		fprintf(stderr, "ofsCreate: could not make context current (0x%x)\n", eglGetError());
+		return -1;
+	}
+
+	fprintf(stderr, "Offscreen: EGL %d.%d %s, %s\n", major, minor,
+		surfaceless ? "surfaceless" : "pbuffer", (const char*)glGetString(GL_RENDERER));
+	return 0;
+
+}
+
+/*
+ * ofs create target (surfaceless only, a color renderbuffer FBO to draw
+ * into, needs GL 3.0 or ARB_framebuffer_object)
+ */
+
+int ofsCreateTarget(struct ofsContext *ofs) {
+
+	if(ofs->surface != EGL_NO_SURFACE){
+		return 0;
+	}
+
+	glGenRenderbuffers(1, &ofs->color);
+	glBindRenderbuffer(GL_RENDERBUFFER, ofs->color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, ofs->width, ofs->height);
+
+	glGenFramebuffers(1, &ofs->fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, ofs->fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ofs->color);
+
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+		fprintf(stderr, "ofsCreateTarget: framebuffer incomplete\n");
+		return -1;
+	}
+
+	glViewport(0, 0, ofs->width, ofs->height);
+	return 0;
+
+}
+
+/*
+ * ofs destroy
+ */
+
+void ofsDestroy(struct ofsContext *ofs) {
+
+	if(ofs->display == EGL_NO_DISPLAY){
+		return;
+	}
+
+	if(ofs->fbo){
+		glDeleteFramebuffers(1, &ofs->fbo);
+		glDeleteRenderbuffers(1, &ofs->color);
+	}
+
+	eglMakeCurrent(ofs->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if(ofs->surface != EGL_NO_SURFACE){
+		eglDestroySurface(ofs->display, ofs->surface);
+	}
+	if(ofs->context != EGL_NO_CONTEXT){
+		eglDestroyContext(ofs->display, ofs->context);
+	}
+	eglTerminate(ofs->display);
+	memset(ofs, 0, sizeof(struct ofsContext));
+
+}
@@ -0,0 +1,603 @@
+/*
+
+	Particle Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+/**
+ * Short-lived particles kept in a fixed ring: spawning overwrites the
+ * oldest slots and nothing is ever compacted. A particle is four floats
+ * of state (position, velocity) advanced every frame, plus birth time and
+ * time to live which never change, so the draw shader works out the fade
+ * and hides dead slots. Three backends share that layout:
+ *
+ * PTL_FEEDBACK  state in two VBOs, advanced by transform feedback (GL 3.0)
+ * PTL_TEXTURE   state in two float textures, advanced by a fragment pass
+ *               and fetched in the vertex shader (GL 2.0 + float textures)
+ * PTL_CPU       state in host memory, advanced with SSE one particle per
+ *               register, uploaded whole to draw (and used headless)
+ *
+ * On the GPU backends only freshly spawned slots are ever uploaded.
+ **/
+
+#define PTL_CPU 				0
+#define PTL_TEXTURE 			1
+#define PTL_FEEDBACK 			2
+
+struct ptlSystem {
+	int backend;
+	unsigned int capacity;
+	unsigned int head;
+	float *state;
+	float *life;
+	unsigned int dirty_begin;
+	unsigned int dirty_count;
+	float now;
+	float drag;
+	int src;
+	unsigned int tex_size;
+	GLuint state_vbo[2];
+	GLuint life_vbo;
+	GLuint index_vbo;
+	GLuint state_tex[2];
+	GLuint state_fbo[2];
+	GLuint quad;
+	GLuint update_program;
+	GLuint draw_program;
+	GLint attribute_update;
+	GLint uniform_update_drag;
+	GLint uniform_update_map;
+	GLint attribute_state;
+	GLint attribute_life;
+	GLint uniform_matrixOrtho2d;
+	GLint uniform_now;
+	GLint uniform_draw_map;
+	GLuint queries[2];
+	unsigned int frame;
+	int timed;
+	unsigned long updated;
+	unsigned int timed_updates;
+	double update_ms;
+};
+
+void ptlCreate(struct ptlSystem *sys, unsigned int capacity, float drag);
+int ptlBestBackend();
+int ptlInitGL(struct ptlSystem *sys, int backend);
+void ptlDestroy(struct ptlSystem *sys);
+void ptlSpawn(struct ptlSystem *sys, float x, float y, unsigned int count, float speed, float ttl, unsigned int *rng);
+void ptlUpdate(struct ptlSystem *sys);
+void ptlDraw(struct ptlSystem *sys, const GLfloat *projection);
+
+/*
+ * ptl random (xorshift, returns [0, 1))
+ */
+
+static float ptlRandom(unsigned int *rng) {
+
+	*rng ^= *rng << 13;
+	*rng ^= *rng >> 17;
+	*rng ^= *rng << 5;
+	return (*rng >> 8) * (1.0f / 16777216.0f);
+
+}
+
+/*
+ * ptl time ms (monotonic, for timing the CPU backend)
+ */
+
+static double ptlTimeMs() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+
+}
+
+/*
+ * ptl create (host side only, every slot starts dead)
+ */
+
+void ptlCreate(struct ptlSystem *sys, unsigned int capacity, float drag) {
+
+	unsigned int i;
+
+	memset(sys, 0, sizeof(struct ptlSystem));
+	sys->backend = PTL_CPU;
+	sys->drag = drag;
+
+	// square so the texture backend can hold it, 16 byte aligned for SSE
+	sys->tex_size = (unsigned int)ceil(sqrt((double)capacity));
+	sys->capacity = sys->tex_size * sys->tex_size;
+	sys->state = (float*)aligned_alloc(16, sys->capacity * 4 * sizeof(float));
+	sys->life = (float*)malloc(sys->capacity * 2 * sizeof(float));
+
+	if(sys->state == NULL || sys->life == NULL){
+		fprintf(stderr, "ptlCreate could not reserve %u particles\n", sys->capacity);
+		exit(1);
+	}
+
+	memset(sys->state, 0, sys->capacity * 4 * sizeof(float));
+	for(i = 0; i < sys->capacity; i++) {
+		sys->life[i * 2 + 0] = -1.0f;
+		sys->life[i * 2 + 1] = 0.0f;
+	}
+
+}
+
+/*
+ * ptl best backend (needs a current GL context)
+ */
+
+int ptlBestBackend() {
+
+	GLint vertex_units = 0;
+
+	if(GLEW_VERSION_3_0){
+		return PTL_FEEDBACK;
+	}
+
+	glGetIntegerv(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS, &vertex_units);
+	if(GLEW_ARB_texture_float && (GLEW_ARB_framebuffer_object || GLEW_EXT_framebuffer_object) && vertex_units > 0){
+		return PTL_TEXTURE;
+	}
+
+	return PTL_CPU;
+
+}
+
+/*
+ * ptl float texture (nearest, state texels must not be blended)
+ */
+
+static GLuint ptlFloatTexture(unsigned int size, const float *pixels) {
+
+	GLuint tex;
+
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F_ARB, size, size, 0, GL_RGBA, GL_FLOAT, pixels);
+	return tex;
+
+}
+
+/*
+ * ptl feedback program (vertex only, outState captured, must be named
+ * before linking so it can't go through mtxCreateProgram)
+ */
+
+static GLuint ptlFeedbackProgram() {
+
+	const char *varyings[] = { "outState" };
+	GLuint shader = mtxCreateShader("shdr/particle_update.glsl", GL_VERTEX_SHADER);
+	GLuint program = glCreateProgram();
+	GLint link_ok = GL_FALSE;
+
+	glAttachShader(program, shader);
+	glTransformFeedbackVaryings(program, 1, varyings, GL_INTERLEAVED_ATTRIBS);
+	glLinkProgram(program);
+	glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+
+	if(link_ok == GL_FALSE){
+		fprintf(stderr, "ptlFeedbackProgram link error\n");
+		exit(1);
+	}
+
+	return program;
+
+}
+
+/*
+ * ptl init gl
+ * Creates the buffers and programs for backend and returns it. PTL_CPU
+ * still needs GL to draw; headless runs never call this.
+ */
+
+int ptlInitGL(struct ptlSystem *sys, int backend) {
+
+	const GLfloat quad[] = {
+		-1.0, -1.0, 1.0, -1.0, -1.0, 1.0,
+		-1.0, 1.0, 1.0, -1.0, 1.0, 1.0
+	};
+	GLsizeiptr state_size = sys->capacity * 4 * sizeof(float);
+	GLfloat *index;
+	GLint target;
+	unsigned int i, k;
+
+	sys->backend = backend;
+
+	glGenBuffers(1, &sys->life_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, sys->life_vbo);
+	glBufferData(GL_ARRAY_BUFFER, sys->capacity * 2 * sizeof(float), sys->life, GL_DYNAMIC_DRAW);
+
+	if(backend == PTL_TEXTURE){
+
+		sys->draw_program = mtxCreateProgram("shdr/particle_fetch_vertex.glsl", "shdr/particle_fragment.glsl");
+		sys->attribute_state = mtxGetShaderAttribute(sys->draw_program, "texcoord");
+		sys->uniform_draw_map = mtxGetShaderUniform(sys->draw_program, "stateMap");
+
+		sys->update_program = mtxCreateProgram("shdr/post_vertex.glsl", "shdr/particle_step.glsl");
+		sys->attribute_update = mtxGetShaderAttribute(sys->update_program, "coord2d");
+		sys->uniform_update_map = mtxGetShaderUniform(sys->update_program, "stateMap");
+		sys->uniform_update_drag = mtxGetShaderUniform(sys->update_program, "drag");
+
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target);
+		for(k = 0; k < 2; k++) {
+			sys->state_tex[k] = ptlFloatTexture(sys->tex_size, sys->state);
+			glGenFramebuffers(1, &sys->state_fbo[k]);
+			glBindFramebuffer(GL_FRAMEBUFFER, sys->state_fbo[k]);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sys->state_tex[k], 0);
+		}
+		if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+			fprintf(stderr, "ptlInitGL: float render target unsupported\n");
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, target);
+
+		// texel center of every slot, the only per vertex data that is fixed
+		index = (GLfloat*)malloc(sys->capacity * 2 * sizeof(GLfloat));
+		for(i = 0; i < sys->capacity; i++) {
+			index[i * 2 + 0] = (i % sys->tex_size + 0.5f) / sys->tex_size;
+			index[i * 2 + 1] = (i / sys->tex_size + 0.5f) / sys->tex_size;
+		}
+		glGenBuffers(1, &sys->index_vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, sys->index_vbo);
+		glBufferData(GL_ARRAY_BUFFER, sys->capacity * 2 * sizeof(GLfloat), index, GL_STATIC_DRAW);
+		free(index);
+
+		glGenBuffers(1, &sys->quad);
+		glBindBuffer(GL_ARRAY_BUFFER, sys->quad);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+
+	} else {
+
+		sys->draw_program = mtxCreateProgram("shdr/particle_vertex.glsl", "shdr/particle_fragment.glsl");
+		sys->attribute_state = mtxGetShaderAttribute(sys->draw_program, "state");
+
+		for(k = 0; k < (backend == PTL_FEEDBACK ? 2 : 1); k++) {
+			glGenBuffers(1, &sys->state_vbo[k]);
+			glBindBuffer(GL_ARRAY_BUFFER, sys->state_vbo[k]);
+			glBufferData(GL_ARRAY_BUFFER, state_size, sys->state, backend == PTL_FEEDBACK ? GL_DYNAMIC_COPY : GL_STREAM_DRAW);
+		}
+
+		if(backend == PTL_FEEDBACK){
+			sys->update_program = ptlFeedbackProgram();
+			sys->attribute_update = mtxGetShaderAttribute(sys->update_program, "state");
+			sys->uniform_update_drag = mtxGetShaderUniform(sys->update_program, "drag");
+		}
+
+	}
+
+	sys->attribute_life = mtxGetShaderAttribute(sys->draw_program, "life");
+	sys->uniform_matrixOrtho2d = mtxGetShaderUniform(sys->draw_program, "matrixOrtho2d");
+	sys->uniform_now = mtxGetShaderUniform(sys->draw_program, "now");
+
+	sys->timed = backend != PTL_CPU && GLEW_ARB_timer_query;
+	if(sys->timed){
+		glGenQueries(2, sys->queries);
+	}
+
+	sys->dirty_count = 0;
+	return backend;
+
+}
+
+/*
+ * ptl destroy
+ */
+
+void ptlDestroy(struct ptlSystem *sys) {
+
+	if(sys->draw_program){
+		glDeleteProgram(sys->draw_program);
+		if(sys->update_program){
+			glDeleteProgram(sys->update_program);
+		}
+		glDeleteBuffers(2, sys->state_vbo);
+		glDeleteBuffers(1, &sys->life_vbo);
+		if(sys->backend == PTL_TEXTURE){
+			glDeleteBuffers(1, &sys->index_vbo);
+			glDeleteBuffers(1, &sys->quad);
+			glDeleteFramebuffers(2, sys->state_fbo);
+			glDeleteTextures(2, sys->state_tex);
+		}
+		if(sys->timed){
+			glDeleteQueries(2, sys->queries);
+		}
+		sys->draw_program = 0;
+	}
+
+	free(sys->state);
+	free(sys->life);
+	sys->state = NULL;
+	sys->life = NULL;
+
+}
+
+/*
+ * ptl spawn (count particles at x, y flying out in random directions,
+ * overwriting the oldest slots)
+ */
+
+void ptlSpawn(struct ptlSystem *sys, float x, float y, unsigned int count, float speed, float ttl, unsigned int *rng) {
+
+	unsigned int n, i;
+	float heading, v;
+
+	count = count < sys->capacity ? count : sys->capacity;
+
+	if(sys->dirty_count == 0){
+		sys->dirty_begin = sys->head;
+	}
+
+	for(n = 0; n < count; n++) {
+
+		i = sys->head;
+		heading = ptlRandom(rng) * 2.0f * M_PI;
+		v = speed * (0.25f + ptlRandom(rng));
+
+		sys->state[i * 4 + 0] = x;
+		sys->state[i * 4 + 1] = y;
+		sys->state[i * 4 + 2] = cosf(heading) * v;
+		sys->state[i * 4 + 3] = sinf(heading) * v;
+		sys->life[i * 2 + 0] = sys->now;
+		sys->life[i * 2 + 1] = ttl * (0.5f + ptlRandom(rng));
+
+		sys->head = (sys->head + 1) % sys->capacity;
+
+	}
+
+	sys->dirty_count = sys->dirty_count + count < sys->capacity ? sys->dirty_count + count : sys->capacity;
+
+}
+
+/*
+ * ptl upload range (slots [begin, begin + count) of the host copy to the
+ * current source state and the life buffer)
+ */
+
+static void ptlUploadRange(struct ptlSystem *sys, unsigned int begin, unsigned int count) {
+
+	unsigned int row, x0, len, i, end = begin + count;
+
+	glBindBuffer(GL_ARRAY_BUFFER, sys->life_vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, begin * 2 * sizeof(float), count * 2 * sizeof(float), &sys->life[begin * 2]);
+
+	if(sys->backend == PTL_FEEDBACK){
+		glBindBuffer(GL_ARRAY_BUFFER, sys->state_vbo[sys->src]);
+		glBufferSubData(GL_ARRAY_BUFFER, begin * 4 * sizeof(float), count * 4 * sizeof(float), &sys->state[begin * 4]);
+		return;
+	}
+
+	if(sys->backend == PTL_TEXTURE){
+		glBindTexture(GL_TEXTURE_2D, sys->state_tex[sys->src]);
+		for(i = begin; i < end; i += len) {
+			row = i / sys->tex_size;
+			x0 = i % sys->tex_size;
+			len = sys->tex_size - x0 < end - i ? sys->tex_size - x0 : end - i;
+			glTexSubImage2D(GL_TEXTURE_2D, 0, x0, row, len, 1, GL_RGBA, GL_FLOAT, &sys->state[i * 4]);
+		}
+	}
+
+}
+
+/*
+ * ptl upload (dirty ring range, split in two if it wraps)
+ */
+
+static void ptlUpload(struct ptlSystem *sys) {
+
+	unsigned int first;
+
+	if(sys->dirty_count == 0 || sys->draw_program == 0){
+		return;
+	}
+
+	first = sys->capacity - sys->dirty_begin < sys->dirty_count ? sys->capacity - sys->dirty_begin : sys->dirty_count;
+	ptlUploadRange(sys, sys->dirty_begin, first);
+	if(first < sys->dirty_count){
+		ptlUploadRange(sys, 0, sys->dirty_count - first);
+	}
+
+	sys->dirty_count = 0;
+
+}
+
+/*
+ * ptl update cpu (position += velocity, velocity *= drag; x y vx vy fit
+ * one SSE register so every particle is one add and one multiply)
+ */
+
+static void ptlUpdateCPU(struct ptlSystem *sys) {
+
+	float * restrict state = sys->state;
+	unsigned int i;
+
+	#ifdef __SSE__
+	__m128 scale = _mm_set_ps(sys->drag, sys->drag, 1.0f, 1.0f);
+	__m128 zero = _mm_setzero_ps();
+	__m128 s;
+
+	for(i = 0; i < sys->capacity; i++) {
+		s = _mm_load_ps(&state[i * 4]);
+		s = _mm_add_ps(s, _mm_movehl_ps(zero, s));
+		_mm_store_ps(&state[i * 4], _mm_mul_ps(s, scale));
+	}
+	#else
+	for(i = 0; i < sys->capacity; i++) {
+		state[i * 4 + 0] += state[i * 4 + 2];
+		state[i * 4 + 1] += state[i * 4 + 3];
+		state[i * 4 + 2] *= sys->drag;
+		state[i * 4 + 3] *= sys->drag;
+	}
+	#endif
+
+}
+
+/*
+ * ptl collect (GPU time of the update issued two frames ago, the very
+ * first one is skipped since it carries buffer and shader setup)
+ */
+
+static void ptlCollect(struct ptlSystem *sys) {
+
+	GLuint64 ns;
+
+	if(!sys->timed || sys->frame < 3){
+		return;
+	}
+
+	glGetQueryObjectui64v(sys->queries[sys->frame & 1], GL_QUERY_RESULT, &ns);
+	sys->update_ms += ns / 1000000.0;
+	sys->timed_updates++;
+
+}
+
+/*
+ * ptl update (one frame, every slot)
+ */
+
+void ptlUpdate(struct ptlSystem *sys) {
+
+	GLint viewport[4];
+	GLint target;
+	double start;
+
+	ptlUpload(sys);
+	sys->now += 1.0f;
+	sys->updated += sys->capacity;
+
+	if(sys->backend == PTL_CPU){
+		start = ptlTimeMs();
+		ptlUpdateCPU(sys);
+		sys->update_ms += ptlTimeMs() - start;
+		sys->timed_updates++;
+		return;
+	}
+
+	ptlCollect(sys);
+	if(sys->timed){
+		glBeginQuery(GL_TIME_ELAPSED, sys->queries[sys->frame & 1]);
+	}
+
+	if(sys->backend == PTL_FEEDBACK){
+
+		glUseProgram(sys->update_program);
+		glUniform1f(sys->uniform_update_drag, sys->drag);
+		glBindBuffer(GL_ARRAY_BUFFER, sys->state_vbo[sys->src]);
+		glEnableVertexAttribArray(sys->attribute_update);
+		glVertexAttribPointer(sys->attribute_update, 4, GL_FLOAT, GL_FALSE, 0, 0);
+
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, sys->state_vbo[!sys->src]);
+		glEnable(GL_RASTERIZER_DISCARD);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, 0, sys->capacity);
+		glEndTransformFeedback();
+		glDisable(GL_RASTERIZER_DISCARD);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+
+		glDisableVertexAttribArray(sys->attribute_update);
+
+	} else {
+
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, sys->state_fbo[!sys->src]);
+		glViewport(0, 0, sys->tex_size, sys->tex_size);
+		glUseProgram(sys->update_program);
+		glUniform1f(sys->uniform_update_drag, sys->drag);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, sys->state_tex[sys->src]);
+		glUniform1i(sys->uniform_update_map, 0);
+
+		glBindBuffer(GL_ARRAY_BUFFER, sys->quad);
+		glEnableVertexAttribArray(sys->attribute_update);
+		glVertexAttribPointer(sys->attribute_update, 2, GL_FLOAT, GL_FALSE, 0, 0);
+		glDrawArrays(GL_TRIANGLES, 0, 6);
+		glDisableVertexAttribArray(sys->attribute_update);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, target);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	}
+
+	if(sys->timed){
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+
+	sys->src = !sys->src;
+	sys->frame++;
+
+}
+
+/*
+ * ptl draw (additive point sprites, dead slots are moved off screen by
+ * the vertex shader)
+ */
+
+void ptlDraw(struct ptlSystem *sys, const GLfloat *projection) {
+
+	if(sys->backend == PTL_CPU){
+		ptlUpload(sys);
+		glBindBuffer(GL_ARRAY_BUFFER, sys->state_vbo[0]);
+		glBufferData(GL_ARRAY_BUFFER, sys->capacity * 4 * sizeof(float), sys->state, GL_STREAM_DRAW);
+	}
+
+	glUseProgram(sys->draw_program);
+	glUniformMatrix4fv(sys->uniform_matrixOrtho2d, 1, GL_FALSE, projection);
+	glUniform1f(sys->uniform_now, sys->now);
+
+	if(sys->backend == PTL_TEXTURE){
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, sys->state_tex[sys->src]);
+		glUniform1i(sys->uniform_draw_map, 0);
+		glBindBuffer(GL_ARRAY_BUFFER, sys->index_vbo);
+		glEnableVertexAttribArray(sys->attribute_state);
+		glVertexAttribPointer(sys->attribute_state, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	} else {
+		glBindBuffer(GL_ARRAY_BUFFER, sys->state_vbo[sys->backend == PTL_FEEDBACK ? sys->src : 0]);
+		glEnableVertexAttribArray(sys->attribute_state);
+		glVertexAttribPointer(sys->attribute_state, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, sys->life_vbo);
+	glEnableVertexAttribArray(sys->attribute_life);
+	glVertexAttribPointer(sys->attribute_life, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+	glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+	glEnable(GL_BLEND);
+	glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE);
+	glDrawArrays(GL_POINTS, 0, sys->capacity);
+	glDisable(GL_BLEND);
+	glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
+
+	glDisableVertexAttribArray(sys->attribute_state);
+	glDisableVertexAttribArray(sys->attribute_life);
+
+}
@@ -0,0 +1,82 @@
+/*
+
+	Pipeline Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+ * Lock-free triple buffer index exchange between one producer and one
+ * consumer. The producer owns back, the consumer owns front and the third
+ * buffer sits in middle. Publishing swaps back with middle and marks it
+ * fresh; acquiring swaps front with middle only if it is fresh, so the
+ * consumer always gets the newest complete buffer and neither side waits.
+ **/
+
+#define PP_FRESH 				0x4
+#define PP_INDEX 				0x3
+
+struct ppTriple {
+	int front;
+	int back;
+	int middle;
+};
+
+void ppInit(struct ppTriple *pp);
+void ppPublish(struct ppTriple *pp);
+int ppAcquire(struct ppTriple *pp);
+
+/*
+ * pp init (front 0, middle 1, back 2, nothing published yet)
+ */
+
+void ppInit(struct ppTriple *pp) {
+
+	pp->front = 0;
+	pp->middle = 1;
+	pp->back = 2;
+
+}
+
+/*
+ * pp publish (producer, hands back over and takes the old middle)
+ */
+
+void ppPublish(struct ppTriple *pp) {
+
+	int prev = __atomic_exchange_n(&pp->middle, pp->back | PP_FRESH, __ATOMIC_ACQ_REL);
+	pp->back = prev & PP_INDEX;
+
+}
+
+/*
+ * pp acquire (consumer, returns 1 and updates front if a new buffer was
+ * published since the last call)
+ */
+
+int ppAcquire(struct ppTriple *pp) {
+
+	int prev;
+
+	if(!(__atomic_load_n(&pp->middle, __ATOMIC_ACQUIRE) & PP_FRESH)){
+		return 0;
+	}
+
+	prev = __atomic_exchange_n(&pp->middle, pp->front, __ATOMIC_ACQ_REL);
+	pp->front = prev & PP_INDEX;
+	return 1;
+
+}
@@ -0,0 +1,210 @@
+/*
+
+	Pool Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Fixed capacity object pool. Live objects are kept packed at the front
+ * of one array so they can be walked with plAt(pool, 0..count-1); release
+ * moves the last live object into the hole. Callers hold a plHandle,
+ * which goes through a slot table with a generation counter so a handle
+ * to a released object is detected instead of aliasing its replacement.
+ * A slot's generation is odd while it is live and even while it is free,
+ * so a zeroed handle never resolves. Free slots are chained through the
+ * slot table itself.
+ **/
+
+#define PL_NONE 				0xffffffff
+
+#define PL_AT(pool, type, i) 	((type*)plAt(pool, i))
+#define PL_GET(pool, type, h) 	((type*)plGet(pool, h))
+
+struct plHandle {
+	unsigned int slot;
+	unsigned int generation;
+};
+
+struct plPool {
+	unsigned char *items;
+	unsigned int stride;
+	unsigned int capacity;
+	unsigned int count;
+	unsigned int *slot_dense;
+	unsigned int *dense_slot;
+	unsigned int *generation;
+	unsigned int free_head;
+};
+
+void plCreate(struct plPool *pool, unsigned int stride, unsigned int capacity);
+void plDestroy(struct plPool *pool);
+void plClear(struct plPool *pool);
+void* plAcquire(struct plPool *pool, struct plHandle *handle);
+int plRelease(struct plPool *pool, struct plHandle handle);
+void plReleaseAt(struct plPool *pool, unsigned int index);
+void* plGet(struct plPool *pool, struct plHandle handle);
+void* plAt(struct plPool *pool, unsigned int index);
+
+/*
+ * pl create (all memory is reserved up front)
+ */
+
+void plCreate(struct plPool *pool, unsigned int stride, unsigned int capacity) {
+
+	pool->items = (unsigned char*)malloc((size_t)stride * capacity);
+	pool->slot_dense = (unsigned int*)malloc(capacity * sizeof(unsigned int));
+	pool->dense_slot = (unsigned int*)malloc(capacity * sizeof(unsigned int));
+	pool->generation = (unsigned int*)calloc(capacity, sizeof(unsigned int));
+
+	if(!pool->items || !pool->slot_dense || !pool->dense_slot || !pool->generation){
+		fprintf(stderr, "plCreate could not reserve %u objects\n", capacity);
+		exit(1);
+	}
+
+	pool->stride = stride;
+	pool->capacity = capacity;
+	plClear(pool);
+
+}
+
+/*
+ * pl destroy
+ */
+
+void plDestroy(struct plPool *pool) {
+
+	free(pool->items);
+	free(pool->slot_dense);
+	free(pool->dense_slot);
+	free(pool->generation);
+	memset(pool, 0, sizeof(struct plPool));
+
+}
+
+/*
+ * pl clear (release everything, outstanding handles become stale)
+ */
+
+void plClear(struct plPool *pool) {
+
+	unsigned int i;
+
+	for(i = 0; i < pool->count; i++){
+		pool->generation[pool->dense_slot[i]]++;
+	}
+
+	for(i = 0; i < pool->capacity; i++){
+		pool->slot_dense[i] = i + 1 < pool->capacity ? i + 1 : PL_NONE;
+	}
+
+	pool->free_head = pool->capacity ? 0 : PL_NONE;
+	pool->count = 0;
+
+}
+
+/*
+ * pl acquire (returns NULL when the pool is full)
+ */
+
+void* plAcquire(struct plPool *pool, struct plHandle *handle) {
+
+	unsigned int slot = pool->free_head;
+
+	if(slot == PL_NONE){
+		return NULL;
+	}
+
+	pool->free_head = pool->slot_dense[slot];
+	pool->slot_dense[slot] = pool->count;
+	pool->dense_slot[pool->count] = slot;
+	pool->generation[slot]++;
+
+	if(handle != NULL){
+		handle->slot = slot;
+		handle->generation = pool->generation[slot];
+	}
+
+	return pool->items + (size_t)pool->stride * pool->count++;
+
+}
+
+/*
+ * pl release at (by dense index, for use while iterating backwards)
+ */
+
+void plReleaseAt(struct plPool *pool, unsigned int index) {
+
+	unsigned int slot = pool->dense_slot[index];
+	unsigned int last = pool->count - 1;
+
+	if(index != last){
+		memcpy(pool->items + (size_t)pool->stride * index,
+			pool->items + (size_t)pool->stride * last, pool->stride);
+		pool->dense_slot[index] = pool->dense_slot[last];
+		pool->slot_dense[pool->dense_slot[index]] = index;
+	}
+
+	pool->generation[slot]++;
+	pool->slot_dense[slot] = pool->free_head;
+	pool->free_head = slot;
+	pool->count--;
+
+}
+
+/*
+ * pl release (by handle, returns -1 for a stale handle)
+ */
+
+int plRelease(struct plPool *pool, struct plHandle handle) {
+
+	if(plGet(pool, handle) == NULL){
+		fprintf(stderr, "plRelease stale handle (slot %u generation %u)\n", handle.slot, handle.generation);
+		return -1;
+	}
+
+	plReleaseAt(pool, pool->slot_dense[handle.slot]);
+	return 0;
+
+}
+
+/*
+ * pl get (returns NULL for a stale handle)
+ */
+
+void* plGet(struct plPool *pool, struct plHandle handle) {
+
+	if(handle.slot >= pool->capacity || (handle.generation & 1) == 0 || pool->generation[handle.slot] != handle.generation){
+		return NULL;
+	}
+
+	return pool->items + (size_t)pool->stride * pool->slot_dense[handle.slot];
+
+}
+
+/*
+ * pl at (dense index in [0, count))
+ */
+
+void* plAt(struct plPool *pool, unsigned int index) {
+
+	return pool->items + (size_t)pool->stride * index;
+
+}
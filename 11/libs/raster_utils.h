@@ -0,0 +1,684 @@
+/*
+
+	Raster Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Software rasterizer for headless frame capture. Geometry goes through
+ * the same affine model rows then matrixOrtho2d transform as
+ * shdr/vertex.glsl and is collected as screen space primitives. rstFlush
+ * bins them into RST_TILE square tiles and rasterizes the tiles in
+ * parallel with jobParallelFor: triangles with edge functions (four
+ * pixels at a time with SSE2), lines with a clipped DDA. The framebuffer
+ * is RGBA with row 0 at the top, as stored in PNG.
+ **/
+
+#define RST_TILE 				64
+#define RST_TRIANGLE 			0
+#define RST_LINE 				1
+
+struct rstPrim {
+	float v[3][2];
+	int min_x, min_y, max_x, max_y;
+	unsigned int type;
+};
+
+struct rstContext {
+	int width;
+	int height;
+	unsigned char *pixels;
+	GLfloat projection[16];
+	unsigned int color;
+	unsigned int clear;
+	unsigned int num_prims;
+	unsigned int max_prims;
+	struct rstPrim *prims;
+	unsigned int tiles_x;
+	unsigned int tiles_y;
+	unsigned int *tile_start;
+	unsigned int *bins;
+	unsigned int max_bins;
+};
+
+void rstCreate(struct rstContext *ctx, int width, int height, unsigned int max_prims);
+void rstDestroy(struct rstContext *ctx);
+void rstBegin(struct rstContext *ctx, const GLfloat *projection);
+void rstTriangles(struct rstContext *ctx, const GLfloat *model, const GLfloat *coords, unsigned int count);
+void rstLineLoop(struct rstContext *ctx, const GLfloat *model, const GLfloat *coords, unsigned int count);
+void rstFlush(struct rstContext *ctx);
+int rstWritePNG(struct rstContext *ctx, const char *filename);
+int rstWriteRGBA(const char *filename, const unsigned char *pixels, int width, int height, int bottom_up);
+long rstComparePNG(struct rstContext *ctx, const char *filename);
+
+/*
+ * rst create
+ */
+
+void rstCreate(struct rstContext *ctx, int width, int height, unsigned int max_prims) {
+
+	memset(ctx, 0, sizeof(struct rstContext));
+	ctx->width = width;
+	ctx->height = height;
+	ctx->tiles_x = (width + RST_TILE - 1) / RST_TILE;
+	ctx->tiles_y = (height + RST_TILE - 1) / RST_TILE;
+	ctx->max_prims = max_prims;
+	ctx->max_bins = max_prims * 4;
+
+	ctx->pixels = (unsigned char*)malloc((size_t)width * height * 4);
+	ctx->prims = (struct rstPrim*)malloc(max_prims * sizeof(struct rstPrim));
+	ctx->tile_start = (unsigned int*)malloc((ctx->tiles_x * ctx->tiles_y + 1) * sizeof(unsigned int));
+	ctx->bins = (unsigned int*)malloc(ctx->max_bins * sizeof(unsigned int));
+
+	if(!ctx->pixels || !ctx->prims || !ctx->tile_start || !ctx->bins){
+		fprintf(stderr, "rstCreate out of memory\n");
+		exit(1);
+	}
+
+	// Same solid blue as shdr/fragment.glsl, opaque black clear
+	ctx->color = 0xffff0000;
+	ctx->clear = 0xff000000;
+
+}
+
+/*
+ * rst destroy
+ */
+
+void rstDestroy(struct rstContext *ctx) {
+
+	free(ctx->pixels);
+	free(ctx->prims);
+	free(ctx->tile_start);
+	free(ctx->bins);
+	memset(ctx, 0, sizeof(struct rstContext));
+
+}
+
+/*
+ * rst begin (start a frame with the given projection)
+ */
+
+void rstBegin(struct rstContext *ctx, const GLfloat *projection) {
+
+	memcpy(ctx->projection, projection, 16 * sizeof(GLfloat));
+	ctx->num_prims = 0;
+
+}
+
+/*
+ * rst project (vertex shader equivalent for a six float affine model,
+ * then viewport with y flipped)
+ */
+
+static void rstProject(struct rstContext *ctx, const GLfloat *model, const GLfloat *coord, float *out) {
+
+	const GLfloat *p = ctx->projection;
+	float mx = model[A_00] * coord[0] + model[A_01] * coord[1] + model[A_02];
+	float my = model[A_10] * coord[0] + model[A_11] * coord[1] + model[A_12];
+	float cx = p[M_00] * mx + p[M_01] * my + p[M_03];
+	float cy = p[M_10] * mx + p[M_11] * my + p[M_13];
+	float cw = p[M_30] * mx + p[M_31] * my + p[M_33];
+
+	out[0] = (cx / cw + 1.0f) * 0.5f * ctx->width;
+	out[1] = (1.0f - (cy / cw + 1.0f) * 0.5f) * ctx->height;
+
+}
+
+/*
+ * rst push (computes the clamped pixel bounds, drops offscreen prims)
+ */
+
+static void rstPush(struct rstContext *ctx, struct rstPrim *prim, unsigned int verts) {
+
+	float lo_x = prim->v[0][0], hi_x = prim->v[0][0];
+	float lo_y = prim->v[0][1], hi_y = prim->v[0][1];
+	unsigned int k;
+
+	for(k = 1; k < verts; k++) {
+		lo_x = prim->v[k][0] < lo_x ? prim->v[k][0] : lo_x;
+		hi_x = prim->v[k][0] > hi_x ? prim->v[k][0] : hi_x;
+		lo_y = prim->v[k][1] < lo_y ? prim->v[k][1] : lo_y;
+		hi_y = prim->v[k][1] > hi_y ? prim->v[k][1] : hi_y;
+	}
+
+	prim->min_x = lo_x < 0.0f ? 0 : (int)lo_x;
+	prim->min_y = lo_y < 0.0f ? 0 : (int)lo_y;
+	prim->max_x = hi_x >= ctx->width ? ctx->width - 1 : (int)hi_x;
+	prim->max_y = hi_y >= ctx->height ? ctx->height - 1 : (int)hi_y;
+
+	if(prim->min_x > prim->max_x || prim->min_y > prim->max_y){
+		return;
+	}
+
+	if(ctx->num_prims == ctx->max_prims){
+		fprintf(stderr, "rstPush primitive buffer full (%u)\n", ctx->max_prims);
+		return;
+	}
+
+	ctx->prims[ctx->num_prims++] = *prim;
+
+}
+
+/*
+ * rst triangles (count vertices as GL_TRIANGLES)
+ */
+
+void rstTriangles(struct rstContext *ctx, const GLfloat *model, const GLfloat *coords, unsigned int count) {
+
+	struct rstPrim prim;
+	unsigned int i, k;
+	float area;
+
+	prim.type = RST_TRIANGLE;
+
+	for(i = 0; i + 2 < count; i += 3) {
+
+		for(k = 0; k < 3; k++){
+			rstProject(ctx, model, &coords[(i + k) * 2], prim.v[k]);
+		}
+
+		// keep one winding so the edge functions are positive inside
+		area = (prim.v[1][0] - prim.v[0][0]) * (prim.v[2][1] - prim.v[0][1]) -
+			(prim.v[1][1] - prim.v[0][1]) * (prim.v[2][0] - prim.v[0][0]);
+		if(area < 0.0f){
+			float tx = prim.v[1][0], ty = prim.v[1][1];
+			prim.v[1][0] = prim.v[2][0];
+			prim.v[1][1] = prim.v[2][1];
+			prim.v[2][0] = tx;
+			prim.v[2][1] = ty;
+		}
+
+		rstPush(ctx, &prim, 3);
+
+	}
+
+}
+
+/*
+ * rst line loop (count vertices as GL_LINE_LOOP)
+ */
+
+void rstLineLoop(struct rstContext *ctx, const GLfloat *model, const GLfloat *coords, unsigned int count) {
+
+	struct rstPrim prim;
+	float first[2], prev[2], cur[2];
+	unsigned int i;
+
+	if(count < 2){
+		return;
+	}
+
+	prim.type = RST_LINE;
+	rstProject(ctx, model, &coords[0], first);
+	prev[0] = first[0];
+	prev[1] = first[1];
+
+	for(i = 1; i <= count; i++) {
+
+		if(i == count){
+			cur[0] = first[0];
+			cur[1] = first[1];
+		} else {
+			rstProject(ctx, model, &coords[i * 2], cur);
+		}
+
+		prim.v[0][0] = prev[0];
+		prim.v[0][1] = prev[1];
+		prim.v[1][0] = cur[0];
+		prim.v[1][1] = cur[1];
+		rstPush(ctx, &prim, 2);
+
+		prev[0] = cur[0];
+		prev[1] = cur[1];
+
+	}
+
+}
+
+/*
+ * rst raster triangle (inside one tile)
+ */
+
+static void rstRasterTriangle(struct rstContext *ctx, const struct rstPrim *t, int x0, int y0, int x1, int y1) {
+
+	// edge i runs from v[i] to v[i+1], E(x, y) = A x + B y + C
+	float A[3], B[3], C[3];
+	unsigned int *row;
+	int x, y, k;
+
+	for(k = 0; k < 3; k++) {
+		const float *a = t->v[k];
+		const float *b = t->v[(k + 1) % 3];
+		A[k] = a[1] - b[1];
+		B[k] = b[0] - a[0];
+		C[k] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	x0 = t->min_x > x0 ? t->min_x : x0;
+	y0 = t->min_y > y0 ? t->min_y : y0;
+	x1 = t->max_x < x1 ? t->max_x : x1;
+	y1 = t->max_y < y1 ? t->max_y : y1;
+
+	for(y = y0; y <= y1; y++) {
+
+		float py = y + 0.5f;
+		row = (unsigned int*)ctx->pixels + (size_t)y * ctx->width;
+		x = x0;
+
+		#ifdef __SSE2__
+		{
+			__m128 step = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+			__m128i color = _mm_set1_epi32((int)ctx->color);
+			__m128 e0, e1, e2, px;
+			__m128i mask, dst;
+
+			for(; x + 3 <= x1; x += 4) {
+				px = _mm_add_ps(_mm_set1_ps((float)x), step);
+				e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[0]), px), _mm_set1_ps(B[0] * py + C[0]));
+				e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[1]), px), _mm_set1_ps(B[1] * py + C[1]));
+				e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[2]), px), _mm_set1_ps(B[2] * py + C[2]));
+				mask = _mm_castps_si128(_mm_and_ps(_mm_and_ps(
+					_mm_cmpge_ps(e0, _mm_setzero_ps()),
+					_mm_cmpge_ps(e1, _mm_setzero_ps())),
+					_mm_cmpge_ps(e2, _mm_setzero_ps())));
+				if(_mm_movemask_epi8(mask) == 0){
+					continue;
+				}
+				dst = _mm_loadu_si128((__m128i*)&row[x]);
+				dst = _mm_or_si128(_mm_and_si128(mask, color), _mm_andnot_si128(mask, dst));
+				_mm_storeu_si128((__m128i*)&row[x], dst);
+			}
+		}
+		#endif
+
+		for(; x <= x1; x++) {
+			float px = x + 0.5f;
+			if(A[0] * px + B[0] * py + C[0] >= 0.0f &&
+				A[1] * px + B[1] * py + C[1] >= 0.0f &&
+				A[2] * px + B[2] * py + C[2] >= 0.0f){
+				row[x] = ctx->color;
+			}
+		}
+
+	}
+
+}
+
+/*
+ * rst raster line (DDA, parameter range clipped to the tile first)
+ */
+
+static void rstRasterLine(struct rstContext *ctx, const struct rstPrim *l, int x0, int y0, int x1, int y1) {
+
+	float ax = l->v[0][0], ay = l->v[0][1];
+	float dx = l->v[1][0] - ax, dy = l->v[1][1] - ay;
+	float t0 = 0.0f, t1 = 1.0f, steps, t, inv;
+	float p[4], q[4], r;
+	unsigned int *pixels = (unsigned int*)ctx->pixels;
+	int k, n, px, py;
+
+	p[0] = -dx; q[0] = ax - x0;
+	p[1] = dx; q[1] = (x1 + 1) - ax;
+	p[2] = -dy; q[2] = ay - y0;
+	p[3] = dy; q[3] = (y1 + 1) - ay;
+
+	for(k = 0; k < 4; k++) {
+		if(p[k] == 0.0f){
+			if(q[k] < 0.0f){
+				return;
+			}
+			continue;
+		}
+		r = q[k] / p[k];
+		if(p[k] < 0.0f){
+			t0 = r > t0 ? r : t0;
+		} else {
+			t1 = r < t1 ? r : t1;
+		}
+	}
+
+	if(t0 > t1){
+		return;
+	}
+
+	steps = fabsf(dx) > fabsf(dy) ? fabsf(dx) : fabsf(dy);
+	if(steps < 1.0f){
+		steps = 1.0f;
+	}
+	inv = 1.0f / steps;
+	n = (int)((t1 - t0) * steps) + 1;
+
+	for(k = 0; k < n; k++) {
+		t = t0 + k * inv;
+		t = t > t1 ? t1 : t;
+		px = (int)(ax + dx * t);
+		py = (int)(ay + dy * t);
+		if(px >= x0 && px <= x1 && py >= y0 && py <= y1){
+			pixels[(size_t)py * ctx->width + px] = ctx->color;
+		}
+	}
+
+}
+
+/*
+ * rst tile job (clear the tile, then draw its bin in submission order)
+ */
+
+static void rstTileJob(void *data, unsigned int begin, unsigned int end) {
+
+	struct rstContext *ctx = (struct rstContext*)data;
+	unsigned int tile, k, tx, ty;
+	int x0, y0, x1, y1, y;
+
+	for(tile = begin; tile < end; tile++) {
+
+		tx = tile % ctx->tiles_x;
+		ty = tile / ctx->tiles_x;
+		x0 = tx * RST_TILE;
+		y0 = ty * RST_TILE;
+		x1 = x0 + RST_TILE - 1 < ctx->width - 1 ? x0 + RST_TILE - 1 : ctx->width - 1;
+		y1 = y0 + RST_TILE - 1 < ctx->height - 1 ? y0 + RST_TILE - 1 : ctx->height - 1;
+
+		for(y = y0; y <= y1; y++) {
+			unsigned int *row = (unsigned int*)ctx->pixels + (size_t)y * ctx->width;
+			int x;
+			for(x = x0; x <= x1; x++){
+				row[x] = ctx->clear;
+			}
+		}
+
+		for(k = ctx->tile_start[tile]; k < ctx->tile_start[tile + 1]; k++) {
+			const struct rstPrim *prim = &ctx->prims[ctx->bins[k]];
+			if(prim->type == RST_TRIANGLE){
+				rstRasterTriangle(ctx, prim, x0, y0, x1, y1);
+			} else {
+				rstRasterLine(ctx, prim, x0, y0, x1, y1);
+			}
+		}
+
+	}
+
+}
+
+/*
+ * rst flush
+ * Bins every primitive into the tiles its bounds touch (counting sort so
+ * each bin keeps submission order) and rasterizes all tiles in parallel.
+ */
+
+void rstFlush(struct rstContext *ctx) {
+
+	unsigned int i, tx, ty, c, sum, tmp, num_tiles = ctx->tiles_x * ctx->tiles_y;
+	const struct rstPrim *prim;
+
+	memset(ctx->tile_start, 0, (num_tiles + 1) * sizeof(unsigned int));
+
+	for(i = 0; i < ctx->num_prims; i++) {
+		prim = &ctx->prims[i];
+		for(ty = prim->min_y / RST_TILE; ty <= (unsigned int)prim->max_y / RST_TILE; ty++){
+			for(tx = prim->min_x / RST_TILE; tx <= (unsigned int)prim->max_x / RST_TILE; tx++){
+				ctx->tile_start[ty * ctx->tiles_x + tx]++;
+			}
+		}
+	}
+
+	sum = 0;
+	for(c = 0; c <= num_tiles; c++) {
+		tmp = ctx->tile_start[c];
+		ctx->tile_start[c] = sum;
+		sum += tmp;
+	}
+
+	if(sum > ctx->max_bins){
+		ctx->max_bins = sum * 2;
+		ctx->bins = (unsigned int*)realloc(ctx->bins, ctx->max_bins * sizeof(unsigned int));
+	}
+
+	for(i = 0; i < ctx->num_prims; i++) {
+		prim = &ctx->prims[i];
+		for(ty = prim->min_y / RST_TILE; ty <= (unsigned int)prim->max_y / RST_TILE; ty++){
+			for(tx = prim->min_x / RST_TILE; tx <= (unsigned int)prim->max_x / RST_TILE; tx++){
+				ctx->bins[ctx->tile_start[ty * ctx->tiles_x + tx]++] = i;
+			}
+		}
+	}
+
+	for(c = num_tiles; c > 0; c--) {
+		ctx->tile_start[c] = ctx->tile_start[c - 1];
+	}
+	ctx->tile_start[0] = 0;
+
+	jobParallelFor(num_tiles, 1, rstTileJob, ctx);
+
+}
+
+/*
+ * rst png chunk (length, type, data, crc)
+ */
+
+static void rstPNGChunk(FILE *fp, const char *type, const unsigned char *data, unsigned int len) {
+
+	unsigned char be[4];
+	unsigned long crc;
+
+	be[0] = len >> 24; be[1] = len >> 16; be[2] = len >> 8; be[3] = len;
+	fwrite(be, 1, 4, fp);
+	fwrite(type, 1, 4, fp);
+	fwrite(data, 1, len, fp);
+
+	crc = crc32(0L, (const Bytef*)type, 4);
+	crc = crc32(crc, data, len);
+	be[0] = crc >> 24; be[1] = crc >> 16; be[2] = crc >> 8; be[3] = crc;
+	fwrite(be, 1, 4, fp);
+
+}
+
+/*
+ * rst write png (the framebuffer)
+ */
+
+int rstWritePNG(struct rstContext *ctx, const char *filename) {
+
+	return rstWriteRGBA(filename, ctx->pixels, ctx->width, ctx->height, 0);
+
+}
+
+/*
+ * rst write rgba
+ * Writes any RGBA buffer as an 8 bit RGBA PNG, filter 0 on every row.
+ * bottom_up flips rows the way glReadPixels returns them.
+ */
+
+int rstWriteRGBA(const char *filename, const unsigned char *pixels, int width, int height, int bottom_up) {
+
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	unsigned char ihdr[13];
+	size_t stride = (size_t)width * 4 + 1;
+	uLongf packed_len = compressBound(stride * height);
+	unsigned char *raw = (unsigned char*)malloc(stride * height);
+	unsigned char *packed = (unsigned char*)malloc(packed_len);
+	FILE *fp;
+	int y, src;
+
+	for(y = 0; y < height; y++) {
+		src = bottom_up ? height - 1 - y : y;
+		raw[y * stride] = 0;
+		memcpy(&raw[y * stride + 1], &pixels[(size_t)src * width * 4], width * 4);
+	}
+	compress2(packed, &packed_len, raw, stride * height, 6);
+
+	ihdr[0] = width >> 24; ihdr[1] = width >> 16; ihdr[2] = width >> 8; ihdr[3] = width;
+	ihdr[4] = height >> 24; ihdr[5] = height >> 16; ihdr[6] = height >> 8; ihdr[7] = height;
+	ihdr[8] = 8;
+	ihdr[9] = 6;
+	ihdr[10] = 0;
+	ihdr[11] = 0;
+	ihdr[12] = 0;
+
+	fp = fopen(filename, "wb");
+	if(fp == NULL){
+		fprintf(stderr, "Could not open %s\n", filename);
+		free(raw);
+		free(packed);
+		return -1;
+	}
+
+	fwrite(signature, 1, 8, fp);
+	rstPNGChunk(fp, "IHDR", ihdr, 13);
+	rstPNGChunk(fp, "IDAT", packed, (unsigned int)packed_len);
+	rstPNGChunk(fp, "IEND", NULL, 0);
+	fclose(fp);
+
+	free(raw);
+	free(packed);
+	return 0;
+
+}
+
+/*
+ * rst paeth
+ */
+
+static unsigned char rstPaeth(int a, int b, int c) {
+
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+	if(pa <= pb && pa <= pc){
+		return a;
+	}
+	return pb <= pc ? b : c;
+
+}
+
+/*
+ * rst compare png
+ * Loads an 8 bit RGB or RGBA non-interlaced PNG and counts the pixels
+ * that differ from the framebuffer. Returns -1 if the file can't be read
+ * or its size doesn't match.
+ */
+
+long rstComparePNG(struct rstContext *ctx, const char *filename) {
+
+	unsigned char hdr[8], *file = NULL, *idat = NULL, *raw = NULL, *prev, *cur;
+	unsigned int len, width = 0, height = 0, channels = 0, bpp;
+	size_t idat_len = 0, stride, i;
+	uLongf raw_len;
+	long diff = -1;
+	FILE *fp;
+	int x, y;
+	char type[5] = { 0 };
+
+	fp = fopen(filename, "rb");
+	if(fp == NULL){
+		fprintf(stderr, "Could not open %s\n", filename);
+		return -1;
+	}
+
+	if(fread(hdr, 1, 8, fp) != 8 || memcmp(hdr, "\x89PNG", 4) != 0){
+		fprintf(stderr, "%s is not a PNG\n", filename);
+		fclose(fp);
+		return -1;
+	}
+
+	while(fread(hdr, 1, 8, fp) == 8) {
+
+		len = (hdr[0] << 24) | (hdr[1] << 16) | (hdr[2] << 8) | hdr[3];
+		memcpy(type, &hdr[4], 4);
+		file = (unsigned char*)realloc(file, len + 4);
+		if(fread(file, 1, len + 4, fp) != len + 4){
+			break;
+		}
+
+		if(strcmp(type, "IHDR") == 0){
+			width = (file[0] << 24) | (file[1] << 16) | (file[2] << 8) | file[3];
+			height = (file[4] << 24) | (file[5] << 16) | (file[6] << 8) | file[7];
+			channels = file[9] == 6 ? 4 : (file[9] == 2 ? 3 : 0);
+			if(file[8] != 8 || channels == 0 || file[12] != 0){
+				fprintf(stderr, "%s: only 8 bit RGB/RGBA non-interlaced PNGs are supported\n", filename);
+				goto done;
+			}
+		} else if(strcmp(type, "IDAT") == 0){
+			idat = (unsigned char*)realloc(idat, idat_len + len);
+			memcpy(&idat[idat_len], file, len);
+			idat_len += len;
+		} else if(strcmp(type, "IEND") == 0){
+			break;
+		}
+
+	}
+
+	if(width != (unsigned int)ctx->width || height != (unsigned int)ctx->height){
+		fprintf(stderr, "%s is %ux%u, framebuffer is %dx%d\n", filename, width, height, ctx->width, ctx->height);
+		goto done;
+	}
+
+	bpp = channels;
+	stride = (size_t)width * bpp + 1;
+	raw_len = stride * height;
+	raw = (unsigned char*)malloc(raw_len);
+	if(uncompress(raw, &raw_len, idat, idat_len) != Z_OK){
+		fprintf(stderr, "%s: corrupt image data\n", filename);
+		goto done;
+	}
+
+	diff = 0;
+	for(y = 0; y < (int)height; y++) {
+
+		cur = &raw[y * stride + 1];
+		prev = y > 0 ? &raw[(y - 1) * stride + 1] : NULL;
+
+		for(i = 0; i < stride - 1; i++) {
+			int a = i >= bpp ? cur[i - bpp] : 0;
+			int b = prev ? prev[i] : 0;
+			int c = prev && i >= bpp ? prev[i - bpp] : 0;
+			switch(raw[y * stride]) {
+				case 1: cur[i] += a; break;
+				case 2: cur[i] += b; break;
+				case 3: cur[i] += (a + b) / 2; break;
+				case 4: cur[i] += rstPaeth(a, b, c); break;
+			}
+		}
+
+		for(x = 0; x < (int)width; x++) {
+			const unsigned char *fb = &ctx->pixels[((size_t)y * width + x) * 4];
+			const unsigned char *px = &cur[x * bpp];
+			if(fb[0] != px[0] || fb[1] != px[1] || fb[2] != px[2] ||
+				(bpp == 4 && fb[3] != px[3])){
+				diff++;
+			}
+		}
+
+	}
+
+done:
+	fclose(fp);
+	free(file);
+	free(idat);
+	free(raw);
+	return diff;
+
+}
@@ -0,0 +1,483 @@
+/*
+
+	Replay Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * A replay is a stream of per-tick input records with a full game state
+ * keyframe every RPL_KEYFRAME_INTERVAL ticks. Keyframes are xor'd against
+ * the previous keyframe and zero-run encoded, except every
+ * RPL_FULL_INTERVAL'th keyframe which is stored whole so seeking never has
+ * to walk more than a short chain. An index of keyframe offsets is written
+ * at the end of the file on close.
+ **/
+
+#define RPL_MAGIC 				0x314c5052
+#define RPL_INDEX_MAGIC 		0x584c5052
+#define RPL_KEYFRAME_INTERVAL 	300
+#define RPL_FULL_INTERVAL 		8
+#define RPL_MIN_ZERO_RUN 		4
+#define RPL_INITIAL_INDEX 		1024
+
+#define RPL_TAG_INPUT 			'I'
+#define RPL_TAG_KEYFRAME 		'K'
+
+struct rplKeyframe {
+	unsigned int tick;
+	unsigned int full;
+	long offset;
+};
+
+struct rplFile {
+	FILE *fp;
+	int writing;
+	unsigned int tick;
+	unsigned int num_keyframes;
+	unsigned int max_keyframes;
+	struct rplKeyframe *index;
+	long index_offset;
+	unsigned char *prev;
+	unsigned int prev_size;
+	unsigned int prev_cap;
+	unsigned char *scratch;
+	unsigned int scratch_size;
+	unsigned long input_bytes;
+	unsigned long keyframe_bytes;
+	unsigned long raw_state_bytes;
+};
+
+int rplCreate(struct rplFile *rpl, const char *filename, unsigned int max_state);
+int rplOpen(struct rplFile *rpl, const char *filename);
+void rplClose(struct rplFile *rpl);
+int rplWriteKeyframe(struct rplFile *rpl, const void *state, unsigned int size);
+void rplWriteInput(struct rplFile *rpl, unsigned int input);
+int rplReadInput(struct rplFile *rpl, unsigned int *input);
+int rplSeek(struct rplFile *rpl, unsigned int tick, void *state, unsigned int max_size);
+unsigned int rplEncode(unsigned char *dst, const unsigned char *src, const unsigned char *prev, unsigned int size, unsigned int prev_size);
+int rplDecode(unsigned char *dst, const unsigned char *src, unsigned int src_len, unsigned int size);
+
+/*
+ * rpl reserve (grow a byte buffer owned by the replay)
+ */
+
+static unsigned char* rplReserve(unsigned char *buf, unsigned int *cap, unsigned int size) {
+
+	if(size <= *cap){
+		return buf;
+	}
+
+	buf = (unsigned char*)realloc(buf, size);
+	if(buf == NULL){
+		fprintf(stderr, "rplReserve out of memory\n");
+		exit(1);
+	}
+	*cap = size;
+	return buf;
+
+}
+
+/*
+ * rpl create (open for recording)
+ * Buffers are reserved for max_state bytes of state and RPL_INITIAL_INDEX
+ * keyframes so recording does not allocate while the game is running.
+ */
+
+int rplCreate(struct rplFile *rpl, const char *filename, unsigned int max_state) {
+
+	unsigned int magic = RPL_MAGIC;
+
+	memset(rpl, 0, sizeof(struct rplFile));
+	rpl->fp = fopen(filename, "wb");
+	if(rpl->fp == NULL){
+		fprintf(stderr, "Could not open %s\n", filename);
+		return -1;
+	}
+
+	rpl->writing = 1;
+	rpl->max_keyframes = RPL_INITIAL_INDEX;
+	rpl->index = (struct rplKeyframe*)malloc(RPL_INITIAL_INDEX * sizeof(struct rplKeyframe));
+	rpl->prev = rplReserve(rpl->prev, &rpl->prev_cap, max_state);
+	rpl->scratch = rplReserve(rpl->scratch, &rpl->scratch_size, 2 * max_state + 8);
+
+	fwrite(&magic, sizeof(unsigned int), 1, rpl->fp);
+	return 0;
+
+}
+
+/*
+ * rpl open (open for playback, loads keyframe index)
+ * The trailer, the index and every keyframe offset in it are checked
+ * against the file size, so a truncated or corrupt recording fails here
+ * instead of seeking into garbage later.
+ */
+
+int rplOpen(struct rplFile *rpl, const char *filename) {
+
+	unsigned int magic, count, k;
+	long index_offset, file_size, trailer = (long)(sizeof(long) + 2 * sizeof(unsigned int));
+
+	memset(rpl, 0, sizeof(struct rplFile));
+	rpl->fp = fopen(filename, "rb");
+	if(rpl->fp == NULL){
+		fprintf(stderr, "Could not open %s\n", filename);
+		return -1;
+	}
+
+	if(fread(&magic, sizeof(unsigned int), 1, rpl->fp) != 1 || magic != RPL_MAGIC){
+		fprintf(stderr, "%s is not a replay file\n", filename);
+		fclose(rpl->fp);
+		return -1;
+	}
+
+	if(fseek(rpl->fp, 0, SEEK_END) != 0 || (file_size = ftell(rpl->fp)) < (long)sizeof(unsigned int) + trailer ||
+		fseek(rpl->fp, -trailer, SEEK_END) != 0 ||
+		fread(&index_offset, sizeof(long), 1, rpl->fp) != 1 ||
+		fread(&count, sizeof(unsigned int), 1, rpl->fp) != 1 ||
+		fread(&magic, sizeof(unsigned int), 1, rpl->fp) != 1 || magic != RPL_INDEX_MAGIC){
+		fprintf(stderr, "%s has no keyframe index (truncated recording?)\n", filename);
+		fclose(rpl->fp);
+		return -1;
+	}
+
+	// the index runs from index_offset right up to the trailer
+	if(index_offset < (long)sizeof(unsigned int) || index_offset > file_size - trailer ||
+		(unsigned long)(file_size - trailer - index_offset) != (unsigned long)count * sizeof(struct rplKeyframe)){
+		fprintf(stderr, "%s has a corrupt keyframe index\n", filename);
+		fclose(rpl->fp);
+		return -1;
+	}
+
+	rpl->index = (struct rplKeyframe*)malloc((count ? count : 1) * sizeof(struct rplKeyframe));
+	if(rpl->index == NULL){
+		fprintf(stderr, "rplOpen out of memory\n");
+		fclose(rpl->fp);
+		return -1;
+	}
+	rpl->num_keyframes = count;
+	rpl->max_keyframes = count;
+	rpl->index_offset = index_offset;
+
+	if(fseek(rpl->fp, index_offset, SEEK_SET) != 0 ||
+		fread(rpl->index, sizeof(struct rplKeyframe), count, rpl->fp) != count){
+		fprintf(stderr, "%s has a corrupt keyframe index\n", filename);
+		rplClose(rpl);
+		return -1;
+	}
+	for(k = 0; k < count; k++) {
+		if(rpl->index[k].offset < (long)sizeof(unsigned int) || rpl->index[k].offset >= index_offset ||
+			(k > 0 && rpl->index[k].tick < rpl->index[k - 1].tick)){
+			fprintf(stderr, "%s has a corrupt keyframe index\n", filename);
+			rplClose(rpl);
+			return -1;
+		}
+	}
+
+	fseek(rpl->fp, sizeof(unsigned int), SEEK_SET);
+	return 0;
+
+}
+
+/*
+ * rpl close (writes the keyframe index when recording)
+ */
+
+void rplClose(struct rplFile *rpl) {
+
+	unsigned int magic = RPL_INDEX_MAGIC;
+	long index_offset;
+
+	if(rpl->fp == NULL){
+		return;
+	}
+
+	if(rpl->writing){
+		index_offset = ftell(rpl->fp);
+		fwrite(rpl->index, sizeof(struct rplKeyframe), rpl->num_keyframes, rpl->fp);
+		fwrite(&index_offset, sizeof(long), 1, rpl->fp);
+		fwrite(&rpl->num_keyframes, sizeof(unsigned int), 1, rpl->fp);
+		fwrite(&magic, sizeof(unsigned int), 1, rpl->fp);
+	}
+
+	fclose(rpl->fp);
+	free(rpl->index);
+	free(rpl->prev);
+	free(rpl->scratch);
+	memset(rpl, 0, sizeof(struct rplFile));
+
+}
+
+/*
+ * rpl encode
+ * xor src against prev (missing prev bytes count as zero) and store as
+ * pairs of [u16 zero run][u16 literal run][literals]. Zero runs shorter
+ * than RPL_MIN_ZERO_RUN are folded into the literals, which bounds the
+ * output at 2 * size + 8 bytes.
+ */
+
+unsigned int rplEncode(unsigned char *dst, const unsigned char *src, const unsigned char *prev, unsigned int size, unsigned int prev_size) {
+
+	unsigned int i = 0, n = 0, zeros, start, run, j;
+	unsigned short hdr;
+
+	#define RPL_XOR(k) (src[k] ^ ((prev != NULL && (k) < prev_size) ? prev[k] : 0))
+
+	while(i < size) {
+
+		zeros = 0;
+		while(i < size && zeros < 0xffff && RPL_XOR(i) == 0){
+			zeros++;
+			i++;
+		}
+
+		start = i;
+		while(i < size && i - start < 0xffff) {
+			if(RPL_XOR(i) == 0){
+				run = 0;
+				while(i + run < size && run < RPL_MIN_ZERO_RUN && RPL_XOR(i + run) == 0){
+					run++;
+				}
+				if(run == RPL_MIN_ZERO_RUN || i + run == size){
+					break;
+				}
+			}
+			i++;
+		}
+
+		hdr = (unsigned short)zeros;
+		memcpy(&dst[n], &hdr, 2);
+		hdr = (unsigned short)(i - start);
+		memcpy(&dst[n + 2], &hdr, 2);
+		n += 4;
+
+		for(j = start; j < i; j++){
+			dst[n++] = RPL_XOR(j);
+		}
+
+	}
+
+	#undef RPL_XOR
+
+	return n;
+
+}
+
+/*
+ * rpl decode (xors the decoded delta into dst in place, returns -1 if a
+ * run goes past the end of src)
+ */
+
+int rplDecode(unsigned char *dst, const unsigned char *src, unsigned int src_len, unsigned int size) {
+
+	unsigned int n = 0, i = 0, j;
+	unsigned short zeros, lits;
+
+	while(n + 4 <= src_len) {
+
+		memcpy(&zeros, &src[n], 2);
+		memcpy(&lits, &src[n + 2], 2);
+		n += 4;
+		if(n + lits > src_len){
+			return -1;
+		}
+		i += zeros;
+
+		for(j = 0; j < lits && i < size; j++){
+			dst[i++] ^= src[n + j];
+		}
+		n += lits;
+
+	}
+
+	return n == src_len ? 0 : -1;
+
+}
+
+/*
+ * rpl write keyframe
+ */
+
+int rplWriteKeyframe(struct rplFile *rpl, const void *state, unsigned int size) {
+
+	struct rplKeyframe *key;
+	unsigned char tag = RPL_TAG_KEYFRAME;
+	unsigned int full, len;
+
+	if(rpl->num_keyframes == rpl->max_keyframes){
+		rpl->max_keyframes = rpl->max_keyframes ? rpl->max_keyframes * 2 : RPL_INITIAL_INDEX;
+		rpl->index = (struct rplKeyframe*)realloc(rpl->index, rpl->max_keyframes * sizeof(struct rplKeyframe));
+	}
+
+	full = (rpl->num_keyframes % RPL_FULL_INTERVAL) == 0;
+	rpl->scratch = rplReserve(rpl->scratch, &rpl->scratch_size, 2 * size + 8);
+	len = rplEncode(rpl->scratch, (const unsigned char*)state, full ? NULL : rpl->prev, size, rpl->prev_size);
+
+	key = &rpl->index[rpl->num_keyframes++];
+	key->tick = rpl->tick;
+	key->full = full;
+	key->offset = ftell(rpl->fp);
+
+	fwrite(&tag, 1, 1, rpl->fp);
+	fwrite(&size, sizeof(unsigned int), 1, rpl->fp);
+	fwrite(&len, sizeof(unsigned int), 1, rpl->fp);
+	fwrite(rpl->scratch, 1, len, rpl->fp);
+
+	rpl->keyframe_bytes += 1 + 2 * sizeof(unsigned int) + len;
+	rpl->raw_state_bytes += size;
+
+	rpl->prev = rplReserve(rpl->prev, &rpl->prev_cap, size);
+	memcpy(rpl->prev, state, size);
+	rpl->prev_size = size;
+
+	return full;
+
+}
+
+/*
+ * rpl write input (one per tick, advances the tick counter)
+ */
+
+void rplWriteInput(struct rplFile *rpl, unsigned int input) {
+
+	unsigned char tag = RPL_TAG_INPUT;
+	unsigned short mask = (unsigned short)input;
+
+	fwrite(&tag, 1, 1, rpl->fp);
+	fwrite(&mask, sizeof(unsigned short), 1, rpl->fp);
+	rpl->input_bytes += 1 + sizeof(unsigned short);
+	rpl->tick++;
+
+}
+
+/*
+ * rpl read input (skips keyframes, returns 0 at end of stream)
+ */
+
+int rplReadInput(struct rplFile *rpl, unsigned int *input) {
+
+	unsigned char tag;
+	unsigned short mask;
+	unsigned int size, len;
+
+	while(fread(&tag, 1, 1, rpl->fp) == 1) {
+
+		if(tag == RPL_TAG_KEYFRAME){
+			if(fread(&size, sizeof(unsigned int), 1, rpl->fp) != 1 ||
+				fread(&len, sizeof(unsigned int), 1, rpl->fp) != 1 ||
+				fseek(rpl->fp, len, SEEK_CUR) != 0){
+				return 0;
+			}
+			continue;
+		}
+
+		if(tag != RPL_TAG_INPUT){
+			return 0;
+		}
+
+		if(fread(&mask, sizeof(unsigned short), 1, rpl->fp) != 1){
+			return 0;
+		}
+		*input = mask;
+		rpl->tick++;
+		return 1;
+
+	}
+
+	return 0;
+
+}
+
+/*
+ * rpl seek
+ * Restores the newest keyframe at or before tick into state and leaves the
+ * stream positioned on that keyframe's first input. Returns the keyframe
+ * tick; the caller simulates forward (tick - return value) inputs, or -1
+ * if a keyframe on the way can't be read back.
+ */
+
+int rplSeek(struct rplFile *rpl, unsigned int tick, void *state, unsigned int max_size) {
+
+	unsigned int lo = 0, hi, mid, k, first, size, len;
+	unsigned char tag;
+
+	if(rpl->num_keyframes == 0){
+		return -1;
+	}
+
+	hi = rpl->num_keyframes;
+	while(hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if(rpl->index[mid].tick <= tick){
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	first = lo;
+	while(first > 0 && !rpl->index[first].full){
+		first--;
+	}
+
+	memset(state, 0, max_size);
+
+	for(k = first; k <= lo; k++) {
+
+		if(fseek(rpl->fp, rpl->index[k].offset, SEEK_SET) != 0 ||
+			fread(&tag, 1, 1, rpl->fp) != 1 || tag != RPL_TAG_KEYFRAME ||
+			fread(&size, sizeof(unsigned int), 1, rpl->fp) != 1 ||
+			fread(&len, sizeof(unsigned int), 1, rpl->fp) != 1){
+			fprintf(stderr, "rplSeek could not read keyframe %u\n", k);
+			return -1;
+		}
+
+		if(size > max_size){
+			fprintf(stderr, "rplSeek keyframe larger than state buffer\n");
+			return -1;
+		}
+
+		// rplEncode never writes more than 2 * size + 8 bytes
+		if(len > 2 * size + 8 || rpl->index[k].offset + 1 + 2 * (long)sizeof(unsigned int) + (long)len > rpl->index_offset){
+			fprintf(stderr, "rplSeek keyframe %u is corrupt\n", k);
+			return -1;
+		}
+
+		rpl->scratch = rplReserve(rpl->scratch, &rpl->scratch_size, len);
+		if(fread(rpl->scratch, 1, len, rpl->fp) != len){
+			fprintf(stderr, "rplSeek could not read keyframe %u\n", k);
+			return -1;
+		}
+
+		if(rpl->index[k].full){
+			memset(state, 0, max_size);
+		}
+		if(rplDecode((unsigned char*)state, rpl->scratch, len, size) < 0){
+			fprintf(stderr, "rplSeek keyframe %u is corrupt\n", k);
+			return -1;
+		}
+		memset((unsigned char*)state + size, 0, max_size - size);
+
+	}
+
+	rpl->tick = rpl->index[lo].tick;
+	return (int)rpl->index[lo].tick;
+
+}
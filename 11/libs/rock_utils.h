@@ -0,0 +1,376 @@
+/*
+
+	Rock Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The asteroid field is stored as parallel arrays (one per component)
+ * rather than an array of mtxObject so the integrator walks contiguous
+ * floats and the compiler can vectorize it. Removal swaps the last rock
+ * into the hole, so rocks stay packed in [0, count).
+ **/
+
+#define RCK_LARGE 				3
+#define RCK_MEDIUM 				2
+#define RCK_SMALL 				1
+#define RCK_CELL_SIZE 			32.0f
+
+struct rckField {
+	unsigned int count;
+	unsigned int capacity;
+	float *x;
+	float *y;
+	float *vx;
+	float *vy;
+	float *rot;
+	float *spin;
+	float *radius;
+	unsigned char *size;
+};
+
+struct rckGrid {
+	unsigned int cols;
+	unsigned int rows;
+	unsigned int *cell_start;
+	unsigned int *items;
+};
+
+void rckCreate(struct rckField *field, unsigned int capacity);
+void rckDestroy(struct rckField *field);
+int rckSpawn(struct rckField *field, float x, float y, unsigned int size, unsigned int *rng);
+void rckRemove(struct rckField *field, unsigned int index);
+void rckIntegrate(struct rckField *field, unsigned int begin, unsigned int end, float width, float height);
+unsigned int rckGridCells(float width, float height);
+void rckInitGrid(struct rckGrid *grid, float width, float height);
+void rckAssignCells(struct rckGrid *grid, struct rckField *field, unsigned int *cells, unsigned int begin, unsigned int end);
+void rckBuildGrid(struct rckGrid *grid, struct rckField *field, const unsigned int *cells);
+int rckQueryPoint(struct rckGrid *grid, struct rckField *field, float px, float py, float width, float height);
+float rckRandom(unsigned int *rng);
+unsigned int rckWrapGhosts(float x, float y, float radius, float width, float height, float *offsets);
+
+/*
+ * rck random (xorshift, returns [0, 1))
+ */
+
+float rckRandom(unsigned int *rng) {
+
+	*rng ^= *rng << 13;
+	*rng ^= *rng >> 17;
+	*rng ^= *rng << 5;
+	return (*rng >> 8) * (1.0f / 16777216.0f);
+
+}
+
+/*
+ * rck create
+ */
+
+void rckCreate(struct rckField *field, unsigned int capacity) {
+
+	memset(field, 0, sizeof(struct rckField));
+	field->capacity = capacity;
+	field->x = (float*)malloc(capacity * sizeof(float));
+	field->y = (float*)malloc(capacity * sizeof(float));
+	field->vx = (float*)malloc(capacity * sizeof(float));
+	field->vy = (float*)malloc(capacity * sizeof(float));
+	field->rot = (float*)malloc(capacity * sizeof(float));
+	field->spin = (float*)malloc(capacity * sizeof(float));
+	field->radius = (float*)malloc(capacity * sizeof(float));
+	field->size = (unsigned char*)malloc(capacity);
+
+	if(!field->x || !field->y || !field->vx || !field->vy || !field->rot ||
+		!field->spin || !field->radius || !field->size){
+		fprintf(stderr, "rckCreate could not reserve %u rocks\n", capacity);
+		exit(1);
+	}
+
+}
+
+/*
+ * rck destroy
+ */
+
+void rckDestroy(struct rckField *field) {
+
+	free(field->x);
+	free(field->y);
+	free(field->vx);
+	free(field->vy);
+	free(field->rot);
+	free(field->spin);
+	free(field->radius);
+	free(field->size);
+	memset(field, 0, sizeof(struct rckField));
+
+}
+
+/*
+ * rck spawn (random heading, smaller rocks move and spin faster)
+ */
+
+int rckSpawn(struct rckField *field, float x, float y, unsigned int size, unsigned int *rng) {
+
+	unsigned int i = field->count;
+	float heading, speed;
+
+	if(i == field->capacity){
+		return -1;
+	}
+
+	heading = rckRandom(rng) * 2.0f * M_PI;
+	speed = (0.5f + rckRandom(rng)) * (4 - size);
+
+	field->x[i] = x;
+	field->y[i] = y;
+	field->vx[i] = cosf(heading) * speed;
+	field->vy[i] = sinf(heading) * speed;
+	field->rot[i] = rckRandom(rng) * 360.0f;
+	field->spin[i] = (rckRandom(rng) - 0.5f) * 2.0f * (4 - size);
+	field->radius[i] = 8.0f * (1 << (size - 1));
+	field->size[i] = (unsigned char)size;
+
+	field->count++;
+	return (int)i;
+
+}
+
+/*
+ * rck remove (swap last into the hole)
+ */
+
+void rckRemove(struct rckField *field, unsigned int index) {
+
+	unsigned int last = --field->count;
+
+	field->x[index] = field->x[last];
+	field->y[index] = field->y[last];
+	field->vx[index] = field->vx[last];
+	field->vy[index] = field->vy[last];
+	field->rot[index] = field->rot[last];
+	field->spin[index] = field->spin[last];
+	field->radius[index] = field->radius[last];
+	field->size[index] = field->size[last];
+
+}
+
+/*
+ * rck integrate
+ * Branch-free so the loop vectorizes: wrapping is done with selects.
+ * Works on [begin, end) so the range can be split across threads.
+ */
+
+void rckIntegrate(struct rckField *field, unsigned int begin, unsigned int end, float width, float height) {
+
+	float * restrict x = field->x;
+	float * restrict y = field->y;
+	float * restrict rot = field->rot;
+	const float * restrict vx = field->vx;
+	const float * restrict vy = field->vy;
+	const float * restrict spin = field->spin;
+	unsigned int i;
+
+	for(i = begin; i < end; i++) {
+
+		float nx = x[i] + vx[i];
+		float ny = y[i] + vy[i];
+		float nr = rot[i] + spin[i];
+
+		nx = nx < 0.0f ? nx + width : nx;
+		nx = nx >= width ? nx - width : nx;
+		ny = ny < 0.0f ? ny + height : ny;
+		ny = ny >= height ? ny - height : ny;
+		nr = nr < 0.0f ? nr + 360.0f : nr;
+		nr = nr >= 360.0f ? nr - 360.0f : nr;
+
+		x[i] = nx;
+		y[i] = ny;
+		rot[i] = nr;
+
+	}
+
+}
+
+/*
+ * rck grid cells (number of cell_start entries rckBuildGrid needs, + 1)
+ */
+
+unsigned int rckGridCells(float width, float height) {
+
+	unsigned int cols = (unsigned int)ceilf(width / RCK_CELL_SIZE);
+	unsigned int rows = (unsigned int)ceilf(height / RCK_CELL_SIZE);
+	return cols * rows + 1;
+
+}
+
+/*
+ * rck cell (clamped, float wrap can land exactly on the far edge)
+ */
+
+static unsigned int rckCell(struct rckGrid *grid, float x, float y) {
+
+	unsigned int cx = (unsigned int)(x / RCK_CELL_SIZE);
+	unsigned int cy = (unsigned int)(y / RCK_CELL_SIZE);
+
+	cx = cx < grid->cols ? cx : grid->cols - 1;
+	cy = cy < grid->rows ? cy : grid->rows - 1;
+	return cy * grid->cols + cx;
+
+}
+
+/*
+ * rck init grid
+ */
+
+void rckInitGrid(struct rckGrid *grid, float width, float height) {
+
+	grid->cols = (unsigned int)ceilf(width / RCK_CELL_SIZE);
+	grid->rows = (unsigned int)ceilf(height / RCK_CELL_SIZE);
+
+}
+
+/*
+ * rck assign cells (cell index of each rock in [begin, end), independent
+ * per rock so it can be split across threads)
+ */
+
+void rckAssignCells(struct rckGrid *grid, struct rckField *field, unsigned int *cells, unsigned int begin, unsigned int end) {
+
+	unsigned int i;
+
+	for(i = begin; i < end; i++){
+		cells[i] = rckCell(grid, field->x[i], field->y[i]);
+	}
+
+}
+
+/*
+ * rck build grid
+ * Counting sort of rock indices by the cells from rckAssignCells. The
+ * caller supplies cell_start (rckGridCells entries) and items
+ * (field->count entries), normally from the frame arena.
+ */
+
+void rckBuildGrid(struct rckGrid *grid, struct rckField *field, const unsigned int *cells) {
+
+	unsigned int i, c, sum, tmp, num_cells;
+
+	num_cells = grid->cols * grid->rows;
+	memset(grid->cell_start, 0, (num_cells + 1) * sizeof(unsigned int));
+
+	for(i = 0; i < field->count; i++) {
+		grid->cell_start[cells[i]]++;
+	}
+
+	sum = 0;
+	for(c = 0; c <= num_cells; c++) {
+		tmp = grid->cell_start[c];
+		grid->cell_start[c] = sum;
+		sum += tmp;
+	}
+
+	for(i = 0; i < field->count; i++) {
+		grid->items[grid->cell_start[cells[i]]++] = i;
+	}
+
+	// cell_start[c] now holds the end of cell c, shift back up one
+	for(c = num_cells; c > 0; c--) {
+		grid->cell_start[c] = grid->cell_start[c - 1];
+	}
+	grid->cell_start[0] = 0;
+
+}
+
+/*
+ * rck query point
+ * Returns the index of a rock whose radius covers (px, py), searching the
+ * 3x3 cells around it with wrap-around, or -1.
+ */
+
+int rckQueryPoint(struct rckGrid *grid, struct rckField *field, float px, float py, float width, float height) {
+
+	unsigned int c = rckCell(grid, px, py);
+	int cx = c % grid->cols;
+	int cy = c / grid->cols;
+	int ox, oy;
+	unsigned int k, i;
+	float dx, dy;
+
+	for(oy = -1; oy <= 1; oy++) {
+		for(ox = -1; ox <= 1; ox++) {
+
+			c = ((cy + oy + grid->rows) % grid->rows) * grid->cols + (cx + ox + grid->cols) % grid->cols;
+
+			for(k = grid->cell_start[c]; k < grid->cell_start[c + 1]; k++) {
+
+				i = grid->items[k];
+				dx = field->x[i] - px;
+				dy = field->y[i] - py;
+				dx = dx > width * 0.5f ? dx - width : (dx < -width * 0.5f ? dx + width : dx);
+				dy = dy > height * 0.5f ? dy - height : (dy < -height * 0.5f ? dy + height : dy);
+
+				if(dx * dx + dy * dy < field->radius[i] * field->radius[i]){
+					return (int)i;
+				}
+
+			}
+
+		}
+	}
+
+	return -1;
+
+}
+
+/*
+ * rck wrap ghosts
+ * An object whose bounding circle crosses a screen edge must also be drawn
+ * on the opposite side. Writes up to three (dx, dy) offsets for those
+ * copies and returns how many; most objects need none.
+ */
+
+unsigned int rckWrapGhosts(float x, float y, float radius, float width, float height, float *offsets) {
+
+	float ex = x < radius ? width : (x > width - radius ? -width : 0.0f);
+	float ey = y < radius ? height : (y > height - radius ? -height : 0.0f);
+	unsigned int n = 0;
+
+	if(ex != 0.0f){
+		offsets[n * 2 + 0] = ex;
+		offsets[n * 2 + 1] = 0.0f;
+		n++;
+	}
+
+	if(ey != 0.0f){
+		offsets[n * 2 + 0] = 0.0f;
+		offsets[n * 2 + 1] = ey;
+		n++;
+	}
+
+	if(ex != 0.0f && ey != 0.0f){
+		offsets[n * 2 + 0] = ex;
+		offsets[n * 2 + 1] = ey;
+		n++;
+	}
+
+	return n;
+
+}
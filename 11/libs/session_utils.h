@@ -0,0 +1,693 @@
+/*
+
+	Session Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Client/server sessions on top of libs/net_utils.h and
+ * libs/snap_utils.h, include those first. The server owns the sim: each
+ * tick it takes one input per client out of that client's input buffer,
+ * steps the game and sends every client a snapshot. Clients only send
+ * inputs and keep the newest snapshot they have, so a lost snapshot is
+ * just skipped.
+ *
+ * The game plugs in through the hooks on a netServer: step runs one
+ * tick with an input mask per client slot and returns the sim tick,
+ * build fills the snapshot world and NET_STATUS words of game status
+ * (score and the like), weigh gives the relevance of each slot to a
+ * client and join / leave tell it a slot was taken or freed. Only step
+ * and build are required.
+ *
+ * Input payload: type, client tick, count, then the masks for that tick
+ * and up to NET_INPUT_REDUNDANCY - 1 ticks before it, newest first, so a
+ * lost input packet is covered by the next one. The server starts
+ * NET_INPUT_DELAY ticks behind a client's first input to ride out
+ * jitter, and repeats the last input when one still hasn't arrived.
+ *
+ * Snapshot payload, bit packed: type, client id, tick, last client tick
+ * applied for that client and the status words (NET_SNAPSHOT_HEADER
+ * bytes), then the world delta encoded against the newest snapshot the
+ * client acked. A client only acks a snapshot it decoded, so any
+ * baseline the server picks is one it has.
+ **/
+
+#define NET_TICK_MS 			(1000.0 / 60.0)
+#define NET_INPUT_REDUNDANCY 	16
+#define NET_INPUT_DELAY 		2
+#define NET_TIMEOUT_MS 			3000.0
+#define NET_STATUS 				2
+#define NET_SNAPSHOT_HEADER 	(10 + 4 * NET_STATUS)
+
+#define NET_MSG_INPUT 			1
+#define NET_MSG_SNAPSHOT 		2
+#define NET_MSG_BYE 			3
+
+struct netClient {
+	int active;
+	struct netPeer peer;
+	struct netInputBuffer inputs;
+	uint32_t next_tick;
+	uint32_t newest_tick;
+	unsigned int hold;
+	int synced;
+	uint32_t last_mask;
+	double join_ms;
+	unsigned long applied;
+	unsigned long missed;
+	struct snpHistory snaps;
+	unsigned long snapshot_bits;
+	unsigned long snapshot_slots;
+};
+
+struct netServer {
+	struct netSocket sock;
+	struct netClient *clients;
+	unsigned int max_clients;
+	unsigned int *inputs;
+	unsigned long ticks;
+	double tick_ms;
+	uint32_t tick;
+	uint32_t status[NET_STATUS];
+	struct snpEntity *world;
+	unsigned int world_count;
+	unsigned int max_entities;
+	float *weight;
+	uint32_t (*step)(struct netServer *srv, const unsigned int *inputs);
+	unsigned int (*build)(struct netServer *srv, struct snpEntity *world, uint32_t *status);
+	void (*weigh)(struct netServer *srv, int c, float *weight, const struct snpEntity *world, unsigned int count);
+	void (*join)(struct netServer *srv, int c);
+	void (*leave)(struct netServer *srv, int c);
+};
+
+struct netView {
+	int id;
+	uint32_t tick;
+	uint32_t input_tick;
+	uint32_t status[NET_STATUS];
+	unsigned int count;
+	struct snpEntity *entities;
+};
+
+struct netLink {
+	struct netSocket sock;
+	struct netPeer peer;
+	uint32_t tick;
+	double start_ms;
+	uint32_t history[NET_INPUT_REDUNDANCY];
+	struct snpHistory snaps;
+	int have_view;
+	uint16_t view_seq;
+	struct netView view;
+	unsigned long snapshots;
+};
+
+double netTimeMs();
+int netServerOpen(struct netServer *srv, int port, unsigned int max_clients, unsigned int max_entities);
+void netServerReceive(struct netServer *srv, double now_ms);
+void netServerTick(struct netServer *srv);
+void netServerSend(struct netServer *srv, double now_ms);
+void netServerUpdate(struct netServer *srv, double now_ms);
+void netServerRun(struct netServer *srv, long num_ticks, double stats_ms);
+void netServerReport(const struct netServer *srv, double now_ms);
+void netServerClose(struct netServer *srv);
+int netLinkOpen(struct netLink *link, const char *host, int port, unsigned int max_entities);
+void netLinkStep(struct netLink *link, unsigned int input, double now_ms);
+void netLinkClose(struct netLink *link, double now_ms);
+
+/*
+ * net time ms (monotonic wall clock)
+ */
+
+double netTimeMs() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+
+}
+
+/*
+ * net server open (hooks are set by the caller afterwards)
+ */
+
+int netServerOpen(struct netServer *srv, int port, unsigned int max_clients, unsigned int max_entities) {
+
+	unsigned int c;
+
+	memset(srv, 0, sizeof(struct netServer));
+	if(netOpen(&srv->sock, port) < 0){
+		return -1;
+	}
+
+	srv->max_clients = max_clients;
+	srv->max_entities = max_entities;
+	srv->clients = (struct netClient*)calloc(max_clients, sizeof(struct netClient));
+	srv->inputs = (unsigned int*)calloc(max_clients, sizeof(unsigned int));
+	srv->world = (struct snpEntity*)malloc(max_entities * sizeof(struct snpEntity));
+	srv->weight = (float*)malloc(max_entities * sizeof(float));
+	if(srv->clients == NULL || srv->inputs == NULL || srv->world == NULL || srv->weight == NULL){
+		fprintf(stderr, "netServerOpen out of memory\n");
+		exit(1);
+	}
+	for(c = 0; c < max_clients; c++) {
+		snpHistoryCreate(&srv->clients[c].snaps, max_entities);
+	}
+
+	return 0;
+
+}
+
+/*
+ * net server find
+ */
+
+static int netServerFind(const struct netServer *srv, const struct sockaddr_in *addr) {
+
+	unsigned int c;
+
+	for(c = 0; c < srv->max_clients; c++) {
+		const struct netClient *cl = &srv->clients[c];
+		if(cl->active && cl->peer.addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+			cl->peer.addr.sin_port == addr->sin_port){
+			return (int)c;
+		}
+	}
+
+	return -1;
+
+}
+
+/*
+ * net server join (a new address takes the first free slot)
+ */
+
+static int netServerJoin(struct netServer *srv, const struct sockaddr_in *addr, double now_ms) {
+
+	unsigned int c;
+
+	for(c = 0; c < srv->max_clients; c++) {
+
+		struct netClient *cl = &srv->clients[c];
+		if(cl->active){
+			continue;
+		}
+
+		// the snapshot history outlives the slot, only its contents go
+		struct snpHistory snaps = cl->snaps;
+		memset(cl, 0, sizeof(struct netClient));
+		cl->snaps = snaps;
+		snpHistoryClear(&cl->snaps);
+		cl->active = 1;
+		cl->join_ms = now_ms;
+		netPeerInit(&cl->peer, addr);
+		netInputClear(&cl->inputs);
+
+		if(srv->join != NULL){
+			srv->join(srv, (int)c);
+		}
+
+		fprintf(stderr, "Server: client %u joined from %s:%d\n", c, inet_ntoa(addr->sin_addr), ntohs(addr->sin_port));
+		return (int)c;
+
+	}
+
+	return -1;
+
+}
+
+/*
+ * net server leave
+ */
+
+static void netServerLeave(struct netServer *srv, int c, const char *reason) {
+
+	srv->clients[c].active = 0;
+	if(srv->leave != NULL){
+		srv->leave(srv, c);
+	}
+	fprintf(stderr, "Server: client %d %s\n", c, reason);
+
+}
+
+/*
+ * net server receive (reads everything waiting. Any input from an
+ * unknown address joins, the redundant masks in each input packet fill
+ * whatever holes earlier losses left in the input buffer)
+ */
+
+void netServerReceive(struct netServer *srv, double now_ms) {
+
+	unsigned char packet[NET_PACKET_SIZE];
+	const unsigned char *p;
+	struct sockaddr_in addr;
+	struct netClient *cl;
+	uint32_t tick;
+	uint16_t mask;
+	unsigned int i, n;
+	int c;
+
+	while(netRecv(&srv->sock, &addr, packet) == 0) {
+
+		p = packet + NET_HEADER_SIZE;
+		c = netServerFind(srv, &addr);
+		if(c < 0 && p[0] == NET_MSG_INPUT){
+			c = netServerJoin(srv, &addr, now_ms);
+		}
+		if(c < 0){
+			continue;
+		}
+
+		cl = &srv->clients[c];
+		if(netPeerAccept(&cl->peer, packet, now_ms) < 0){
+			continue;
+		}
+		if(p[0] == NET_MSG_BYE){
+			netServerLeave(srv, c, "left");
+			continue;
+		}
+		if(p[0] != NET_MSG_INPUT){
+			continue;
+		}
+
+		p = netGet32(p + 1, &tick);
+		n = *p++;
+
+		if(!cl->synced){
+			cl->synced = 1;
+			cl->next_tick = tick;
+			cl->newest_tick = tick;
+			cl->hold = NET_INPUT_DELAY;
+		} else if((int32_t)(tick - cl->next_tick) >= NET_INPUT_BUFFER / 2){
+			// the client got far ahead (it stalled, or we did), catch up
+			cl->next_tick = tick - NET_INPUT_DELAY;
+		}
+		if((int32_t)(tick - cl->newest_tick) > 0){
+			cl->newest_tick = tick;
+		}
+
+		for(i = 0; i < n && i < NET_INPUT_REDUNDANCY; i++) {
+			p = netGet16(p, &mask);
+			if((int32_t)(tick - i - cl->next_tick) >= 0){
+				netInputPut(&cl->inputs, tick - i, mask);
+			}
+		}
+
+	}
+
+}
+
+/*
+ * net server tick (one authoritative tick. A client whose input for
+ * this tick hasn't arrived repeats its last one and the miss is counted)
+ */
+
+void netServerTick(struct netServer *srv) {
+
+	uint32_t mask;
+	unsigned int c;
+
+	for(c = 0; c < srv->max_clients; c++) {
+
+		struct netClient *cl = &srv->clients[c];
+		srv->inputs[c] = 0;
+		if(!cl->active || !cl->synced){
+			continue;
+		}
+		if(cl->hold > 0){
+			cl->hold--;
+			continue;
+		}
+
+		if(netInputGet(&cl->inputs, cl->next_tick, &mask)){
+			cl->last_mask = mask;
+		} else {
+			cl->missed++;
+		}
+		srv->inputs[c] = cl->last_mask;
+		cl->next_tick++;
+		cl->applied++;
+
+	}
+
+	srv->tick = srv->step(srv, srv->inputs);
+	srv->ticks++;
+
+}
+
+/*
+ * net server snapshot (for client c into packet, whose header was
+ * stamped with seq. Expects srv->world to hold this tick)
+ */
+
+static void netServerSnapshot(struct netServer *srv, int c, unsigned char *packet, uint16_t seq) {
+
+	struct netClient *cl = &srv->clients[c];
+	struct snpBits bits;
+	struct snpStats stats;
+	unsigned int i;
+
+	snpBitsInit(&bits, packet + NET_HEADER_SIZE, NET_PACKET_SIZE - NET_HEADER_SIZE);
+	snpPut(&bits, NET_MSG_SNAPSHOT, 8);
+	snpPut(&bits, (uint32_t)c, 8);
+	snpPut(&bits, srv->tick, 32);
+	snpPut(&bits, cl->next_tick - 1, 32);
+	for(i = 0; i < NET_STATUS; i++) {
+		snpPut(&bits, srv->status[i], 32);
+	}
+
+	if(srv->weigh != NULL){
+		srv->weigh(srv, c, srv->weight, srv->world, srv->world_count);
+	}
+	if(snpEncode(&cl->snaps, seq, cl->peer.have_acked ? cl->peer.newest_acked : -1,
+		srv->world, srv->world_count, srv->weigh != NULL ? srv->weight : NULL, &bits, &stats) == 0){
+		cl->snapshot_bits += bits.pos;
+		cl->snapshot_slots += stats.written;
+	}
+
+}
+
+/*
+ * net server send (a snapshot to every client, dropping those that
+ * went quiet)
+ */
+
+void netServerSend(struct netServer *srv, double now_ms) {
+
+	unsigned char packet[NET_PACKET_SIZE];
+	uint16_t seq;
+	unsigned int c;
+
+	srv->world_count = srv->build(srv, srv->world, srv->status);
+
+	for(c = 0; c < srv->max_clients; c++) {
+
+		struct netClient *cl = &srv->clients[c];
+		if(!cl->active){
+			continue;
+		}
+		if(now_ms - cl->peer.last_recv_ms > NET_TIMEOUT_MS){
+			netServerLeave(srv, (int)c, "timed out");
+			continue;
+		}
+
+		memset(packet, 0, NET_PACKET_SIZE);
+		seq = cl->peer.local_seq;
+		netPeerStamp(&cl->peer, packet, now_ms);
+		netServerSnapshot(srv, (int)c, packet, seq);
+		netSend(&srv->sock, &cl->peer.addr, packet, now_ms);
+
+	}
+
+	netFlush(&srv->sock, now_ms);
+
+}
+
+/*
+ * net server update (receive, tick and send at now_ms, which can be a
+ * simulated clock; the busy time is measured on the wall clock)
+ */
+
+void netServerUpdate(struct netServer *srv, double now_ms) {
+
+	double start = netTimeMs();
+
+	netServerReceive(srv, now_ms);
+	netServerTick(srv);
+	netServerSend(srv, now_ms);
+	srv->tick_ms += netTimeMs() - start;
+
+}
+
+/*
+ * net server run (NET_TICK_MS per tick on the wall clock, for num_ticks
+ * ticks or forever when it is negative, tick rate and report every
+ * stats_ms)
+ */
+
+void netServerRun(struct netServer *srv, long num_ticks, double stats_ms) {
+
+	double start, now, last_report;
+	unsigned long last_ticks = srv->ticks;
+
+	start = last_report = netTimeMs();
+	while(num_ticks < 0 || srv->ticks < (unsigned long)num_ticks) {
+
+		now = netTimeMs();
+		if(srv->ticks >= (now - start) / NET_TICK_MS){
+			netFlush(&srv->sock, now);
+			usleep(1000);
+			continue;
+		}
+		// after a stall, drop the ticks instead of racing to catch up
+		if((now - start) / NET_TICK_MS - srv->ticks > NET_INPUT_DELAY){
+			start = now - srv->ticks * NET_TICK_MS;
+		}
+
+		netServerUpdate(srv, now);
+
+		if(now - last_report >= stats_ms){
+			fprintf(stderr, "Server: %.1f ticks/s\n", (srv->ticks - last_ticks) * 1000.0 / (now - last_report));
+			netServerReport(srv, now);
+			last_report = now;
+			last_ticks = srv->ticks;
+		}
+
+	}
+
+}
+
+/*
+ * net server report (tick cost and per client traffic since each
+ * joined. Unacked counts snapshots still in flight too)
+ */
+
+void netServerReport(const struct netServer *srv, double now_ms) {
+
+	unsigned int c;
+
+	fprintf(stderr, "Server: %lu ticks, %.3f ms/tick busy, %.0f ticks/s possible\n",
+		srv->ticks, srv->ticks ? srv->tick_ms / srv->ticks : 0.0,
+		srv->tick_ms > 0.0 ? srv->ticks * 1000.0 / srv->tick_ms : 0.0);
+
+	for(c = 0; c < srv->max_clients; c++) {
+
+		const struct netClient *cl = &srv->clients[c];
+		double seconds = (now_ms - cl->join_ms) / 1000.0;
+		if(!cl->active || seconds <= 0.0){
+			continue;
+		}
+
+		fprintf(stderr, "Server: client %u up %.1f kB/s, down %.1f kB/s, rtt %.1f ms, %.1f%% snapshots unacked, %lu of %lu inputs late\n",
+			c, cl->peer.bytes_received / 1024.0 / seconds, cl->peer.bytes_sent / 1024.0 / seconds, cl->peer.rtt_ms,
+			cl->peer.sent ? 100.0 * (cl->peer.sent - cl->peer.acked_count) / cl->peer.sent : 0.0,
+			cl->missed, cl->applied);
+		fprintf(stderr, "Server: client %u snapshots %.0f of %d bytes used, %.1f slots written\n",
+			c, cl->peer.sent ? cl->snapshot_bits / 8.0 / cl->peer.sent : 0.0, NET_PACKET_SIZE - NET_HEADER_SIZE,
+			cl->peer.sent ? (double)cl->snapshot_slots / cl->peer.sent : 0.0);
+
+	}
+
+}
+
+/*
+ * net server close (clients still on are dropped without a word)
+ */
+
+void netServerClose(struct netServer *srv) {
+
+	unsigned int c;
+
+	netClose(&srv->sock);
+	for(c = 0; c < srv->max_clients; c++) {
+		if(srv->clients[c].active && srv->leave != NULL){
+			srv->leave(srv, (int)c);
+		}
+		snpHistoryDestroy(&srv->clients[c].snaps);
+	}
+	free(srv->clients);
+	free(srv->inputs);
+	free(srv->world);
+	free(srv->weight);
+	srv->clients = NULL;
+	srv->max_clients = 0;
+
+}
+
+/*
+ * net link open (client side connection to the server at host:port)
+ */
+
+int netLinkOpen(struct netLink *link, const char *host, int port, unsigned int max_entities) {
+
+	struct sockaddr_in addr;
+
+	memset(link, 0, sizeof(struct netLink));
+	if(netResolve(&addr, host, port) < 0 || netOpen(&link->sock, 0) < 0){
+		return -1;
+	}
+	netPeerInit(&link->peer, &addr);
+	snpHistoryCreate(&link->snaps, max_entities);
+	link->view.entities = (struct snpEntity*)malloc(max_entities * sizeof(struct snpEntity));
+	if(link->view.entities == NULL){
+		fprintf(stderr, "netLinkOpen out of memory\n");
+		exit(1);
+	}
+	link->view.id = -1;
+	link->start_ms = -1.0;
+	return 0;
+
+}
+
+/*
+ * net link send (an input packet carries the newest
+ * NET_INPUT_REDUNDANCY masks)
+ */
+
+static void netLinkSend(struct netLink *link, unsigned char type, double now_ms) {
+
+	unsigned char packet[NET_PACKET_SIZE], *p;
+	unsigned int i, n;
+
+	memset(packet, 0, NET_PACKET_SIZE);
+	netPeerStamp(&link->peer, packet, now_ms);
+	p = packet + NET_HEADER_SIZE;
+	*p++ = type;
+
+	if(type == NET_MSG_INPUT){
+		p = netPut32(p, link->tick);
+		n = link->tick < NET_INPUT_REDUNDANCY ? link->tick + 1 : NET_INPUT_REDUNDANCY;
+		*p++ = (unsigned char)n;
+		for(i = 0; i < n; i++) {
+			p = netPut16(p, (uint16_t)link->history[(link->tick - i) % NET_INPUT_REDUNDANCY]);
+		}
+	}
+
+	netSend(&link->sock, &link->peer.addr, packet, now_ms);
+
+}
+
+/*
+ * net link read (decodes a snapshot packet into link->view, returns -1
+ * if it isn't one or its baseline is gone. The view keeps its own copy
+ * of the world so later decodes can reuse the history slot)
+ */
+
+static int netLinkRead(struct netLink *link, const unsigned char *packet, uint16_t seq) {
+
+	struct snpBits bits;
+	uint32_t id, tick, input_tick, status[NET_STATUS];
+	unsigned int i;
+
+	snpBitsInit(&bits, (unsigned char*)packet + NET_HEADER_SIZE, NET_PACKET_SIZE - NET_HEADER_SIZE);
+	if(snpGet(&bits, 8) != NET_MSG_SNAPSHOT){
+		return -1;
+	}
+	id = snpGet(&bits, 8);
+	tick = snpGet(&bits, 32);
+	input_tick = snpGet(&bits, 32);
+	for(i = 0; i < NET_STATUS; i++) {
+		status[i] = snpGet(&bits, 32);
+	}
+
+	if(snpDecode(&link->snaps, seq, &bits) < 0){
+		return -1;
+	}
+
+	link->view.id = (int)id;
+	link->view.tick = tick;
+	link->view.input_tick = input_tick;
+	memcpy(link->view.status, status, sizeof(status));
+	memcpy(link->view.entities, snpHistoryWorld(&link->snaps, seq, &link->view.count),
+		link->snaps.count[seq % SNP_RING] * sizeof(struct snpEntity));
+	link->view_seq = seq;
+	link->have_view = 1;
+	link->snapshots++;
+	return 0;
+
+}
+
+/*
+ * net link step (client side of a frame: decode snapshots newer than
+ * the one on show, then send one input per server tick since the last
+ * call however often this runs. A client that stalls skips the ticks it
+ * missed. Snapshots that arrive late or can't be decoded are never
+ * acked, so the server won't use them as a baseline)
+ */
+
+void netLinkStep(struct netLink *link, unsigned int input, double now_ms) {
+
+	unsigned char packet[NET_PACKET_SIZE];
+	struct sockaddr_in addr;
+	uint16_t seq;
+	uint32_t due;
+
+	while(netRecv(&link->sock, &addr, packet) == 0) {
+		if(addr.sin_addr.s_addr != link->peer.addr.sin_addr.s_addr || addr.sin_port != link->peer.addr.sin_port){
+			continue;
+		}
+		netGet16(packet, &seq);
+		if(link->have_view && !netSeqNewer(seq, link->view_seq)){
+			continue;
+		}
+		if(netLinkRead(link, packet, seq) == 0){
+			netPeerAccept(&link->peer, packet, now_ms);
+		}
+	}
+
+	if(link->start_ms < 0.0){
+		link->start_ms = now_ms;
+	}
+	due = (uint32_t)((now_ms - link->start_ms) / NET_TICK_MS + 0.5) + 1;
+	if(due - link->tick > NET_INPUT_REDUNDANCY){
+		link->tick = due - NET_INPUT_REDUNDANCY;
+	}
+
+	while(link->tick < due) {
+		link->history[link->tick % NET_INPUT_REDUNDANCY] = input;
+		netLinkSend(link, NET_MSG_INPUT, now_ms);
+		link->tick++;
+	}
+
+	netFlush(&link->sock, now_ms);
+
+}
+
+/*
+ * net link close (says bye to the server)
+ */
+
+void netLinkClose(struct netLink *link, double now_ms) {
+
+	// release anything still held back by simulated latency first, so
+	// the bye can't overtake an input and have it join again
+	netFlush(&link->sock, now_ms + link->sock.latency_ms + link->sock.jitter_ms);
+	netSetConditions(&link->sock, 0.0, 0.0, 0.0f, 0);
+	netLinkSend(link, NET_MSG_BYE, now_ms);
+	netClose(&link->sock);
+	snpHistoryDestroy(&link->snaps);
+	free(link->view.entities);
+	link->view.entities = NULL;
+
+}
@@ -0,0 +1,582 @@
+/*
+
+	Snapshot Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+/**
+ * Quantized, delta compressed, bit packed world snapshots. A world is an
+ * array of entity slots, each a kind, a radius in pixels, a position on
+ * a grid of SNP_POS_SCALE steps per pixel and an angle in
+ * SNP_ANGLE_BITS.
+ *
+ * A snpHistory holds the last SNP_RING worlds by packet sequence. The
+ * server keeps one per client with the world that client will have if
+ * each snapshot arrives, the client keeps one with what it decoded. A
+ * snapshot is encoded against a baseline the client acked. Only slots
+ * that differ from the baseline are written, in priority order: how
+ * far off the client is, times a per slot weight from the caller for
+ * relevance. Slots whose weighted error is under SNP_MIN_PRIORITY are
+ * culled, and whatever doesn't fit the bit budget keeps its baseline
+ * state and ranks higher next time because it drifts further.
+ *
+ * Written slots go out in index order as a gap from the previous one,
+ * then either a full state or a small delta per field.
+ **/
+
+#define SNP_RING 				32
+#define SNP_POS_SCALE 			4.0f
+#define SNP_POS_BITS 			12
+#define SNP_ANGLE_BITS 			10
+#define SNP_RADIUS_BITS 		6
+#define SNP_KIND_BITS 			2
+#define SNP_BUCKETS 			32
+#define SNP_MIN_PRIORITY 		2.0f
+#define SNP_CHANGED_PRIORITY 	1e6f
+#define SNP_GAP_ESTIMATE 		8
+#define SNP_GAP_MAX_BITS 		18
+#define SNP_END_BITS 			5
+
+#define SNP_EMPTY 				0
+#define SNP_SHIP 				1
+#define SNP_BULLET 				2
+#define SNP_ROCK 				3
+
+struct snpEntity {
+	uint16_t x;
+	uint16_t y;
+	uint16_t angle;
+	uint8_t kind;
+	uint8_t radius;
+};
+
+struct snpBits {
+	unsigned char *data;
+	unsigned int size;
+	unsigned int pos;
+	int overflow;
+};
+
+struct snpHistory {
+	unsigned int capacity;
+	struct snpEntity *worlds;
+	unsigned int count[SNP_RING];
+	uint16_t seq[SNP_RING];
+	unsigned char valid[SNP_RING];
+	unsigned char *bucket;
+};
+
+struct snpStats {
+	unsigned int written;
+	unsigned int pending;
+	unsigned int bits;
+};
+
+void snpBitsInit(struct snpBits *bits, unsigned char *data, unsigned int bytes);
+void snpPut(struct snpBits *bits, uint32_t value, unsigned int n);
+uint32_t snpGet(struct snpBits *bits, unsigned int n);
+void snpQuantize(struct snpEntity *e, unsigned int kind, float x, float y, float angle, float radius);
+void snpDequantize(const struct snpEntity *e, float *x, float *y, float *angle);
+int snpHistoryCreate(struct snpHistory *hist, unsigned int capacity);
+void snpHistoryDestroy(struct snpHistory *hist);
+void snpHistoryClear(struct snpHistory *hist);
+const struct snpEntity* snpHistoryWorld(const struct snpHistory *hist, uint16_t seq, unsigned int *count);
+int snpEncode(struct snpHistory *hist, uint16_t seq, int baseline, const struct snpEntity *world, unsigned int count,
+	const float *weight, struct snpBits *out, struct snpStats *stats);
+int snpDecode(struct snpHistory *hist, uint16_t seq, struct snpBits *in);
+
+/*
+ * snp bits (LSB first bit stream over a byte buffer, size and pos in
+ * bits; writes past the end are dropped and reads return 0, both set
+ * overflow)
+ */
+
+void snpBitsInit(struct snpBits *bits, unsigned char *data, unsigned int bytes) {
+
+	bits->data = data;
+	bits->size = bytes * 8;
+	bits->pos = 0;
+	bits->overflow = 0;
+
+}
+
+void snpPut(struct snpBits *bits, uint32_t value, unsigned int n) {
+
+	unsigned int shift, k;
+	unsigned char mask;
+
+	if(bits->pos + n > bits->size){
+		bits->overflow = 1;
+		return;
+	}
+
+	while(n > 0) {
+		shift = bits->pos & 7;
+		k = 8 - shift < n ? 8 - shift : n;
+		mask = (unsigned char)(((1u << k) - 1) << shift);
+		bits->data[bits->pos >> 3] = (bits->data[bits->pos >> 3] & ~mask) | ((value << shift) & mask);
+		value >>= k;
+		n -= k;
+		bits->pos += k;
+	}
+
+}
+
+uint32_t snpGet(struct snpBits *bits, unsigned int n) {
+
+	uint32_t value = 0;
+	unsigned int shift, k, got = 0;
+
+	if(bits->pos + n > bits->size){
+		bits->overflow = 1;
+		bits->pos = bits->size;
+		return 0;
+	}
+
+	while(got < n) {
+		shift = bits->pos & 7;
+		k = 8 - shift < n - got ? 8 - shift : n - got;
+		value |= (uint32_t)((bits->data[bits->pos >> 3] >> shift) & ((1u << k) - 1)) << got;
+		got += k;
+		bits->pos += k;
+	}
+
+	return value;
+
+}
+
+/*
+ * snp quantize (angle in degrees, any range)
+ */
+
+void snpQuantize(struct snpEntity *e, unsigned int kind, float x, float y, float angle, float radius) {
+
+	const float pos_max = (float)((1 << SNP_POS_BITS) - 1);
+	float px = roundf(x * SNP_POS_SCALE);
+	float py = roundf(y * SNP_POS_SCALE);
+	float turns = angle / 360.0f;
+
+	// empty slots are all zero so they compare equal whatever was there
+	memset(e, 0, sizeof(struct snpEntity));
+	if(kind == SNP_EMPTY){
+		return;
+	}
+
+	e->kind = (uint8_t)kind;
+	e->x = (uint16_t)(px < 0.0f ? 0.0f : (px > pos_max ? pos_max : px));
+	e->y = (uint16_t)(py < 0.0f ? 0.0f : (py > pos_max ? pos_max : py));
+	e->angle = (uint16_t)((long)roundf((turns - floorf(turns)) * (1 << SNP_ANGLE_BITS)) & ((1 << SNP_ANGLE_BITS) - 1));
+	e->radius = (uint8_t)(radius < 0.0f ? 0 : (radius > (1 << SNP_RADIUS_BITS) - 1 ? (1 << SNP_RADIUS_BITS) - 1 : (int)roundf(radius)));
+
+}
+
+void snpDequantize(const struct snpEntity *e, float *x, float *y, float *angle) {
+
+	*x = e->x / SNP_POS_SCALE;
+	*y = e->y / SNP_POS_SCALE;
+	*angle = e->angle * (360.0f / (1 << SNP_ANGLE_BITS));
+
+}
+
+/*
+ * snp history
+ */
+
+int snpHistoryCreate(struct snpHistory *hist, unsigned int capacity) {
+
+	memset(hist, 0, sizeof(struct snpHistory));
+	hist->capacity = capacity;
+	hist->worlds = (struct snpEntity*)malloc(SNP_RING * capacity * sizeof(struct snpEntity));
+	hist->bucket = (unsigned char*)malloc(capacity);
+
+	if(hist->worlds == NULL || hist->bucket == NULL){
+		fprintf(stderr, "snpHistoryCreate out of memory\n");
+		exit(1);
+	}
+
+	return 0;
+
+}
+
+void snpHistoryDestroy(struct snpHistory *hist) {
+
+	free(hist->worlds);
+	free(hist->bucket);
+	memset(hist, 0, sizeof(struct snpHistory));
+
+}
+
+void snpHistoryClear(struct snpHistory *hist) {
+
+	memset(hist->valid, 0, sizeof(hist->valid));
+
+}
+
+const struct snpEntity* snpHistoryWorld(const struct snpHistory *hist, uint16_t seq, unsigned int *count) {
+
+	unsigned int slot = seq % SNP_RING;
+
+	if(!hist->valid[slot] || hist->seq[slot] != seq){
+		return NULL;
+	}
+	*count = hist->count[slot];
+	return &hist->worlds[slot * hist->capacity];
+
+}
+
+/*
+ * Field deltas: '0' unchanged, '10' and 5 bits, '110' and 9 bits, or
+ * '111' and the whole new value.
+ */
+
+static int snpWrap(uint16_t value, uint16_t base, unsigned int width) {
+
+	int d = (value - base) & ((1 << width) - 1);
+	return d >= 1 << (width - 1) ? d - (1 << width) : d;
+
+}
+
+static unsigned int snpDeltaBits(int d, unsigned int width) {
+
+	if(d == 0){
+		return 1;
+	}
+	if(d >= -16 && d < 16){
+		return 2 + 5;
+	}
+	if(d >= -256 && d < 256){
+		return 3 + 9;
+	}
+	return 3 + width;
+
+}
+
+static void snpPutDelta(struct snpBits *bits, uint16_t value, uint16_t base, unsigned int width) {
+
+	int d = snpWrap(value, base, width);
+
+	if(d == 0){
+		snpPut(bits, 0, 1);
+	} else if(d >= -16 && d < 16){
+		snpPut(bits, 1, 2);
+		snpPut(bits, (uint32_t)d & 0x1f, 5);
+	} else if(d >= -256 && d < 256){
+		snpPut(bits, 3, 3);
+		snpPut(bits, (uint32_t)d & 0x1ff, 9);
+	} else {
+		snpPut(bits, 7, 3);
+		snpPut(bits, value, width);
+	}
+
+}
+
+static uint16_t snpGetDelta(struct snpBits *bits, uint16_t base, unsigned int width) {
+
+	int d;
+
+	if(!snpGet(bits, 1)){
+		return base;
+	}
+	if(!snpGet(bits, 1)){
+		d = (int)snpGet(bits, 5);
+		d = d >= 16 ? d - 32 : d;
+	} else if(!snpGet(bits, 1)){
+		d = (int)snpGet(bits, 9);
+		d = d >= 256 ? d - 512 : d;
+	} else {
+		return (uint16_t)snpGet(bits, width);
+	}
+
+	return (uint16_t)((base + d) & ((1 << width) - 1));
+
+}
+
+/*
+ * Slot gaps: 2 bits picking a width of 3, 6, 10 or 16 bits, then the
+ * gap. A gap of zero ends the list.
+ */
+
+static const unsigned int snp_gap_width[4] = { 3, 6, 10, 16 };
+
+static unsigned int snpGapClass(unsigned int gap) {
+
+	return gap < 8 ? 0 : (gap < 64 ? 1 : (gap < 1024 ? 2 : 3));
+
+}
+
+static int snpFull(const struct snpEntity *e, const struct snpEntity *base) {
+
+	return e->kind != base->kind || e->radius != base->radius || base->kind == SNP_EMPTY;
+
+}
+
+static unsigned int snpStateBits(const struct snpEntity *e, const struct snpEntity *base) {
+
+	if(snpFull(e, base)){
+		return 1 + SNP_KIND_BITS + (e->kind == SNP_EMPTY ? 0 : SNP_RADIUS_BITS + 2 * SNP_POS_BITS + SNP_ANGLE_BITS);
+	}
+	return 1 + snpDeltaBits(snpWrap(e->x, base->x, SNP_POS_BITS), SNP_POS_BITS) +
+		snpDeltaBits(snpWrap(e->y, base->y, SNP_POS_BITS), SNP_POS_BITS) +
+		snpDeltaBits(snpWrap(e->angle, base->angle, SNP_ANGLE_BITS), SNP_ANGLE_BITS);
+
+}
+
+/*
+ * How far off a client holding base is, in grid steps. The angle counts
+ * as the distance the rim of the entity is off by.
+ */
+
+static float snpError(const struct snpEntity *e, const struct snpEntity *base) {
+
+	if(e->kind != base->kind || e->radius != base->radius){
+		return SNP_CHANGED_PRIORITY;
+	}
+	if(e->kind == SNP_EMPTY){
+		return 0.0f;
+	}
+
+	return abs(snpWrap(e->x, base->x, SNP_POS_BITS)) + abs(snpWrap(e->y, base->y, SNP_POS_BITS)) +
+		abs(snpWrap(e->angle, base->angle, SNP_ANGLE_BITS)) * (e->radius * SNP_POS_SCALE * 2.0f * (float)M_PI / (1 << SNP_ANGLE_BITS));
+
+}
+
+/*
+ * snp encode (world as of packet seq against the acked baseline, or from
+ * nothing if baseline is -1 or no longer held, in what is left of out.
+ * Records what the client will have in hist. Returns -1 if not even the
+ * header fits)
+ *
+ * Slots are bucketed by the exponent of their priority and whole
+ * buckets taken from the top while their estimated size fits. The
+ * bucket where it runs out is taken in slot order as far as it fits
+ * without eating into the room the higher buckets still need.
+ */
+
+int snpEncode(struct snpHistory *hist, uint16_t seq, int baseline, const struct snpEntity *world, unsigned int count,
+	const float *weight, struct snpBits *out, struct snpStats *stats) {
+
+	static const struct snpEntity empty = { 0, 0, 0, SNP_EMPTY, 0 };
+	unsigned int bucket_bits[SNP_BUCKETS];
+	const struct snpEntity *base = NULL, *b;
+	struct snpEntity *next;
+	unsigned int base_count = 0, slot = seq % SNP_RING;
+	unsigned int i, k, cost, gap, cls, cut, budget, reserve, start = out->pos;
+	int prev = -1, e;
+	float p;
+
+	if(count > hist->capacity){
+		return -1;
+	}
+	if(baseline >= 0 && (uint16_t)(seq - baseline) > 0 && (uint16_t)(seq - baseline) < SNP_RING){
+		base = snpHistoryWorld(hist, (uint16_t)baseline, &base_count);
+	}
+	base_count = base != NULL ? base_count : 0;
+
+	memset(bucket_bits, 0, sizeof(bucket_bits));
+	for(i = 0; i < count; i++) {
+		b = i < base_count ? &base[i] : &empty;
+		p = snpError(&world[i], b) * (weight != NULL ? weight[i] : 1.0f);
+		k = 0;
+		if(p >= SNP_MIN_PRIORITY){
+			frexpf(p, &e);
+			k = e < 1 ? 1 : (e >= SNP_BUCKETS ? SNP_BUCKETS - 1 : (unsigned int)e);
+			bucket_bits[k] += snpStateBits(&world[i], b) + SNP_GAP_ESTIMATE;
+		}
+		hist->bucket[i] = (unsigned char)k;
+	}
+
+	snpPut(out, base != NULL, 1);
+	if(base != NULL){
+		snpPut(out, (uint16_t)baseline, 16);
+	}
+	snpPut(out, count, 16);
+	if(out->overflow || out->size - out->pos < SNP_END_BITS){
+		return -1;
+	}
+	budget = out->size - out->pos - SNP_END_BITS;
+
+	for(cut = SNP_BUCKETS - 1, cost = 0; cut > 0; cut--) {
+		if(cost + bucket_bits[cut] > budget){
+			break;
+		}
+		cost += bucket_bits[cut];
+	}
+
+	reserve = 0;
+	for(i = 0; i < count; i++) {
+		if(hist->bucket[i] > cut){
+			reserve += snpStateBits(&world[i], i < base_count ? &base[i] : &empty) + SNP_GAP_MAX_BITS;
+		}
+	}
+
+	// the client's world after this snapshot is the baseline plus what
+	// gets written below
+	next = &hist->worlds[slot * hist->capacity];
+	hist->valid[slot] = 0;
+	for(i = 0; i < count; i++) {
+		next[i] = i < base_count ? base[i] : empty;
+	}
+
+	stats->written = stats->pending = 0;
+	for(i = 0; i < count; i++) {
+
+		if(hist->bucket[i] == 0 || hist->bucket[i] < cut){
+			stats->pending += hist->bucket[i] > 0;
+			continue;
+		}
+
+		b = &next[i];
+		gap = i - prev;
+		cls = snpGapClass(gap);
+		cost = 2 + snp_gap_width[cls] + snpStateBits(&world[i], b);
+
+		if(hist->bucket[i] > cut){
+			reserve -= snpStateBits(&world[i], b) + SNP_GAP_MAX_BITS;
+			if(out->pos + cost + SNP_END_BITS > out->size){
+				stats->pending++;
+				continue;
+			}
+		} else if(out->pos + cost + reserve + SNP_END_BITS > out->size){
+			stats->pending++;
+			continue;
+		}
+
+		snpPut(out, cls, 2);
+		snpPut(out, gap, snp_gap_width[cls]);
+		if(snpFull(&world[i], b)){
+			snpPut(out, 1, 1);
+			snpPut(out, world[i].kind, SNP_KIND_BITS);
+			if(world[i].kind != SNP_EMPTY){
+				snpPut(out, world[i].radius, SNP_RADIUS_BITS);
+				snpPut(out, world[i].x, SNP_POS_BITS);
+				snpPut(out, world[i].y, SNP_POS_BITS);
+				snpPut(out, world[i].angle, SNP_ANGLE_BITS);
+			}
+		} else {
+			snpPut(out, 0, 1);
+			snpPutDelta(out, world[i].x, b->x, SNP_POS_BITS);
+			snpPutDelta(out, world[i].y, b->y, SNP_POS_BITS);
+			snpPutDelta(out, world[i].angle, b->angle, SNP_ANGLE_BITS);
+		}
+
+		next[i] = world[i];
+		prev = (int)i;
+		stats->written++;
+
+	}
+
+	// gap class 0 with a zero gap, SNP_END_BITS in all
+	snpPut(out, 0, 2);
+	snpPut(out, 0, snp_gap_width[0]);
+
+	hist->count[slot] = count;
+	hist->seq[slot] = seq;
+	hist->valid[slot] = 1;
+	stats->bits = out->pos - start;
+	return 0;
+
+}
+
+/*
+ * snp decode (into hist as packet seq, returns -1 if the baseline it
+ * names isn't held or the data runs out)
+ */
+
+int snpDecode(struct snpHistory *hist, uint16_t seq, struct snpBits *in) {
+
+	static const struct snpEntity empty = { 0, 0, 0, SNP_EMPTY, 0 };
+	const struct snpEntity *base = NULL;
+	struct snpEntity *next, *e;
+	unsigned int base_count = 0, slot = seq % SNP_RING;
+	unsigned int i, count, gap, cls;
+	uint16_t baseline = 0;
+	int has_base, index = -1;
+
+	has_base = (int)snpGet(in, 1);
+	if(has_base){
+		baseline = (uint16_t)snpGet(in, 16);
+	}
+	count = snpGet(in, 16);
+
+	if(in->overflow || count > hist->capacity){
+		return -1;
+	}
+	if(has_base){
+		if((uint16_t)(seq - baseline) == 0 || (uint16_t)(seq - baseline) >= SNP_RING){
+			return -1;
+		}
+		base = snpHistoryWorld(hist, baseline, &base_count);
+		if(base == NULL){
+			return -1;
+		}
+	}
+
+	next = &hist->worlds[slot * hist->capacity];
+	hist->valid[slot] = 0;
+	for(i = 0; i < count; i++) {
+		next[i] = i < base_count ? base[i] : empty;
+	}
+
+	while(1) {
+
+		cls = snpGet(in, 2);
+		gap = snpGet(in, snp_gap_width[cls]);
+		if(gap == 0){
+			break;
+		}
+		index += (int)gap;
+		if(in->overflow || index >= (int)count){
+			return -1;
+		}
+
+		e = &next[index];
+		if(snpGet(in, 1)){
+			*e = empty;
+			e->kind = (uint8_t)snpGet(in, SNP_KIND_BITS);
+			if(e->kind != SNP_EMPTY){
+				e->radius = (uint8_t)snpGet(in, SNP_RADIUS_BITS);
+				e->x = (uint16_t)snpGet(in, SNP_POS_BITS);
+				e->y = (uint16_t)snpGet(in, SNP_POS_BITS);
+				e->angle = (uint16_t)snpGet(in, SNP_ANGLE_BITS);
+			}
+		} else {
+			if(e->kind == SNP_EMPTY){
+				return -1;
+			}
+			e->x = snpGetDelta(in, e->x, SNP_POS_BITS);
+			e->y = snpGetDelta(in, e->y, SNP_POS_BITS);
+			e->angle = snpGetDelta(in, e->angle, SNP_ANGLE_BITS);
+		}
+
+	}
+
+	if(in->overflow){
+		return -1;
+	}
+
+	hist->count[slot] = count;
+	hist->seq[slot] = seq;
+	hist->valid[slot] = 1;
+	return 0;
+
+}
@@ -0,0 +1,419 @@
+/*
+
+	Text Utilities
+
+	Copyright (C) 2016 Benjamin Collins
+
+	This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License version 3
+    as published by the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ * HUD text from a signed distance field atlas. The glyphs are a built-in
+ * 5x7 pixel font; txtCreate turns each into a distance field once at
+ * startup, so one small atlas stays sharp at any size (the fragment
+ * shader thresholds at 0.5 with a screen-space smoothstep).
+ *
+ * Every string drawn lives in a cache slot with a fixed region of one
+ * vertex buffer. A string drawn again with the same text, position and
+ * size reuses its slot: no layout and no upload. Only new or changed
+ * strings are laid out and streamed in with glBufferSubData. All slots
+ * used in a frame go out in one glMultiDrawArrays call; slots not used
+ * for a frame are recycled least recently used first.
+ **/
+
+#define TXT_GLYPH_W 			5
+#define TXT_GLYPH_H 			7
+#define TXT_PAD 				1
+#define TXT_SCALE 				4
+#define TXT_SPREAD 				1.0f
+#define TXT_ATLAS_COLS 			8
+#define TXT_MAX_LEN 			32
+#define TXT_SLOTS 				32
+#define TXT_FLOATS 				4
+#define TXT_SLOT_VERTS 			(TXT_MAX_LEN * 6)
+
+static const char txt_charset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ :.-/%(),+=";
+
+// one byte per row, top row first, bit 4 is the leftmost pixel
+static const unsigned char txt_font[][TXT_GLYPH_H] = {
+	{ 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // 0
+	{ 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 1
+	{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // 2
+	{ 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // 3
+	{ 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // 4
+	{ 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // 5
+	{ 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // 6
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+	{ 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // 8
+	{ 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // 9
+	{ 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // A
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, // B
+	{ 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, // C
+	{ 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, // D
+	{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, // E
+	{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, // F
+	{ 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, // G
+	{ 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // H
+	{ 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // I
+	{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, // J
+	{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+	{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, // L
+	{ 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+	{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+	{ 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // O
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, // P
+	{ 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, // Q
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, // R
+	{ 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, // S
+	{ 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // U
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // V
+	{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, // W
+	{ 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, // X
+	{ 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 }, // Y
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, // Z
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+	{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, // :
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // .
+	{ 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // -
+	{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // /
+	{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // %
+	{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // (
+	{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+	{ 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 }, // ,
+	{ 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 }, // +
+	{ 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 }  // =
+};
+
+struct txtSlot {
+	char text[TXT_MAX_LEN + 1];
+	float x;
+	float y;
+	float size;
+	GLint first;
+	GLsizei count;
+	unsigned int last_used;
+};
+
+struct txtBatch {
+	GLuint atlas;
+	int atlas_width;
+	int atlas_height;
+	GLuint vbo;
+	GLuint program;
+	GLint attribute_coord2d;
+	GLint attribute_texcoord;
+	GLint uniform_matrixOrtho2d;
+	GLint uniform_atlas;
+	struct txtSlot slots[TXT_SLOTS];
+	GLint draw_first[TXT_SLOTS];
+	GLsizei draw_count[TXT_SLOTS];
+	unsigned int num_draws;
+	unsigned int frame;
+	GLfloat scratch[TXT_SLOT_VERTS * TXT_FLOATS];
+	unsigned long layouts;
+	unsigned long hits;
+};
+
+void txtCreate(struct txtBatch *batch, GLuint program);
+void txtDestroy(struct txtBatch *batch);
+void txtBegin(struct txtBatch *batch);
+void txtPrint(struct txtBatch *batch, float x, float y, float size, const char *text);
+void txtFlush(struct txtBatch *batch, const GLfloat *projection);
+
+/*
+ * txt glyph (index into txt_font, lower case folds to upper, anything
+ * else draws as a space)
+ */
+
+static int txtGlyph(char c) {
+
+	const char *p;
+
+	if(c >= 'a' && c <= 'z'){
+		c -= 'a' - 'A';
+	}
+
+	p = c ? strchr(txt_charset, c) : NULL;
+	return p ? (int)(p - txt_charset) : (int)(strchr(txt_charset, ' ') - txt_charset);
+
+}
+
+/*
+ * txt lit (pixel of glyph g, off outside the 5x7 box)
+ */
+
+static int txtLit(int g, int px, int py) {
+
+	if(px < 0 || py < 0 || px >= TXT_GLYPH_W || py >= TXT_GLYPH_H){
+		return 0;
+	}
+	return (txt_font[g][py] >> (TXT_GLYPH_W - 1 - px)) & 1;
+
+}
+
+/*
+ * txt distance field
+ * Brute force per texel: distance in font pixels to the nearest pixel of
+ * the other kind, signed and mapped so 0.5 is the outline and TXT_SPREAD
+ * pixels either side reach 0 and 1. Only runs once.
+ */
+
+static void txtDistanceField(unsigned char *atlas, int stride, int g, int ox, int oy) {
+
+	int cw = (TXT_GLYPH_W + 2 * TXT_PAD) * TXT_SCALE;
+	int ch = (TXT_GLYPH_H + 2 * TXT_PAD) * TXT_SCALE;
+	int tx, ty, sx, sy, inside;
+	float px, py, dx, dy, d, best;
+
+	for(ty = 0; ty < ch; ty++) {
+		for(tx = 0; tx < cw; tx++) {
+
+			px = (tx + 0.5f) / TXT_SCALE - TXT_PAD;
+			py = (ty + 0.5f) / TXT_SCALE - TXT_PAD;
+			inside = txtLit(g, (int)floorf(px), (int)floorf(py));
+			best = TXT_SPREAD * TXT_SPREAD;
+
+			for(sy = -TXT_PAD - 1; sy <= TXT_GLYPH_H + TXT_PAD; sy++) {
+				for(sx = -TXT_PAD - 1; sx <= TXT_GLYPH_W + TXT_PAD; sx++) {
+					if(txtLit(g, sx, sy) == inside){
+						continue;
+					}
+					dx = px < sx ? sx - px : (px > sx + 1 ? px - sx - 1 : 0.0f);
+					dy = py < sy ? sy - py : (py > sy + 1 ? py - sy - 1 : 0.0f);
+					d = dx * dx + dy * dy;
+					best = d < best ? d : best;
+				}
+			}
+
+			d = sqrtf(best) / TXT_SPREAD;
+			d = 0.5f + (inside ? d : -d) * 0.5f;
+			atlas[(oy + ty) * stride + ox + tx] = (unsigned char)(d * 255.0f + 0.5f);
+
+		}
+	}
+
+}
+
+/*
+ * txt create (program built from shdr/text_vertex.glsl and
+ * shdr/text_fragment.glsl)
+ */
+
+void txtCreate(struct txtBatch *batch, GLuint program) {
+
+	int num_glyphs = sizeof(txt_font) / sizeof(txt_font[0]);
+	int cw = (TXT_GLYPH_W + 2 * TXT_PAD) * TXT_SCALE;
+	int ch = (TXT_GLYPH_H + 2 * TXT_PAD) * TXT_SCALE;
+	unsigned char *atlas;
+	int g;
+
+	memset(batch, 0, sizeof(struct txtBatch));
+	batch->program = program;
+	batch->atlas_width = TXT_ATLAS_COLS * cw;
+	batch->atlas_height = ((num_glyphs + TXT_ATLAS_COLS - 1) / TXT_ATLAS_COLS) * ch;
+
+	atlas = (unsigned char*)calloc(batch->atlas_width * batch->atlas_height, 1);
+	for(g = 0; g < num_glyphs; g++) {
+		txtDistanceField(atlas, batch->atlas_width, g, (g % TXT_ATLAS_COLS) * cw, (g / TXT_ATLAS_COLS) * ch);
+	}
+
+	glGenTextures(1, &batch->atlas);
+	glBindTexture(GL_TEXTURE_2D, batch->atlas);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, batch->atlas_width, batch->atlas_height, 0,
+		GL_LUMINANCE, GL_UNSIGNED_BYTE, atlas);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	free(atlas);
+
+	glGenBuffers(1, &batch->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, batch->vbo);
+	glBufferData(GL_ARRAY_BUFFER, TXT_SLOTS * TXT_SLOT_VERTS * TXT_FLOATS * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+
+	batch->attribute_coord2d = mtxGetShaderAttribute(program, "coord2d");
+	batch->attribute_texcoord = mtxGetShaderAttribute(program, "texcoord");
+	batch->uniform_matrixOrtho2d = mtxGetShaderUniform(program, "matrixOrtho2d");
+	batch->uniform_atlas = mtxGetShaderUniform(program, "atlas");
+
+}
+
+/*
+ * txt destroy
+ */
+
+void txtDestroy(struct txtBatch *batch) {
+
+	if(batch->vbo == 0){
+		return;
+	}
+
+	glDeleteTextures(1, &batch->atlas);
+	glDeleteBuffers(1, &batch->vbo);
+	memset(batch, 0, sizeof(struct txtBatch));
+
+}
+
+/*
+ * txt begin
+ */
+
+void txtBegin(struct txtBatch *batch) {
+
+	batch->num_draws = 0;
+	batch->frame++;
+
+}
+
+/*
+ * txt layout (quads for text into scratch, returns vertex count; x, y is
+ * the top left corner, size the glyph height in pixels)
+ */
+
+static GLsizei txtLayout(struct txtBatch *batch, float x, float y, float size, const char *text) {
+
+	int cw = (TXT_GLYPH_W + 2 * TXT_PAD) * TXT_SCALE;
+	int ch = (TXT_GLYPH_H + 2 * TXT_PAD) * TXT_SCALE;
+	float unit = size / TXT_GLYPH_H;
+	float w = (TXT_GLYPH_W + 2 * TXT_PAD) * unit;
+	float h = (TXT_GLYPH_H + 2 * TXT_PAD) * unit;
+	float x0, y0, u0, v0, u1, v1;
+	GLfloat *v = batch->scratch;
+	GLsizei n = 0;
+	int i, g;
+
+	// cells overlap by the padding so glyphs sit one font pixel apart
+	x -= TXT_PAD * unit;
+	y += TXT_PAD * unit;
+
+	for(i = 0; text[i] && i < TXT_MAX_LEN; i++) {
+
+		g = txtGlyph(text[i]);
+		x0 = x + i * (TXT_GLYPH_W + 1) * unit;
+		y0 = y;
+		u0 = (float)((g % TXT_ATLAS_COLS) * cw) / batch->atlas_width;
+		v0 = (float)((g / TXT_ATLAS_COLS) * ch) / batch->atlas_height;
+		u1 = u0 + (float)cw / batch->atlas_width;
+		v1 = v0 + (float)ch / batch->atlas_height;
+
+		#define TXT_VERT(px, py, tu, tv) v[n * 4 + 0] = px; v[n * 4 + 1] = py; v[n * 4 + 2] = tu; v[n * 4 + 3] = tv; n++;
+		TXT_VERT(x0, y0, u0, v0);
+		TXT_VERT(x0, y0 - h, u0, v1);
+		TXT_VERT(x0 + w, y0, u1, v0);
+		TXT_VERT(x0 + w, y0, u1, v0);
+		TXT_VERT(x0, y0 - h, u0, v1);
+		TXT_VERT(x0 + w, y0 - h, u1, v1);
+		#undef TXT_VERT
+
+	}
+
+	return n;
+
+}
+
+/*
+ * txt print (queue a string for this frame, y up like the rest of the
+ * scene, longer strings are cut at TXT_MAX_LEN)
+ */
+
+void txtPrint(struct txtBatch *batch, float x, float y, float size, const char *text) {
+
+	struct txtSlot *slot = NULL, *oldest = NULL;
+	int i;
+
+	for(i = 0; i < TXT_SLOTS; i++) {
+		struct txtSlot *s = &batch->slots[i];
+		if(s->count > 0 && s->x == x && s->y == y && s->size == size &&
+			strncmp(s->text, text, TXT_MAX_LEN) == 0){
+			slot = s;
+			break;
+		}
+		if(s->last_used != batch->frame && (oldest == NULL || s->last_used < oldest->last_used)){
+			oldest = s;
+		}
+	}
+
+	if(slot != NULL){
+		batch->hits++;
+	} else {
+
+		if(oldest == NULL){
+			return;
+		}
+
+		slot = oldest;
+		strncpy(slot->text, text, TXT_MAX_LEN);
+		slot->text[TXT_MAX_LEN] = '\0';
+		slot->x = x;
+		slot->y = y;
+		slot->size = size;
+		slot->first = (GLint)(slot - batch->slots) * TXT_SLOT_VERTS;
+		slot->count = txtLayout(batch, x, y, size, text);
+
+		glBindBuffer(GL_ARRAY_BUFFER, batch->vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, slot->first * TXT_FLOATS * sizeof(GLfloat),
+			slot->count * TXT_FLOATS * sizeof(GLfloat), batch->scratch);
+		batch->layouts++;
+
+	}
+
+	if(slot->last_used != batch->frame && slot->count > 0){
+		batch->draw_first[batch->num_draws] = slot->first;
+		batch->draw_count[batch->num_draws] = slot->count;
+		batch->num_draws++;
+	}
+	slot->last_used = batch->frame;
+
+}
+
+/*
+ * txt flush (every slot used this frame in one draw call)
+ */
+
+void txtFlush(struct txtBatch *batch, const GLfloat *projection) {
+
+	if(batch->num_draws == 0){
+		return;
+	}
+
+	glUseProgram(batch->program);
+	glUniformMatrix4fv(batch->uniform_matrixOrtho2d, 1, GL_FALSE, projection);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, batch->atlas);
+	glUniform1i(batch->uniform_atlas, 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, batch->vbo);
+	glEnableVertexAttribArray(batch->attribute_coord2d);
+	glEnableVertexAttribArray(batch->attribute_texcoord);
+	glVertexAttribPointer(batch->attribute_coord2d, 2, GL_FLOAT, GL_FALSE, TXT_FLOATS * sizeof(GLfloat), 0);
+	glVertexAttribPointer(batch->attribute_texcoord, 2, GL_FLOAT, GL_FALSE, TXT_FLOATS * sizeof(GLfloat),
+		(const GLvoid*)(2 * sizeof(GLfloat)));
+
+	glEnable(GL_BLEND);
+	glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ZERO, GL_ONE);
+	glMultiDrawArrays(GL_TRIANGLES, batch->draw_first, batch->draw_count, batch->num_draws);
+	glDisable(GL_BLEND);
+
+	glDisableVertexAttribArray(batch->attribute_coord2d);
+	glDisableVertexAttribArray(batch->attribute_texcoord);
+
+}
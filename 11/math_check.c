@@ -0,0 +1,891 @@
+/*
+ * Math check and benchmark, built apart from the game so nothing here
+ * ships in prgm.c. With no arguments it checks every stage's matrix code
+ * (05 to 11, each stage's libs/mtx_utils.h included under its own
+ * prefix through check_stage.h), lib/kinectGL.h and lib/mathGL.h against
+ * a double precision reference and exits 1 on any failure (make
+ * check-math). With --bench it times the multiplies, object transforms
+ * and sincos paths against the code they replaced (make bench-math).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <GL/glew.h>
+#include "libs/mtx_utils.h"
+#include "../lib/kinectGL.h"
+
+#define CHECK_PASTE(a, b) a##b
+#define CHECK_JOIN(a, b) CHECK_PASTE(a, b)
+#define CHECK_NAME(name) CHECK_JOIN(CHECK_STAGE, name)
+
+#define CHECK_STAGE s05
+#define CHECK_STAGE_HEADER "../05/libs/mtx_utils.h"
+#include "check_stage.h"
+#define CHECK_STAGE s06
+#define CHECK_STAGE_HEADER "../06/libs/mtx_utils.h"
+#include "check_stage.h"
+#define CHECK_STAGE s07
+#define CHECK_STAGE_HEADER "../07/libs/mtx_utils.h"
+#include "check_stage.h"
+#define CHECK_STAGE s08
+#define CHECK_STAGE_HEADER "../08/libs/mtx_utils.h"
+#include "check_stage.h"
+#define CHECK_STAGE s09
+#define CHECK_STAGE_HEADER "../09/libs/mtx_utils.h"
+#include "check_stage.h"
+#define CHECK_STAGE s10
+#define CHECK_STAGE_HEADER "../10/libs/mtx_utils.h"
+#include "check_stage.h"
+
+#define MATH_BENCH_ITERS 2000000
+#define SINCOS_BENCH_ANGLES 4096
+#define CHECK_TRIALS 10000
+#define CHECK_TOLERANCE 1e-5
+#define CHECK_ORTHO_SPAN 4097
+// two mtxAffine2dBatch chunks and a tail that is not a whole SSE batch
+#define CHECK_BATCH (2 * MTX_BATCH_CHUNK + 3)
+
+#define CHECK_STAGES 7
+#define CHECK_IDENTITY 0
+#define CHECK_ORTHO 1
+#define CHECK_MULTIPLY 2
+#define CHECK_ASSOCIATIVE 3
+#define CHECK_TRANSLATE 4
+#define CHECK_SCALE 5
+#define CHECK_ROTATE 6
+#define CHECK_STAGE_KINDS 9
+#define CHECK_SHARED 15
+
+int run_math_bench();
+int run_check_math();
+
+double get_time_ms() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+
+}
+
+// xorshift like rckRandom, [0, 1)
+static float check_random(unsigned int *seed) {
+
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+	return (*seed >> 8) * (1.0f / 16777216.0f);
+
+}
+
+/*
+ * The multiplies stages 06 to 10 (heap temporary, as fixed) and
+ * lib/kinectGL.h (stack temporary) had before they went through
+ * mathGL.h, copied unchanged and kept here only to benchmark against.
+ */
+
+static void bench_heap_multiply(GLfloat *a, GLfloat *b) {
+
+	GLfloat *p = (GLfloat*)malloc(16*sizeof(GLfloat));
+	
+	// First Row
+	p[M_00] = a[M_00]*b[M_00]+a[M_01]*b[M_10]+a[M_02]*b[M_20]+a[M_03]*b[M_30];
+	p[M_01] = a[M_00]*b[M_01]+a[M_01]*b[M_11]+a[M_02]*b[M_21]+a[M_03]*b[M_31];
+	p[M_02] = a[M_00]*b[M_02]+a[M_01]*b[M_12]+a[M_02]*b[M_22]+a[M_03]*b[M_32];
+	p[M_03] = a[M_00]*b[M_03]+a[M_01]*b[M_13]+a[M_02]*b[M_23]+a[M_03]*b[M_33];
+	
+	// Second Row
+	p[M_10] = a[M_10]*b[M_00]+a[M_11]*b[M_10]+a[M_12]*b[M_20]+a[M_13]*b[M_30];
+	p[M_11] = a[M_10]*b[M_01]+a[M_11]*b[M_11]+a[M_12]*b[M_21]+a[M_13]*b[M_31];
+	p[M_12] = a[M_10]*b[M_02]+a[M_11]*b[M_12]+a[M_12]*b[M_22]+a[M_13]*b[M_32];
+	p[M_13] = a[M_10]*b[M_03]+a[M_11]*b[M_13]+a[M_12]*b[M_23]+a[M_13]*b[M_33];
+
+	// Third Row
+	p[M_20] = a[M_20]*b[M_00]+a[M_21]*b[M_10]+a[M_22]*b[M_20]+a[M_23]*b[M_30];
+	p[M_21] = a[M_20]*b[M_01]+a[M_21]*b[M_11]+a[M_22]*b[M_21]+a[M_23]*b[M_31];
+	p[M_22] = a[M_20]*b[M_02]+a[M_21]*b[M_12]+a[M_22]*b[M_22]+a[M_23]*b[M_32];
+	p[M_23] = a[M_20]*b[M_03]+a[M_21]*b[M_13]+a[M_22]*b[M_23]+a[M_23]*b[M_33];
+
+	// Fourth Row
+	p[M_30] = a[M_30]*b[M_00]+a[M_31]*b[M_10]+a[M_32]*b[M_20]+a[M_33]*b[M_30];
+	p[M_31] = a[M_30]*b[M_01]+a[M_31]*b[M_11]+a[M_32]*b[M_21]+a[M_33]*b[M_31];
+	p[M_32] = a[M_30]*b[M_02]+a[M_31]*b[M_12]+a[M_32]*b[M_22]+a[M_33]*b[M_32];
+	p[M_33] = a[M_30]*b[M_03]+a[M_31]*b[M_13]+a[M_32]*b[M_23]+a[M_33]*b[M_33];
+	
+	a[0] = p[0]; a[1] = p[1]; a[2] = p[2]; a[3] = p[3];
+	a[4] = p[4]; a[5] = p[5]; a[6] = p[6]; a[7] = p[7];
+	a[8] = p[8]; a[9] = p[9]; a[10] = p[10]; a[11] = p[11]; 
+	a[12] = p[12]; a[13] = p[13]; a[14] = p[14]; a[15] = p[15];
+
+	free(p);
+
+}
+
+static void bench_stack_multiply(GLfloat *a, GLfloat *b) {
+	
+	GLfloat c[] = {
+		1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1
+	};
+	
+	// First Row
+	c[M_00] = a[M_00]*b[M_00] + a[M_01]*b[M_10] + a[M_02]*b[M_20] + a[M_03]*b[M_30];
+	c[M_01] = a[M_00]*b[M_01] + a[M_01]*b[M_11] + a[M_02]*b[M_21] + a[M_03]*b[M_31];
+	c[M_02] = a[M_00]*b[M_02] + a[M_01]*b[M_12] + a[M_02]*b[M_22] + a[M_03]*b[M_32];
+	c[M_03] = a[M_00]*b[M_03] + a[M_01]*b[M_13] + a[M_02]*b[M_23] + a[M_03]*b[M_33];
+
+	// Second Row
+	c[M_10] = a[M_10]*b[M_00] + a[M_11]*b[M_10] + a[M_12]*b[M_20] + a[M_13]*b[M_30];
+	c[M_11] = a[M_10]*b[M_01] + a[M_11]*b[M_11] + a[M_12]*b[M_21] + a[M_13]*b[M_31];
+	c[M_12] = a[M_10]*b[M_02] + a[M_11]*b[M_12] + a[M_12]*b[M_22] + a[M_13]*b[M_32];
+	c[M_13] = a[M_10]*b[M_03] + a[M_11]*b[M_13] + a[M_12]*b[M_23] + a[M_13]*b[M_33];
+
+	// Third Row
+	c[M_20] = a[M_20]*b[M_00] + a[M_21]*b[M_10] + a[M_22]*b[M_20] + a[M_23]*b[M_30];
+	c[M_21] = a[M_20]*b[M_01] + a[M_21]*b[M_11] + a[M_22]*b[M_21] + a[M_23]*b[M_31];
+	c[M_22] = a[M_20]*b[M_02] + a[M_21]*b[M_12] + a[M_22]*b[M_22] + a[M_23]*b[M_32];
+	c[M_23] = a[M_20]*b[M_03] + a[M_21]*b[M_13] + a[M_22]*b[M_23] + a[M_23]*b[M_33];
+
+	// Fourth Row
+	c[M_30] = a[M_30]*b[M_00] + a[M_31]*b[M_10] + a[M_32]*b[M_20] + a[M_33]*b[M_30];
+	c[M_31] = a[M_30]*b[M_01] + a[M_31]*b[M_11] + a[M_32]*b[M_21] + a[M_33]*b[M_31];
+	c[M_32] = a[M_30]*b[M_02] + a[M_31]*b[M_12] + a[M_32]*b[M_22] + a[M_33]*b[M_32];
+	c[M_33] = a[M_30]*b[M_03] + a[M_31]*b[M_13] + a[M_32]*b[M_23] + a[M_33]*b[M_33];
+	
+	// Copy product to first element
+
+	a[0] = c[0]; a[1] = c[1]; a[2] = c[2]; a[3] = c[3];
+	a[4] = c[4]; a[5] = c[5]; a[6] = c[6]; a[7] = c[7];
+	a[8] = c[8]; a[9] = c[9]; a[10] = c[10]; a[11] = c[11];
+	a[12] = c[12]; a[13] = c[13]; a[14] = c[14]; a[15] = c[15];
+
+}
+
+/*
+ * Chain MATH_BENCH_ITERS 4x4 multiplies through the old heap and stack
+ * versions and lib/mathGL.h, then build object
+ * matrices the old way (three full multiplies per call) and with the
+ * in-place helpers. All results must agree.
+ */
+
+/*
+ * Largest sin or cos error against double precision libm.
+ */
+
+static double sincos_error(const float *degrees, const float *s, const float *c, unsigned int count) {
+
+	double err = 0.0, r;
+	unsigned int i;
+
+	for(i = 0; i < count; i++) {
+		r = degrees[i] * (M_PI / 180.0);
+		err = fmax(err, fmax(fabs(s[i] - sin(r)), fabs(c[i] - cos(r))));
+	}
+	return err;
+
+}
+
+int run_math_bench() {
+
+	GLfloat step[16], heap[16], ki[16], mth[16], obj[16], affine[6], inverse[6], check[16];
+	double start, heap_ms, ki_ms, mth_ms, full_ms, fast_ms, mat4_ms, affine_ms, diff = 0.0;
+	struct mtxObject bench_obj;
+	static float angles[SINCOS_BENCH_ANGLES], sines[SINCOS_BENCH_ANGLES], cosines[SINCOS_BENCH_ANGLES];
+	double libm_ms, poly_ms, batch_ms, table_ms, libm_err, poly_err, batch_err, table_err;
+	unsigned int pass, passes = MATH_BENCH_ITERS / SINCOS_BENCH_ANGLES;
+	float c = cosf(0.001f), sn = sinf(0.001f);
+	// keeps the timed loops from being optimized away
+	volatile float sink = 0.0f;
+	unsigned int i;
+
+	// a small rotation plus translation keeps the chain bounded
+	mthMat4Identity(step);
+	mthMat4RotateZ(step, c, sn);
+	mthMat4RotateX(step, c, sn);
+	step[M_03] = 0.001f;
+
+	mthMat4Identity(heap);
+	mthMat4Identity(ki);
+	mthMat4Identity(mth);
+
+	start = get_time_ms();
+	for(i = 0; i < MATH_BENCH_ITERS; i++) {
+		bench_heap_multiply(heap, step);
+	}
+	heap_ms = get_time_ms() - start;
+
+	start = get_time_ms();
+	for(i = 0; i < MATH_BENCH_ITERS; i++) {
+		bench_stack_multiply(ki, step);
+	}
+	ki_ms = get_time_ms() - start;
+
+	start = get_time_ms();
+	for(i = 0; i < MATH_BENCH_ITERS; i++) {
+		mthMat4Multiply(mth, mth, step);
+	}
+	mth_ms = get_time_ms() - start;
+
+	for(i = 0; i < 16; i++) {
+		diff = fmax(diff, fabs(heap[i] - mth[i]));
+		diff = fmax(diff, fabs(ki[i] - mth[i]));
+	}
+
+	start = get_time_ms();
+	for(i = 0; i < MATH_BENCH_ITERS; i++) {
+		GLfloat t[16];
+		mthMat4Identity(obj);
+		mthMat4Identity(t);
+		t[M_03] = i * 0.001f;
+		t[M_13] = 2.0f;
+		bench_stack_multiply(obj, t);
+		mthMat4Identity(t);
+		t[M_00] = c; t[M_01] = -sn; t[M_10] = sn; t[M_11] = c;
+		bench_stack_multiply(obj, t);
+		mthMat4Identity(t);
+		t[M_00] = 3.0f; t[M_11] = 3.0f;
+		bench_stack_multiply(obj, t);
+		sink += obj[M_03];
+	}
+	full_ms = get_time_ms() - start;
+
+	start = get_time_ms();
+	for(i = 0; i < MATH_BENCH_ITERS; i++) {
+		mthMat4Identity(mth);
+		mthMat4Translate(mth, i * 0.001f, 2.0f, 0.0f);
+		mthMat4RotateZ(mth, c, sn);
+		mthMat4Scale(mth, 3.0f, 3.0f, 1.0f);
+		sink -= mth[M_03];
+	}
+	fast_ms = get_time_ms() - start;
+
+	for(i = 0; i < 16; i++) {
+		diff = fmax(diff, fabs(obj[i] - mth[i]));
+	}
+
+	// what build_transforms used to do per object against what it does now
+	memset(&bench_obj, 0, sizeof(bench_obj));
+	bench_obj.scl[0] = bench_obj.scl[1] = 3.0f;
+	bench_obj.scl[2] = 1.0f;
+	bench_obj.pos[1] = 2.0f;
+
+	start = get_time_ms();
+	for(i = 0; i < MATH_BENCH_ITERS; i++) {
+		bench_obj.pos[0] = i * 0.001f;
+		bench_obj.rot[2] = i * 0.01f;
+		mtxTransformObject(&bench_obj);
+		sink += bench_obj.matrix[M_00] + bench_obj.matrix[M_03];
+	}
+	mat4_ms = get_time_ms() - start;
+
+	start = get_time_ms();
+	for(i = 0; i < MATH_BENCH_ITERS; i++) {
+		bench_obj.pos[0] = i * 0.001f;
+		bench_obj.rot[2] = i * 0.01f;
+		mtxTransformObject2d(&bench_obj, affine);
+		sink -= affine[A_00] + affine[A_02];
+	}
+	affine_ms = get_time_ms() - start;
+
+	mthAffine2ToMat4(check, affine);
+	for(i = 0; i < 16; i++) {
+		diff = fmax(diff, fabs(check[i] - bench_obj.matrix[i]));
+	}
+
+	// m * inverse(m) should come back as the identity, translation error
+	// relative to how far out the object is
+	mthAffine2Invert(inverse, affine);
+	mthAffine2Compose(inverse, affine, inverse);
+	diff = fmax(diff, fabs(inverse[A_00] - 1.0) + fabs(inverse[A_01]) + fabs(inverse[A_10]) + fabs(inverse[A_11] - 1.0));
+	diff = fmax(diff, (fabs(inverse[A_02]) + fabs(inverse[A_12])) / (1.0 + fabs(affine[A_02]) + fabs(affine[A_12])));
+
+	// sincos over two turns either way, as the old per object path did it
+	// (float radians, double libm) against the float versions
+	for(i = 0; i < SINCOS_BENCH_ANGLES; i++) {
+		angles[i] = (i * 1440.0f) / SINCOS_BENCH_ANGLES - 720.0f + 0.0137f;
+	}
+	mthSinCosTableInit();
+
+	start = get_time_ms();
+	for(pass = 0; pass < passes; pass++) {
+		for(i = 0; i < SINCOS_BENCH_ANGLES; i++) {
+			GLfloat radians = angles[i] / 180 * M_PI;
+			sines[i] = sin(radians);
+			cosines[i] = cos(radians);
+		}
+		sink += sines[pass] + cosines[pass];
+	}
+	libm_ms = get_time_ms() - start;
+	libm_err = sincos_error(angles, sines, cosines, SINCOS_BENCH_ANGLES);
+
+	start = get_time_ms();
+	for(pass = 0; pass < passes; pass++) {
+		for(i = 0; i < SINCOS_BENCH_ANGLES; i++) {
+			mthSinCosDeg(angles[i], &sines[i], &cosines[i]);
+		}
+		sink += sines[pass] + cosines[pass];
+	}
+	poly_ms = get_time_ms() - start;
+	poly_err = sincos_error(angles, sines, cosines, SINCOS_BENCH_ANGLES);
+
+	start = get_time_ms();
+	for(pass = 0; pass < passes; pass++) {
+		mthSinCosDegBatch(angles, sines, cosines, SINCOS_BENCH_ANGLES);
+		sink += sines[pass] + cosines[pass];
+	}
+	batch_ms = get_time_ms() - start;
+	batch_err = sincos_error(angles, sines, cosines, SINCOS_BENCH_ANGLES);
+
+	start = get_time_ms();
+	for(pass = 0; pass < passes; pass++) {
+		for(i = 0; i < SINCOS_BENCH_ANGLES; i++) {
+			mthSinCosDegTable(angles[i], &sines[i], &cosines[i]);
+		}
+		sink += sines[pass] + cosines[pass];
+	}
+	table_ms = get_time_ms() - start;
+	table_err = sincos_error(angles, sines, cosines, SINCOS_BENCH_ANGLES);
+
+	fprintf(stderr, "Math: multiply ns/op: heap temporaries %.2f, stack temporaries %.2f, mthMat4Multiply %.2f (%.2fx, %.2fx)\n",
+		heap_ms * 1e6 / MATH_BENCH_ITERS, ki_ms * 1e6 / MATH_BENCH_ITERS, mth_ms * 1e6 / MATH_BENCH_ITERS,
+		heap_ms / mth_ms, ki_ms / mth_ms);
+	fprintf(stderr, "Math: object matrix ns/op: three multiplies %.2f, in-place helpers %.2f (%.2fx), max difference %g\n",
+		full_ms * 1e6 / MATH_BENCH_ITERS, fast_ms * 1e6 / MATH_BENCH_ITERS, full_ms / fast_ms, diff);
+	fprintf(stderr, "Math: 2D object ns/op: mat4 %.2f, affine %.2f (%.0f%% less), upload %u -> %u bytes\n",
+		mat4_ms * 1e6 / MATH_BENCH_ITERS, affine_ms * 1e6 / MATH_BENCH_ITERS, 100.0 * (1.0 - affine_ms / mat4_ms),
+		(unsigned int)(16 * sizeof(GLfloat)), (unsigned int)sizeof(affine));
+	fprintf(stderr, "Math: sincos ns/angle (max error): libm %.2f (%.1e), polynomial %.2f (%.1e), "
+		"SSE batch %.2f (%.1e), table %.2f (%.1e)\n",
+		libm_ms * 1e6 / (passes * SINCOS_BENCH_ANGLES), libm_err, poly_ms * 1e6 / (passes * SINCOS_BENCH_ANGLES), poly_err,
+		batch_ms * 1e6 / (passes * SINCOS_BENCH_ANGLES), batch_err, table_ms * 1e6 / (passes * SINCOS_BENCH_ANGLES), table_err);
+
+	return diff > 1e-5 || poly_err > 1e-6 || batch_err > 1e-6 || table_err > 1e-5 ? 1 : 0;
+
+}
+
+/*
+ * Double precision reference for the check, column-major like the
+ * float code (element (r, c) at c * 4 + r) and computed the textbook way.
+ */
+
+static void ref_identity(double *m) {
+
+	int i;
+
+	for(i = 0; i < 16; i++) {
+		m[i] = i % 5 == 0 ? 1.0 : 0.0;
+	}
+
+}
+
+static void ref_multiply(double *out, const double *a, const double *b) {
+
+	double p[16];
+	int r, c, k;
+
+	for(c = 0; c < 4; c++) {
+		for(r = 0; r < 4; r++) {
+			p[c * 4 + r] = 0.0;
+			for(k = 0; k < 4; k++) {
+				p[c * 4 + r] += a[k * 4 + r] * b[c * 4 + k];
+			}
+		}
+	}
+	memcpy(out, p, sizeof(p));
+
+}
+
+// m = m * R about axis 0, 1 or 2, counterclockwise for positive degrees
+static void ref_rotate(double *m, int axis, double degrees) {
+
+	double t[16], c = cos(degrees * M_PI / 180.0), s = sin(degrees * M_PI / 180.0);
+	int i = (axis + 1) % 3, j = (axis + 2) % 3;
+
+	ref_identity(t);
+	t[i * 4 + i] = c;
+	t[j * 4 + i] = -s;
+	t[i * 4 + j] = s;
+	t[j * 4 + j] = c;
+	ref_multiply(m, m, t);
+
+}
+
+static void ref_translate(double *m, double x, double y, double z) {
+
+	double t[16];
+
+	ref_identity(t);
+	t[M_03] = x;
+	t[M_13] = y;
+	t[M_23] = z;
+	ref_multiply(m, m, t);
+
+}
+
+static void ref_scale(double *m, double x, double y, double z) {
+
+	double t[16];
+
+	ref_identity(t);
+	t[M_00] = x;
+	t[M_11] = y;
+	t[M_22] = z;
+	ref_multiply(m, m, t);
+
+}
+
+static void ref_ortho(double *m, double w, double h) {
+
+	ref_identity(m);
+	m[M_00] = 2.0 / w;
+	m[M_11] = 2.0 / h;
+	m[M_22] = -2.0 / 1.1;
+	m[M_03] = -1.0;
+	m[M_13] = -1.0;
+	m[M_23] = -0.9 / 1.1;
+
+}
+
+static void ref_from_float(double *out, const GLfloat *m, int n) {
+
+	int i;
+
+	for(i = 0; i < n; i++) {
+		out[i] = m[i];
+	}
+
+}
+
+/*
+ * Largest difference between n floats and their reference, relative to
+ * the largest reference element so big and small matrices compare alike.
+ */
+
+static double ref_error(const GLfloat *got, const double *want, int n) {
+
+	double err = 0.0, scale = 1.0;
+	int i;
+
+	for(i = 0; i < n; i++) {
+		scale = fmax(scale, fabs(want[i]));
+	}
+	for(i = 0; i < n; i++) {
+		err = fmax(err, fabs(got[i] - want[i]));
+	}
+	return err / scale;
+
+}
+
+// the float matrix as a 2D affine, for comparing against mat4 references
+static void ref_affine(double *out, const double *m) {
+
+	out[A_00] = m[M_00]; out[A_01] = m[M_01]; out[A_02] = m[M_03];
+	out[A_10] = m[M_10]; out[A_11] = m[M_11]; out[A_12] = m[M_13];
+
+}
+
+static double ref_size(const GLfloat *m, int n) {
+
+	double size = 0.0;
+	int i;
+
+	for(i = 0; i < n; i++) {
+		size = fmax(size, fabs(m[i]));
+	}
+	return size;
+
+}
+
+static void random_matrix(GLfloat *m, int n, unsigned int *seed) {
+
+	int i;
+
+	for(i = 0; i < n; i++) {
+		m[i] = check_random(seed) * 20.0f - 10.0f;
+	}
+
+}
+
+// random rotation, scale in [0.5, 2) and translation, bottom row 0 0 0 1
+static void random_affine(GLfloat *m, unsigned int *seed) {
+
+	mthMat4Identity(m);
+	mthMat4Translate(m, check_random(seed) * 200.0f - 100.0f, check_random(seed) * 200.0f - 100.0f, check_random(seed) * 200.0f - 100.0f);
+	mtxRotateMatrix(m, check_random(seed) * 360.0f, check_random(seed) * 360.0f, check_random(seed) * 360.0f);
+	mthMat4Scale(m, check_random(seed) * 1.5f + 0.5f, check_random(seed) * 1.5f + 0.5f, check_random(seed) * 1.5f + 0.5f);
+
+}
+
+static int check_report(const char *name, double err) {
+
+	int ok = err <= CHECK_TOLERANCE;
+
+	fprintf(stderr, "Check: %-32s max error %.2e  %s\n", name, err, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+
+}
+
+/*
+ * The 4x4 matrix functions one stage's mtx_utils.h has, NULL where it
+ * has none. Stage 05 hands back heap matrices, so it goes through the
+ * two adapters below.
+ */
+
+struct checkStage {
+	const char *name;
+	void (*identity)(GLfloat *m);
+	void (*ortho)(GLfloat *m, GLint width, GLint height);
+	void (*multiply)(GLfloat *a, GLfloat *b);
+	void (*translate)(GLfloat *m, GLfloat x, GLfloat y, GLfloat z);
+	void (*scale)(GLfloat *m, GLfloat x, GLfloat y, GLfloat z);
+	void (*rotate[3])(GLfloat *m, GLfloat angle);
+};
+
+static void s05Identity(GLfloat *m) {
+
+	GLfloat *p = s05CreateIdentity();
+	memcpy(m, p, 16 * sizeof(GLfloat));
+	free(p);
+
+}
+
+static void s05Ortho2d(GLfloat *m, GLint width, GLint height) {
+
+	GLfloat *p = s05CreateOrtho2d(width, height);
+	memcpy(m, p, 16 * sizeof(GLfloat));
+	free(p);
+
+}
+
+static const struct checkStage check_stages[CHECK_STAGES] = {
+	{ "05", s05Identity, s05Ortho2d, NULL, NULL, NULL, { NULL, NULL, NULL } },
+	{ "06", s06ResetIdentity, s06CreateOrtho2d, s06MultiplyMatrix, s06TranslateMatrix, s06ScaleMatrix,
+		{ NULL, NULL, s06RotateZMatrix } },
+	{ "07", s07SetIdentity, s07CreateOrtho2d, s07MultiplyMatrix, s07TranslateMatrix, s07ScaleMatrix,
+		{ s07RotateXMatrix, s07RotateYMatrix, s07RotateZMatrix } },
+	{ "08", s08SetIdentity, s08CreateOrtho2d, s08MultiplyMatrix, s08TranslateMatrix, s08ScaleMatrix,
+		{ s08RotateXMatrix, s08RotateYMatrix, s08RotateZMatrix } },
+	{ "09", s09SetIdentity, s09CreateOrtho2d, s09MultiplyMatrix, s09TranslateMatrix, s09ScaleMatrix,
+		{ s09RotateXMatrix, s09RotateYMatrix, s09RotateZMatrix } },
+	{ "10", s10SetIdentity, s10CreateOrtho2d, s10MultiplyMatrix, s10TranslateMatrix, s10ScaleMatrix,
+		{ s10RotateXMatrix, s10RotateYMatrix, s10RotateZMatrix } },
+	{ "11", mtxSetIdentity, mtxCreateOrtho2d, mtxMultiplyMatrix, mtxTranslateMatrix, mtxScaleMatrix,
+		{ mtxRotateXMatrix, mtxRotateYMatrix, mtxRotateZMatrix } }
+};
+
+static const char *check_stage_names[CHECK_STAGE_KINDS] = {
+	"identity", "ortho 2d", "multiply", "multiply (AB)C = A(BC)", "translate", "scale",
+	"rotate x", "rotate y", "rotate z"
+};
+
+static const char *check_shared_names[CHECK_SHARED] = {
+	"kiMatrixMultiply", "mthMat4Multiply", "kiTranslate", "kiRotateZ (clockwise)", "mtxTransformObject",
+	"mtxTransformObject2d", "kiOrtho2D", "kiMatrixMultiply (AB)C = A(BC)", "mthMat4Multiply (AB)C = A(BC)",
+	"mthAffine2Compose (AB)C = A(BC)", "mthMat4InvertAffine M M^-1 = I", "mthAffine2Invert M M^-1 = I",
+	"mthSinCosDeg", "mthSinCosDegBatch = mthSinCosDeg", "mtxAffine2dBatch"
+};
+
+/*
+ * One trial of everything a stage has against the reference. a, b and c
+ * are random matrices, width is the ortho width out of CHECK_ORTHO_SPAN.
+ */
+
+static void check_stage_trial(const struct checkStage *st, double *err, GLfloat *a, GLfloat *b, GLfloat *c,
+	float x, float y, float z, float angle, unsigned int width) {
+
+	GLfloat got[16], ab[16], bc[16];
+	double ra[16], rb[16], want[16];
+	int i;
+
+	ref_from_float(ra, a, 16);
+	ref_from_float(rb, b, 16);
+
+	memcpy(got, a, sizeof(got));
+	st->identity(got);
+	ref_identity(want);
+	err[CHECK_IDENTITY] = fmax(err[CHECK_IDENTITY], ref_error(got, want, 16));
+
+	st->ortho(got, width, CHECK_ORTHO_SPAN - width);
+	ref_ortho(want, width, CHECK_ORTHO_SPAN - width);
+	err[CHECK_ORTHO] = fmax(err[CHECK_ORTHO], ref_error(got, want, 16));
+
+	if(st->multiply != NULL){
+
+		memcpy(got, a, sizeof(got));
+		st->multiply(got, b);
+		ref_multiply(want, ra, rb);
+		err[CHECK_MULTIPLY] = fmax(err[CHECK_MULTIPLY], ref_error(got, want, 16));
+
+		// (AB)C = A(BC), relative to the size of the product
+		memcpy(ab, a, sizeof(ab));
+		st->multiply(ab, b);
+		st->multiply(ab, c);
+		memcpy(bc, b, sizeof(bc));
+		st->multiply(bc, c);
+		memcpy(got, a, sizeof(got));
+		st->multiply(got, bc);
+		ref_from_float(want, got, 16);
+		err[CHECK_ASSOCIATIVE] = fmax(err[CHECK_ASSOCIATIVE], ref_error(ab, want, 16));
+
+	}
+
+	// helpers that post-multiply in place
+	if(st->translate != NULL){
+		memcpy(got, a, sizeof(got));
+		st->translate(got, x, y, z);
+		memcpy(want, ra, sizeof(want));
+		ref_translate(want, x, y, z);
+		err[CHECK_TRANSLATE] = fmax(err[CHECK_TRANSLATE], ref_error(got, want, 16));
+	}
+
+	if(st->scale != NULL){
+		memcpy(got, a, sizeof(got));
+		st->scale(got, x, y, z);
+		memcpy(want, ra, sizeof(want));
+		ref_scale(want, x, y, z);
+		err[CHECK_SCALE] = fmax(err[CHECK_SCALE], ref_error(got, want, 16));
+	}
+
+	for(i = 0; i < 3; i++) {
+		if(st->rotate[i] == NULL){
+			continue;
+		}
+		memcpy(got, a, sizeof(got));
+		st->rotate[i](got, angle);
+		memcpy(want, ra, sizeof(want));
+		ref_rotate(want, i, angle);
+		err[CHECK_ROTATE + i] = fmax(err[CHECK_ROTATE + i], ref_error(got, want, 16));
+	}
+
+}
+
+// whether st has the function check kind k is about
+static int check_stage_has(const struct checkStage *st, int k) {
+
+	switch(k) {
+		case CHECK_MULTIPLY:
+		case CHECK_ASSOCIATIVE:
+			return st->multiply != NULL;
+		case CHECK_TRANSLATE:
+			return st->translate != NULL;
+		case CHECK_SCALE:
+			return st->scale != NULL;
+		case CHECK_ROTATE:
+		case CHECK_ROTATE + 1:
+		case CHECK_ROTATE + 2:
+			return st->rotate[k - CHECK_ROTATE] != NULL;
+	}
+	return 1;
+
+}
+
+/*
+ * Every stage's matrix functions, then kinectGL.h, mathGL.h and the
+ * stage 11 object transforms, against the double precision reference on
+ * CHECK_TRIALS random inputs, plus the properties optimized paths have
+ * to keep: (AB)C = A(BC), M M^-1 = I and the in-place forms agreeing
+ * with the out-of-place ones. Errors are relative to the largest
+ * element, returns 1 if any exceed CHECK_TOLERANCE.
+ */
+
+int run_check_math() {
+
+	GLfloat a[16], b[16], c[16], ab[16], bc[16], got[16], inv[16];
+	GLfloat fa[6], fb[6], fc[6], fab[6], fbc[6], finv[6];
+	GLfloat xs[CHECK_BATCH], ys[CHECK_BATCH], angles[CHECK_BATCH], scales[CHECK_BATCH];
+	GLfloat batch[CHECK_BATCH * 6], sines[4], cosines[4];
+	double ra[16], rb[16], want[16], wa[6];
+	double stage_err[CHECK_STAGES][CHECK_STAGE_KINDS], err[CHECK_SHARED];
+	char label[64];
+	struct mtxObject obj;
+	unsigned int seed = 0x9e3779b9, trial, i, k, width, checks = 0, failed = 0;
+	float x, y, z, angle;
+
+	memset(stage_err, 0, sizeof(stage_err));
+	memset(err, 0, sizeof(err));
+
+	for(trial = 0; trial < CHECK_TRIALS; trial++) {
+
+		random_matrix(a, 16, &seed);
+		random_matrix(b, 16, &seed);
+		random_matrix(c, 16, &seed);
+		ref_from_float(ra, a, 16);
+		ref_from_float(rb, b, 16);
+		x = check_random(&seed) * 200.0f - 100.0f;
+		y = check_random(&seed) * 200.0f - 100.0f;
+		z = check_random(&seed) * 200.0f - 100.0f;
+		angle = check_random(&seed) * 1440.0f - 720.0f;
+		width = 1 + (unsigned int)(check_random(&seed) * (CHECK_ORTHO_SPAN - 1));
+
+		for(i = 0; i < CHECK_STAGES; i++) {
+			check_stage_trial(&check_stages[i], stage_err[i], a, b, c, x, y, z, angle, width);
+		}
+
+		// products
+		ref_multiply(want, ra, rb);
+		memcpy(got, a, sizeof(got));
+		kiMatrixMultiply(got, b);
+		err[0] = fmax(err[0], ref_error(got, want, 16));
+
+		mthMat4Multiply(got, a, b);
+		err[1] = fmax(err[1], ref_error(got, want, 16));
+		memcpy(got, b, sizeof(got));
+		mthMat4Multiply(got, a, got);
+		err[1] = fmax(err[1], ref_error(got, want, 16));
+
+		memcpy(got, a, sizeof(got));
+		kiTranslate(got, x, y, z);
+		memcpy(want, ra, sizeof(want));
+		ref_translate(want, x, y, z);
+		err[2] = fmax(err[2], ref_error(got, want, 16));
+
+		// kiRotateZ turns the other way from mtxRotateZMatrix
+		memcpy(got, a, sizeof(got));
+		kiRotateZ(got, angle);
+		memcpy(want, ra, sizeof(want));
+		ref_rotate(want, 2, -angle);
+		err[3] = fmax(err[3], ref_error(got, want, 16));
+
+		// x and y left at zero every other trial to cover the skipped axes
+		memset(&obj, 0, sizeof(obj));
+		obj.pos[0] = x; obj.pos[1] = y; obj.pos[2] = z;
+		obj.rot[0] = trial & 1 ? angle * 0.5f : 0.0f;
+		obj.rot[1] = trial & 1 ? angle * 0.25f : 0.0f;
+		obj.rot[2] = angle;
+		obj.scl[0] = a[0]; obj.scl[1] = a[1]; obj.scl[2] = a[2];
+		mtxTransformObject(&obj);
+		ref_identity(want);
+		ref_translate(want, x, y, z);
+		ref_rotate(want, 0, obj.rot[0]);
+		ref_rotate(want, 1, obj.rot[1]);
+		ref_rotate(want, 2, obj.rot[2]);
+		ref_scale(want, obj.scl[0], obj.scl[1], obj.scl[2]);
+		err[4] = fmax(err[4], ref_error(obj.matrix, want, 16));
+
+		// 2D affine forms of the same thing
+		obj.rot[0] = obj.rot[1] = 0.0f;
+		mtxTransformObject2d(&obj, fa);
+		ref_identity(want);
+		ref_translate(want, x, y, 0.0);
+		ref_rotate(want, 2, angle);
+		ref_scale(want, obj.scl[0], obj.scl[1], 1.0);
+		ref_affine(wa, want);
+		err[5] = fmax(err[5], ref_error(fa, wa, 6));
+
+		// projection
+		kiOrtho2D(got, 0.0f, (GLfloat)width, 0.0f, (GLfloat)(CHECK_ORTHO_SPAN - width));
+		ref_ortho(want, width, CHECK_ORTHO_SPAN - width);
+		err[6] = fmax(err[6], ref_error(got, want, 16));
+
+		// (AB)C = A(BC), relative to the size of the product
+		memcpy(ab, a, sizeof(ab));
+		kiMatrixMultiply(ab, b);
+		kiMatrixMultiply(ab, c);
+		memcpy(bc, b, sizeof(bc));
+		kiMatrixMultiply(bc, c);
+		memcpy(got, a, sizeof(got));
+		kiMatrixMultiply(got, bc);
+		ref_from_float(want, got, 16);
+		err[7] = fmax(err[7], ref_error(ab, want, 16));
+
+		mthMat4Multiply(ab, a, b);
+		mthMat4Multiply(ab, ab, c);
+		mthMat4Multiply(bc, b, c);
+		mthMat4Multiply(got, a, bc);
+		ref_from_float(want, got, 16);
+		err[8] = fmax(err[8], ref_error(ab, want, 16));
+
+		random_matrix(fb, 6, &seed);
+		random_matrix(fc, 6, &seed);
+		mthAffine2Compose(fab, fa, fb);
+		mthAffine2Compose(fab, fab, fc);
+		mthAffine2Compose(fbc, fb, fc);
+		mthAffine2Compose(got, fa, fbc);
+		ref_from_float(wa, got, 6);
+		err[9] = fmax(err[9], ref_error(fab, wa, 6));
+
+		// M M^-1 = M^-1 M = I, scaled by the condition of M since that is
+		// what float rounding in the inverse can promise
+		random_affine(b, &seed);
+		if(mthMat4InvertAffine(inv, b) == 0){
+			double cond = ref_size(b, 16) * ref_size(inv, 16);
+			ref_identity(want);
+			mthMat4Multiply(got, b, inv);
+			err[10] = fmax(err[10], ref_error(got, want, 16) / cond);
+			mthMat4Multiply(got, inv, b);
+			err[10] = fmax(err[10], ref_error(got, want, 16) / cond);
+		}
+
+		if(mthAffine2Invert(finv, fa) == 0){
+			double cond = ref_size(fa, 6) * ref_size(finv, 6);
+			mthAffine2Identity(fb);
+			ref_from_float(wa, fb, 6);
+			mthAffine2Compose(fab, fa, finv);
+			err[11] = fmax(err[11], ref_error(fab, wa, 6) / cond);
+			mthAffine2Compose(fab, finv, fa);
+			err[11] = fmax(err[11], ref_error(fab, wa, 6) / cond);
+		}
+
+		// sincos, scalar and batch must match bit for bit
+		for(i = 0; i < 4; i++) {
+			angles[i] = angle + i * 33.3f;
+		}
+		mthSinCosDegBatch(angles, sines, cosines, 4);
+		for(i = 0; i < 4; i++) {
+			float sv, cv;
+			double r = angles[i] * (M_PI / 180.0);
+			mthSinCosDeg(angles[i], &sv, &cv);
+			err[12] = fmax(err[12], fmax(fabs(sv - sin(r)), fabs(cv - cos(r))));
+			err[13] = fmax(err[13], sv != sines[i] || cv != cosines[i] ? 1.0 : 0.0);
+		}
+
+	}
+
+	// batch of rock transforms against one at a time
+	for(i = 0; i < CHECK_BATCH; i++) {
+		xs[i] = check_random(&seed) * 800.0f;
+		ys[i] = check_random(&seed) * 480.0f;
+		angles[i] = check_random(&seed) * 360.0f;
+		scales[i] = check_random(&seed) * 40.0f + 10.0f;
+	}
+	mtxAffine2dBatch(batch, xs, ys, angles, scales, CHECK_BATCH);
+	for(i = 0; i < CHECK_BATCH; i++) {
+		ref_identity(want);
+		ref_translate(want, xs[i], ys[i], 0.0);
+		ref_rotate(want, 2, angles[i]);
+		ref_scale(want, scales[i], scales[i], 1.0);
+		ref_affine(wa, want);
+		err[14] = fmax(err[14], ref_error(&batch[i * 6], wa, 6));
+	}
+
+	for(i = 0; i < CHECK_STAGES; i++) {
+		for(k = 0; k < CHECK_STAGE_KINDS; k++) {
+			if(!check_stage_has(&check_stages[i], k)){
+				continue;
+			}
+			snprintf(label, sizeof(label), "%s %s", check_stages[i].name, check_stage_names[k]);
+			failed += check_report(label, stage_err[i][k]);
+			checks++;
+		}
+	}
+
+	for(k = 0; k < CHECK_SHARED; k++) {
+		failed += check_report(check_shared_names[k], err[k]);
+		checks++;
+	}
+
+	fprintf(stderr, "Check: %u trials, %u of %u checks failed\n", CHECK_TRIALS, failed, checks);
+	return failed ? 1 : 0;
+
+}
+
+int main(int argc, char *argv[]) {
+
+	if(argc > 1 && strcmp(argv[1], "--bench") == 0){
+		return run_math_bench();
+	}
+
+	return run_check_math();
+
+}
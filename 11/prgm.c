@@ -1,58 +1,428 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
 #include <GL/glew.h>
 #include <GL/freeglut.h>
+#include "libs/alloc_utils.h"
 #include "libs/mtx_utils.h"
 #include "libs/gamepad_utils.h"
+#include "libs/replay_utils.h"
+#include "libs/arena_utils.h"
+#include "libs/pool_utils.h"
+#include "libs/rock_utils.h"
+#include "libs/job_utils.h"
+#include "libs/pipe_utils.h"
+#include "libs/raster_utils.h"
+#include "libs/offscreen_utils.h"
+#include "libs/capture_utils.h"
+#include "libs/line_utils.h"
+#include "libs/bloom_utils.h"
+#include "libs/particle_utils.h"
+#include "libs/text_utils.h"
+#include "libs/net_utils.h"
+#include "libs/snap_utils.h"
+#include "libs/session_utils.h"
+#include "../lib/kinectGL.h"
+#include "../lib/kinectFrames.h"
+#include "../lib/kinectGesture.h"
 
 int init_resources();
 int free_resources();
 
+void init_game();
+void init_geometry();
+void update_game(unsigned int input);
+void update_player(struct mtxObject *player, unsigned int *fire_cooldown, unsigned int input);
+void update_net_game(const unsigned int *inputs);
+void update_bullets();
+void update_rocks();
+void spawn_wave();
+unsigned int save_game(unsigned char *buf);
+void load_game(const unsigned char *buf);
+unsigned int game_random();
+double get_time_ms();
+
+struct renderFrame;
+
+void create_frame(struct renderFrame *frame, unsigned int max_rocks);
+void destroy_frame(struct renderFrame *frame);
+void step_frame(unsigned int input, struct renderFrame *frame);
+void build_transforms(struct renderFrame *frame);
+void draw_triangles(const GLfloat *models, unsigned int count);
+void draw_frame(struct renderFrame *frame);
+void draw_hud(struct renderFrame *frame);
+void emit_particles(struct renderFrame *frame);
+void raster_frame(struct rstContext *ctx, struct renderFrame *frame);
+unsigned int append_ghosts(GLfloat *instances, unsigned int count, const GLfloat *model, float x, float y, float radius);
+void* sim_thread_main(void *arg);
+int run_headless(unsigned int num_frames);
+unsigned int headless_input(unsigned int tick);
+int run_stress(unsigned int max_rocks);
+int run_job_bench(unsigned int max_threads);
+int run_bench(const char *filename);
+void apply_view(const struct netView *view);
+int run_server(int port, long num_ticks);
+int run_net_test(unsigned int num_clients);
+int run_snapshot_bench();
+int run_raster(unsigned int num_frames, const char *capture_file, const char *golden_file);
+int run_offscreen(unsigned int num_frames, const char *capture_file);
+unsigned int poll_gesture();
+int init_glew();
+
 void on_display();
 void on_timer(int value);
+void on_close();
+void capture_frame();
 
 GLuint vbo_triangle;
 GLuint program;
 GLint attribute_coord2d;
 GLint uniform_matrixOrtho2d;
-GLint uniform_matrixModel;
+GLint attribute_instance;
+GLint uniform_modelRows;
+GLuint line_program;
+GLuint text_program;
+GLfloat matrixOrtho2d[16];
 
 #define VIEWPORT_WIDTH 800
 #define VIEWPORT_HEIGHT 480
+#define FRAME_ARENA_SIZE (4 * 1024 * 1024)
+
+#define MAX_BULLETS 64
+#define BULLET_SPEED 10.0
+#define BULLET_TTL 40
+#define BULLET_COOLDOWN 6
+
+#define MAX_ROCKS 1024
+#define ROCK_VERTICES 10
+#define STRESS_TICKS 120
+#define BENCH_ROCKS 100000
+#define ROCK_GRAIN 256
+#define BENCH_WARMUP 3
+#define BENCH_REPS 15
+#define BENCH_SIM_TICKS 300
+#define BULLET_GRAIN 8
+#define PLAYER_SCALE 2.0
+#define MAX_PLAYERS 4
+
+// per object 2D affine transform, and how many go up per draw call
+// (the modelRows array in shdr/vertex.glsl holds two rows each)
+#define MODEL_FLOATS 6
+#define MODEL_BATCH 32
+
+#define RASTER_MAX_PRIMS (2 * (4 + MAX_BULLETS + MAX_ROCKS * 4 * ROCK_VERTICES))
+
+#define CAPTURE_FPS 33
+#define LINE_WIDTH 1.5
+#define MAX_SEGMENTS (MAX_ROCKS * 4 * ROCK_VERTICES)
+#define BLOOM_LEVELS 3
+#define BLOOM_THRESHOLD 0.5
+#define BLOOM_INTENSITY 1.5
+
+#define MAX_BURSTS 64
+#define PARTICLE_CAPACITY 65536
+#define PARTICLE_DRAG 0.96
+#define BURST_PARTICLES 1000
+#define THRUST_PARTICLES 64
+
+#define HUD_SIZE 14.0
+#define HUD_MARGIN 12.0
+#define HUD_STATS_FRAMES 30
+
+#define NET_DEFAULT_PORT 27960
+#define NET_STATS_MS 5000.0
+#define NET_SLOT_BULLETS MAX_PLAYERS
+#define NET_SLOT_ROCKS (MAX_PLAYERS + MAX_BULLETS)
+#define NET_ENTITIES (NET_SLOT_ROCKS + MAX_ROCKS)
+#define NET_RELEVANCE_RADIUS 200.0
+#define NET_SHIP_WEIGHT 64.0
+#define NET_BULLET_WEIGHT 4.0
+#define NET_HISTORY 256
+#define NET_TEST_TICKS 600
+#define SNAP_BENCH_TICKS 300
+#define SNAP_BENCH_RTT 6
+#define SNAP_BENCH_LOSS 0.05
+
+#define REPLAY_NONE 0
+#define REPLAY_RECORD 1
+#define REPLAY_PLAYBACK 2
+
+struct gameState {
+	struct mtxObject player;
+	unsigned int rng;
+	unsigned int score;
+	unsigned int tick;
+	unsigned int fire_cooldown;
+	unsigned int wave;
+};
+
+struct bullet {
+	struct mtxObject obj;
+	GLfloat vel[2];
+	unsigned int ttl;
+};
+
+#define ROCK_STATE_SIZE (7 * sizeof(float) + 1)
+#define GAME_STATE_MAX_SIZE (sizeof(struct gameState) + 2 * sizeof(unsigned int) + \
+	MAX_BULLETS * sizeof(struct bullet) + MAX_ROCKS * ROCK_STATE_SIZE)
+
+/*
+ * Everything on_display needs to draw one frame, copied out of the game
+ * state so the sim can move on while the frame is being submitted.
+ */
 
-struct mtxObject player;
+struct renderFrame {
+	unsigned int tick;
+	unsigned int score;
+	unsigned int wave;
+	unsigned int num_players;
+	GLfloat players[MAX_PLAYERS * 4 * MODEL_FLOATS];
+	unsigned int num_bullets;
+	GLfloat bullets[MAX_BULLETS * MODEL_FLOATS];
+	unsigned int num_rocks;
+	GLfloat *rocks;
+	unsigned int num_ghosts;
+	unsigned int thrust;
+	unsigned int num_bursts;
+	GLfloat bursts[MAX_BURSTS * 3];
+};
+
+struct collideJob {
+	struct rckGrid *grid;
+	unsigned int *cells;
+	int *bullet_hit;
+};
+
+GLfloat triangle_vertices[6];
+GLfloat player_radius;
+GLfloat rock_vertices[ROCK_VERTICES * 2];
+
+struct gameState game;
+struct plPool bullets;
+struct rckField rocks;
+struct rplFile replay;
+struct arnArena frame_arena;
+int replay_mode = REPLAY_NONE;
+
+struct renderFrame frames[3];
+struct ppTriple frame_exchange;
+int pipelined = 1;
+pthread_t sim_thread;
+sem_t sim_go;
+volatile int sim_quit = 0;
+unsigned int sim_input;
+double sim_ms = 0.0, render_ms = 0.0;
+unsigned long ghost_total = 0;
+unsigned int sim_frames = 0, render_frames = 0;
+
+struct capRing capture;
+const char *dump_file = NULL;
+int capturing = 0;
+double capture_ms = 0.0;
+
+struct lnBatch lines;
+double line_ms = 0.0;
+
+struct txtBatch hud;
+char hud_stats[TXT_MAX_LEN];
+
+struct blmChain bloom;
+int bloom_levels = BLOOM_LEVELS;
+
+struct ptlSystem particles;
+int particle_backend = -1;
+int particles_on = 0;
+unsigned int particle_tick = 0;
+unsigned int fx_rng = 0x9e3779b9;
+
+// body steering from a depth recording (--kinect)
+struct kiSource depth_source;
+struct kiGesture gesture;
+int kinect_on = 0;
+
+struct netLink net_link;
+int net_client_on = 0;
+
+// effects raised by the sim this tick, not part of the game state
+unsigned int num_bursts = 0;
+GLfloat bursts[MAX_BURSTS * 3];
+unsigned int thrust = 0;
+
+// ships for network clients 1 and up, client 0 flies game.player
+struct mtxObject net_players[MAX_PLAYERS];
+unsigned int net_cooldown[MAX_PLAYERS];
+int net_active[MAX_PLAYERS];
+double net_latency = 0.0;
+double net_jitter = 0.0;
+float net_loss = 0.0f;
 
 int main( int argc, char *argv[] ) {
 
+	int i;
+	long seek_tick = -1;
+	long headless_frames = -1;
+	long stress_rocks = -1;
+	long stress_threads = 1;
+	long bench_threads = -1;
+	const char *bench_file = NULL;
+	long raster_frames = -1;
+	long offscreen_frames = -1;
+	const char *record_file = NULL;
+	const char *replay_file = NULL;
+	const char *capture_file = NULL;
+	const char *golden_file = NULL;
+	const char *kinect_file = NULL;
+	const char *client_host = NULL;
+	long server_port = -1;
+	long net_clients = -1;
+	int snapshot_bench = 0;
+
+	for(i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--record") == 0 && i + 1 < argc){
+			record_file = argv[++i];
+		} else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc){
+			replay_file = argv[++i];
+		} else if(strcmp(argv[i], "--seek") == 0 && i + 1 < argc){
+			seek_tick = atol(argv[++i]);
+		} else if(strcmp(argv[i], "--headless") == 0 && i + 1 < argc){
+			headless_frames = atol(argv[++i]);
+		} else if(strcmp(argv[i], "--stress") == 0 && i + 1 < argc){
+			stress_rocks = atol(argv[++i]);
+		} else if(strcmp(argv[i], "--stress-threads") == 0 && i + 1 < argc){
+			stress_threads = atol(argv[++i]);
+		} else if(strcmp(argv[i], "--bench-jobs") == 0 && i + 1 < argc){
+			bench_threads = atol(argv[++i]);
+		} else if(strcmp(argv[i], "--bench") == 0 && i + 1 < argc){
+			bench_file = argv[++i];
+		} else if(strcmp(argv[i], "--raster") == 0 && i + 1 < argc){
+			raster_frames = atol(argv[++i]);
+		} else if(strcmp(argv[i], "--offscreen") == 0 && i + 1 < argc){
+			offscreen_frames = atol(argv[++i]);
+		} else if(strcmp(argv[i], "--capture") == 0 && i + 1 < argc){
+			capture_file = argv[++i];
+		} else if(strcmp(argv[i], "--bloom") == 0 && i + 1 < argc){
+			bloom_levels = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--particles") == 0 && i + 1 < argc){
+			i++;
+			particle_backend = strcmp(argv[i], "off") == 0 ? -2 : (strcmp(argv[i], "tf") == 0 ? PTL_FEEDBACK :
+				(strcmp(argv[i], "tex") == 0 ? PTL_TEXTURE : PTL_CPU));
+		} else if(strcmp(argv[i], "--dump") == 0 && i + 1 < argc){
+			dump_file = argv[++i];
+		} else if(strcmp(argv[i], "--golden") == 0 && i + 1 < argc){
+			golden_file = argv[++i];
+		} else if(strcmp(argv[i], "--kinect") == 0 && i + 1 < argc){
+			kinect_file = argv[++i];
+		} else if(strcmp(argv[i], "--serial") == 0){
+			pipelined = 0;
+		} else if(strcmp(argv[i], "--server") == 0 && i + 1 < argc){
+			server_port = atol(argv[++i]);
+		} else if(strcmp(argv[i], "--client") == 0 && i + 1 < argc){
+			client_host = argv[++i];
+		} else if(strcmp(argv[i], "--snapshot-bench") == 0){
+			snapshot_bench = 1;
+		} else if(strcmp(argv[i], "--net-test") == 0 && i + 1 < argc){
+			net_clients = atol(argv[++i]);
+		} else if(strcmp(argv[i], "--latency") == 0 && i + 1 < argc){
+			net_latency = atof(argv[++i]);
+		} else if(strcmp(argv[i], "--jitter") == 0 && i + 1 < argc){
+			net_jitter = atof(argv[++i]);
+		} else if(strcmp(argv[i], "--loss") == 0 && i + 1 < argc){
+			net_loss = atof(argv[++i]) / 100.0f;
+		}
+	}
+
+	init_game();
+
+	if(record_file != NULL){
+		if(rplCreate(&replay, record_file, GAME_STATE_MAX_SIZE) < 0){
+			return 1;
+		}
+		replay_mode = REPLAY_RECORD;
+	} else if(replay_file != NULL){
+		if(rplOpen(&replay, replay_file) < 0){
+			return 1;
+		}
+		replay_mode = REPLAY_PLAYBACK;
+	}
+
+	if(replay_mode == REPLAY_PLAYBACK && seek_tick >= 0){
+	
+		unsigned int input;
+		unsigned char *state = (unsigned char*)malloc(GAME_STATE_MAX_SIZE);
+		double start = get_time_ms();
+		int key_tick = rplSeek(&replay, (unsigned int)seek_tick, state, GAME_STATE_MAX_SIZE);
+		if(key_tick < 0){
+			fprintf(stderr, "Could not seek to tick %ld\n", seek_tick);
+			return 1;
+		}
+		load_game(state);
+		free(state);
+
+		while(game.tick < (unsigned int)seek_tick && rplReadInput(&replay, &input)) {
+			update_game(input);
+		}
+
+		fprintf(stderr, "Seek to tick %u: keyframe %d + %u ticks simulated in %.3f ms\n",
+			game.tick, key_tick, game.tick - key_tick, get_time_ms() - start);
+	
+	}
+
+	if(bench_threads > 0){
+		return run_job_bench((unsigned int)bench_threads);
+	}
+
+	if(bench_file != NULL){
+		return run_bench(bench_file);
+	}
+
+	// single threaded unless --stress-threads asks for more, so the
+	// numbers mean the same thing on every machine
+	if(stress_rocks > 0){
+		jobCreate(stress_threads > 1 ? (unsigned int)stress_threads - 1 : 0);
+		return run_stress((unsigned int)stress_rocks);
+	}
+
+	jobCreate(jobDefaultWorkers());
+
+	if(raster_frames >= 0){
+		return run_raster((unsigned int)raster_frames, capture_file, golden_file);
+	}
+
+	if(offscreen_frames >= 0){
+		return run_offscreen((unsigned int)offscreen_frames, capture_file);
+	}
+
+	if(server_port >= 0){
+		return run_server((int)server_port, headless_frames);
+	}
+
+	if(net_clients > 0){
+		return run_net_test((unsigned int)net_clients);
+	}
+
+	if(snapshot_bench){
+		return run_snapshot_bench();
+	}
+
+	if(headless_frames >= 0){
+		return run_headless((unsigned int)headless_frames);
+	}
+
 	glutInit(&argc, argv);
 	glutInitContextVersion(2, 0);
 	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE);
 	glutInitWindowSize(800, 480);
 	glutCreateWindow("Main Window");
 	glutFullScreen();
-	
-	
-	player.pos[0] = 400.0;
-	player.pos[1] = 100.0;
-	player.pos[2] = 0.0;
-	
-	player.rot[0] = 0.0;
-	player.rot[1] = 0.0;
-	player.rot[2] = 0.0;
-	
-	player.scl[0] = 2.0;
-	player.scl[1] = 2.0;
-	player.scl[2] = 2.0;
+	glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
 
-	GLenum glew_status = glewInit();
-	if(glew_status != GLEW_OK) {
-		fprintf(stderr, "Error: %s\n", glewGetErrorString(glew_status));
-		return 1;
-	}
-
-	if(!GLEW_VERSION_2_0) {
-		fprintf(stderr, "Your gpu does not support OpenGL 2.0\n");
+	if(init_glew() < 0){
 		return 1;
 	}
 
@@ -61,9 +431,43 @@ int main( int argc, char *argv[] ) {
 		return 1;
 	}
 
+	if(kinect_file != NULL){
+		if(kiSourceOpenFile(&depth_source, kinect_file, 1) < 0){
+			return 1;
+		}
+		kiGestureCreate(&gesture, depth_source.width, depth_source.height);
+		kiSourceStart(&depth_source, 1);
+		kinect_on = 1;
+	}
+
+	if(client_host != NULL){
+		// host:port, the port defaults to NET_DEFAULT_PORT
+		char host[256];
+		const char *colon = strrchr(client_host, ':');
+		int port = colon != NULL ? atoi(colon + 1) : NET_DEFAULT_PORT;
+		size_t len = colon != NULL ? (size_t)(colon - client_host) : strlen(client_host);
+		snprintf(host, sizeof(host), "%.*s", (int)len, client_host);
+		if(netLinkOpen(&net_link, host, port, NET_ENTITIES) < 0){
+			return 1;
+		}
+		netSetConditions(&net_link.sock, net_latency, net_jitter, net_loss, 2);
+		// the server owns the sim, there is nothing to pipeline
+		net_client_on = 1;
+		pipelined = 0;
+	}
+
+	if(pipelined){
+		ppInit(&frame_exchange);
+		sem_init(&sim_go, 0, 1);
+		pthread_create(&sim_thread, NULL, sim_thread_main, NULL);
+	}
+
 	glutDisplayFunc(on_display);
+	glutCloseFunc(on_close);
 	glutTimerFunc(0, on_timer, 0);
-	glutJoystickFunc(gamepad_callback, 25);
+	if(replay_mode != REPLAY_PLAYBACK){
+		glutJoystickFunc(gamepad_callback, 25);
+	}
 	glutMainLoop();
 
 	free_resources();
@@ -71,92 +475,1952 @@ int main( int argc, char *argv[] ) {
 
 }
 
+int init_glew() {
+
+	GLenum glew_status = glewInit();
+
+	#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	// GLX builds of GLEW complain under an EGL context but still load GL
+	if(glew_status == GLEW_ERROR_NO_GLX_DISPLAY){
+		glew_status = GLEW_OK;
+	}
+	#endif
+
+	if(glew_status != GLEW_OK) {
+		fprintf(stderr, "Error: %s\n", glewGetErrorString(glew_status));
+		return -1;
+	}
+
+	if(!GLEW_VERSION_2_0) {
+		fprintf(stderr, "Your gpu does not support OpenGL 2.0\n");
+		return -1;
+	}
+
+	return 0;
+
+}
+
 int init_resources( ) {
-	
-	GLfloat triangle_vertices[] = {
-		0.0, 10.0, -10.0, -10.0, 10.0, -10.0
-	};
+
+	GLfloat batch_vertices[MODEL_BATCH * 3 * 3];
+	int i, k;
+
+	// one ship triangle per batch slot, tagged with its slot for modelRows
+	for(i = 0; i < MODEL_BATCH; i++) {
+		for(k = 0; k < 3; k++) {
+			batch_vertices[(i * 3 + k) * 3 + 0] = triangle_vertices[k * 2 + 0];
+			batch_vertices[(i * 3 + k) * 3 + 1] = triangle_vertices[k * 2 + 1];
+			batch_vertices[(i * 3 + k) * 3 + 2] = (GLfloat)i;
+		}
+	}
+
 	glGenBuffers(1, &vbo_triangle);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo_triangle);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(triangle_vertices), triangle_vertices, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(batch_vertices), batch_vertices, GL_STATIC_DRAW);
 
 	glClearColor(0.0, 0.0, 0.0, 1.0);
 	program = mtxCreateProgram("shdr/vertex.glsl", "shdr/fragment.glsl");	
 
 	attribute_coord2d = mtxGetShaderAttribute(program, "coord2d");
 	uniform_matrixOrtho2d = mtxGetShaderUniform(program, "matrixOrtho2d");
-	uniform_matrixModel = mtxGetShaderUniform(program, "matrixModel");
+	attribute_instance = mtxGetShaderAttribute(program, "instance");
+	uniform_modelRows = mtxGetShaderUniform(program, "modelRows");
 
 	glUseProgram(program);
-	GLfloat *matrixOrtho2d = (GLfloat*)malloc(16 * sizeof(GLfloat));
 	
 	mtxSetIdentity(matrixOrtho2d);
 	mtxCreateOrtho2d(matrixOrtho2d, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
 	glUniformMatrix4fv(uniform_matrixOrtho2d, 1, GL_FALSE, matrixOrtho2d);
 
+	line_program = mtxCreateProgram("shdr/line_vertex.glsl", "shdr/line_fragment.glsl");
+	lnCreate(&lines, line_program, MAX_SEGMENTS, LINE_WIDTH);
+
+	text_program = mtxCreateProgram("shdr/text_vertex.glsl", "shdr/text_fragment.glsl");
+	txtCreate(&hud, text_program);
+
+	if(bloom_levels > 0){
+		blmCreate(&bloom, bloom_levels, BLOOM_THRESHOLD, BLOOM_INTENSITY);
+	}
+
+	if(particle_backend != -2){
+		ptlInitGL(&particles, particle_backend >= 0 ? particle_backend : ptlBestBackend());
+		particles_on = 1;
+	}
+
 	return 0;
 
 }
 
+void init_game() {
 
-void on_display() {
+	int i;
 
-	glClear(GL_COLOR_BUFFER_BIT);
-		
-	if(GAMEPAD_LEFT){
-		player.pos[0] -= 6.0;
+	plCreate(&bullets, sizeof(struct bullet), MAX_BULLETS);
+	rckCreate(&rocks, MAX_ROCKS);
+	arnCreate(&frame_arena, FRAME_ARENA_SIZE);
+	ptlCreate(&particles, PARTICLE_CAPACITY, PARTICLE_DRAG);
+	for(i = 0; i < 3; i++){
+		create_frame(&frames[i], MAX_ROCKS);
+	}
+
+	init_geometry();
+
+	memset(&game, 0, sizeof(struct gameState));
+	game.rng = 0x2545f491;
+
+	game.player.pos[0] = 400.0;
+	game.player.pos[1] = 100.0;
+	game.player.pos[2] = 0.0;
+	
+	game.player.rot[0] = 0.0;
+	game.player.rot[1] = 0.0;
+	game.player.rot[2] = 0.0;
+	
+	game.player.scl[0] = PLAYER_SCALE;
+	game.player.scl[1] = PLAYER_SCALE;
+	game.player.scl[2] = PLAYER_SCALE;
+
+}
+
+/*
+ * Model space vertices shared by the GL buffers and the software
+ * rasterizer.
+ */
+
+void init_geometry() {
+
+	int i;
+
+	const GLfloat triangle[6] = {
+		0.0, 10.0, -10.0, -10.0, 10.0, -10.0
+	};
+	memcpy(triangle_vertices, triangle, sizeof(triangle));
+
+	// furthest corner of the ship as drawn, for wrap ghosts
+	player_radius = 0.0;
+	for(i = 0; i < 3; i++) {
+		GLfloat r = PLAYER_SCALE * sqrtf(triangle[i * 2 + 0] * triangle[i * 2 + 0] + triangle[i * 2 + 1] * triangle[i * 2 + 1]);
+		player_radius = r > player_radius ? r : player_radius;
+	}
+
+	// Unit radius outline with a few dents so rocks don't look like circles
+	const GLfloat rock_dents[ROCK_VERTICES] = {
+		1.0, 0.8, 1.0, 0.9, 0.7, 1.0, 0.85, 1.0, 0.75, 0.95
+	};
+	for(i = 0; i < ROCK_VERTICES; i++) {
+		GLfloat angle = i * 2.0 * M_PI / ROCK_VERTICES;
+		rock_vertices[i * 2 + 0] = cos(angle) * rock_dents[i];
+		rock_vertices[i * 2 + 1] = sin(angle) * rock_dents[i];
 	}
 
-	if(GAMEPAD_RIGHT){
-		player.pos[0] += 6.0;
+}
+
+/*
+ * Advance the simulation one tick from a packed gamepad mask. Must only
+ * depend on game and input so replays stay deterministic.
+ */
+
+void update_game(unsigned int input) {
+
+	num_bursts = 0;
+	thrust = input & (GAMEPAD_LEFT_MASK | GAMEPAD_RIGHT_MASK | GAMEPAD_UP_MASK | GAMEPAD_DOWN_MASK);
+
+	update_player(&game.player, &game.fire_cooldown, input);
+
+	update_bullets();
+	update_rocks();
+	game.tick++;
+
+}
+
+/*
+ * Move, turn and fire one ship from its input mask. Fired bullets go in
+ * the shared pool.
+ */
+
+void update_player(struct mtxObject *player, unsigned int *fire_cooldown, unsigned int input) {
+
+	if(input & GAMEPAD_LEFT_MASK){
+		player->pos[0] -= 6.0;
 	}
 
-	if(GAMEPAD_UP){
-		player.pos[1] += 6.0;
+	if(input & GAMEPAD_RIGHT_MASK){
+		player->pos[0] += 6.0;
 	}
 
-	if(GAMEPAD_DOWN) {
-		player.pos[1] -= 6.0;
+	if(input & GAMEPAD_UP_MASK){
+		player->pos[1] += 6.0;
 	}
 
-	if(GAMEPAD_BUTTON_L) {
-		player.rot[2] += 4.0;
+	if(input & GAMEPAD_DOWN_MASK) {
+		player->pos[1] -= 6.0;
 	}
 
-	if(GAMEPAD_BUTTON_R) {
-		player.rot[2] -= 4.0;
+	player->pos[0] += player->pos[0] < 0.0 ? VIEWPORT_WIDTH : 0.0;
+	player->pos[0] -= player->pos[0] >= VIEWPORT_WIDTH ? VIEWPORT_WIDTH : 0.0;
+	player->pos[1] += player->pos[1] < 0.0 ? VIEWPORT_HEIGHT : 0.0;
+	player->pos[1] -= player->pos[1] >= VIEWPORT_HEIGHT ? VIEWPORT_HEIGHT : 0.0;
+
+	if(input & GAMEPAD_BUTTON_L_MASK) {
+		player->rot[2] += 4.0;
 	}
-	
-	
-	mtxTransformObject(&player);
-	glUniformMatrix4fv(uniform_matrixModel, 1, GL_FALSE, player.matrix);
-	
 
-	glEnableVertexAttribArray(attribute_coord2d);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_triangle);
-	glVertexAttribPointer(
-		attribute_coord2d,
-		2,
-		GL_FLOAT,
-		GL_FALSE,
-		0,
-		0
-	);
-	glDrawArrays(GL_TRIANGLES, 0, 3);
-	glDisableVertexAttribArray(attribute_coord2d);
+	if(input & GAMEPAD_BUTTON_R_MASK) {
+		player->rot[2] -= 4.0;
+	}
 
-	glutSwapBuffers();
+	if(*fire_cooldown > 0){
+		(*fire_cooldown)--;
+	}
+
+	if((input & GAMEPAD_BUTTON_A_MASK) && *fire_cooldown == 0) {
+
+		struct bullet *b = (struct bullet*)plAcquire(&bullets, NULL);
+		if(b != NULL){
+			GLfloat radians = player->rot[2] / 180 * M_PI;
+			GLfloat dx = -sin(radians);
+			GLfloat dy = cos(radians);
+
+			b->obj.pos[0] = player->pos[0] + dx * 10.0 * player->scl[1];
+			b->obj.pos[1] = player->pos[1] + dy * 10.0 * player->scl[1];
+			b->obj.pos[2] = 0.0;
+			b->obj.rot[0] = 0.0;
+			b->obj.rot[1] = 0.0;
+			b->obj.rot[2] = player->rot[2];
+			b->obj.scl[0] = 0.3;
+			b->obj.scl[1] = 0.3;
+			b->obj.scl[2] = 0.3;
+			b->vel[0] = dx * BULLET_SPEED;
+			b->vel[1] = dy * BULLET_SPEED;
+			b->ttl = BULLET_TTL;
+			*fire_cooldown = BULLET_COOLDOWN;
+		}
+
+	}
 
 }
 
-void on_timer(int value) {
-	
-	glutPostRedisplay();
-	glutTimerFunc(30, on_timer, 0);
+/*
+ * One server tick with an input per client slot. The extra ships move
+ * before update_game so a single player game runs exactly as before.
+ */
+
+void update_net_game(const unsigned int *inputs) {
+
+	unsigned int c;
+
+	for(c = 1; c < MAX_PLAYERS; c++) {
+		if(net_active[c]){
+			update_player(&net_players[c], &net_cooldown[c], inputs[c]);
+		}
+	}
+
+	update_game(inputs[0]);
 
 }
 
-int free_resources(){
+/*
+ * Bullets wrap around the screen and expire after BULLET_TTL ticks.
+ * Walk backwards so plReleaseAt can swap the last bullet into the hole.
+ */
+
+void update_bullets() {
+
+	unsigned int i = bullets.count;
+
+	while(i-- > 0) {
+
+		struct bullet *b = PL_AT(&bullets, struct bullet, i);
+
+		if(--b->ttl == 0){
+			plReleaseAt(&bullets, i);
+			continue;
+		}
+
+		b->obj.pos[0] += b->vel[0];
+		b->obj.pos[1] += b->vel[1];
+
+		if(b->obj.pos[0] < 0.0) b->obj.pos[0] += VIEWPORT_WIDTH;
+		if(b->obj.pos[0] >= VIEWPORT_WIDTH) b->obj.pos[0] -= VIEWPORT_WIDTH;
+		if(b->obj.pos[1] < 0.0) b->obj.pos[1] += VIEWPORT_HEIGHT;
+		if(b->obj.pos[1] >= VIEWPORT_HEIGHT) b->obj.pos[1] -= VIEWPORT_HEIGHT;
+
+	}
+
+}
+
+/*
+ * Job bodies for jobParallelFor, each works on its own index range.
+ */
+
+static void integrate_job(void *data, unsigned int begin, unsigned int end) {
+
+	rckIntegrate(&rocks, begin, end, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+
+}
+
+static void assign_cells_job(void *data, unsigned int begin, unsigned int end) {
+
+	struct collideJob *job = (struct collideJob*)data;
+	rckAssignCells(job->grid, &rocks, job->cells, begin, end);
+
+}
+
+static void query_bullets_job(void *data, unsigned int begin, unsigned int end) {
+
+	struct collideJob *job = (struct collideJob*)data;
+	unsigned int i;
+
+	for(i = begin; i < end; i++) {
+		struct bullet *b = PL_AT(&bullets, struct bullet, i);
+		job->bullet_hit[i] = rckQueryPoint(job->grid, &rocks, b->obj.pos[0], b->obj.pos[1], VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+	}
+
+}
+
+static void rock_matrix_job(void *data, unsigned int begin, unsigned int end) {
+
+	struct renderFrame *frame = (struct renderFrame*)data;
+
+	mtxAffine2dBatch(&frame->rocks[begin * MODEL_FLOATS], &rocks.x[begin], &rocks.y[begin],
+		&rocks.rot[begin], &rocks.radius[begin], end - begin);
+
+}
+
+/*
+ * Move the field, then test bullets against it through a uniform grid.
+ * Hit pairs are collected first and resolved highest rock index first so
+ * the swap in rckRemove never moves a rock that is still to be removed.
+ */
+
+void update_rocks() {
+
+	struct rckGrid grid;
+	struct collideJob job;
+	unsigned int i, num_hits = 0;
+	unsigned int *hit_rock, *hit_size;
+	float *hit_x, *hit_y;
+	unsigned char *hit;
+	int r, k;
+
+	if(rocks.count == 0){
+		spawn_wave();
+	}
+
+	jobParallelFor(rocks.count, ROCK_GRAIN, integrate_job, NULL);
+
+	if(bullets.count == 0){
+		return;
+	}
+
+	rckInitGrid(&grid, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+	grid.cell_start = (unsigned int*)arnAlloc(&frame_arena, rckGridCells(VIEWPORT_WIDTH, VIEWPORT_HEIGHT) * sizeof(unsigned int));
+	grid.items = (unsigned int*)arnAlloc(&frame_arena, rocks.count * sizeof(unsigned int));
+	job.grid = &grid;
+	job.cells = (unsigned int*)arnAlloc(&frame_arena, rocks.count * sizeof(unsigned int));
+	job.bullet_hit = (int*)arnAlloc(&frame_arena, bullets.count * sizeof(int));
+
+	jobParallelFor(rocks.count, ROCK_GRAIN, assign_cells_job, &job);
+	rckBuildGrid(&grid, &rocks, job.cells);
+	jobParallelFor(bullets.count, BULLET_GRAIN, query_bullets_job, &job);
+
+	hit_rock = (unsigned int*)arnAlloc(&frame_arena, bullets.count * sizeof(unsigned int));
+	i = bullets.count;
+	while(i-- > 0) {
+		r = job.bullet_hit[i];
+		if(r >= 0){
+			hit_rock[num_hits++] = (unsigned int)r;
+			plReleaseAt(&bullets, i);
+		}
+	}
+
+	if(num_hits == 0){
+		return;
+	}
+
+	hit = (unsigned char*)arnAlloc(&frame_arena, rocks.count);
+	memset(hit, 0, rocks.count);
+	for(i = 0; i < num_hits; i++){
+		hit[hit_rock[i]] = 1;
+	}
+
+	hit_x = (float*)arnAlloc(&frame_arena, num_hits * sizeof(float));
+	hit_y = (float*)arnAlloc(&frame_arena, num_hits * sizeof(float));
+	hit_size = (unsigned int*)arnAlloc(&frame_arena, num_hits * sizeof(unsigned int));
+	num_hits = 0;
+
+	i = rocks.count;
+	while(i-- > 0) {
+		if(!hit[i]){
+			continue;
+		}
+		hit_x[num_hits] = rocks.x[i];
+		hit_y[num_hits] = rocks.y[i];
+		hit_size[num_hits] = rocks.size[i];
+		game.score += hit_size[num_hits] == RCK_LARGE ? 20 : (hit_size[num_hits] == RCK_MEDIUM ? 50 : 100);
+		if(num_bursts < MAX_BURSTS){
+			bursts[num_bursts * 3 + 0] = rocks.x[i];
+			bursts[num_bursts * 3 + 1] = rocks.y[i];
+			bursts[num_bursts * 3 + 2] = rocks.size[i];
+			num_bursts++;
+		}
+		num_hits++;
+		rckRemove(&rocks, i);
+	}
+
+	for(i = 0; i < num_hits; i++) {
+		if(hit_size[i] == RCK_SMALL){
+			continue;
+		}
+		for(k = 0; k < 2; k++){
+			rckSpawn(&rocks, hit_x[i], hit_y[i], hit_size[i] - 1, &game.rng);
+		}
+	}
+
+}
+
+/*
+ * Each wave adds one more large rock, spawned along the screen edges.
+ */
+
+void spawn_wave() {
+
+	unsigned int i;
+
+	game.wave++;
+	for(i = 0; i < 3 + game.wave; i++) {
+		if(game_random() & 1){
+			rckSpawn(&rocks, 0.0, rckRandom(&game.rng) * VIEWPORT_HEIGHT, RCK_LARGE, &game.rng);
+		} else {
+			rckSpawn(&rocks, rckRandom(&game.rng) * VIEWPORT_WIDTH, 0.0, RCK_LARGE, &game.rng);
+		}
+	}
+
+}
+
+/*
+ * Serialize the game state and live pool objects for replay keyframes.
+ * Layout: gameState, bullet count, live bullets in pool order, rock
+ * count, then each rock array in turn.
+ */
+
+unsigned int save_game(unsigned char *buf) {
+
+	unsigned int n = 0;
+
+	memcpy(buf + n, &game, sizeof(struct gameState));
+	n += sizeof(struct gameState);
+	memcpy(buf + n, &bullets.count, sizeof(unsigned int));
+	n += sizeof(unsigned int);
+	memcpy(buf + n, bullets.items, bullets.count * sizeof(struct bullet));
+	n += bullets.count * sizeof(struct bullet);
+
+	memcpy(buf + n, &rocks.count, sizeof(unsigned int));
+	n += sizeof(unsigned int);
+	#define SAVE_ROCKS(field, sz) memcpy(buf + n, rocks.field, rocks.count * sz); n += rocks.count * sz;
+	SAVE_ROCKS(x, sizeof(float));
+	SAVE_ROCKS(y, sizeof(float));
+	SAVE_ROCKS(vx, sizeof(float));
+	SAVE_ROCKS(vy, sizeof(float));
+	SAVE_ROCKS(rot, sizeof(float));
+	SAVE_ROCKS(spin, sizeof(float));
+	SAVE_ROCKS(radius, sizeof(float));
+	SAVE_ROCKS(size, 1);
+	#undef SAVE_ROCKS
+
+	return n;
+
+}
+
+void load_game(const unsigned char *buf) {
+
+	unsigned int i, count;
+
+	memcpy(&game, buf, sizeof(struct gameState));
+	buf += sizeof(struct gameState);
+	memcpy(&count, buf, sizeof(unsigned int));
+	buf += sizeof(unsigned int);
+
+	plClear(&bullets);
+	for(i = 0; i < count && i < MAX_BULLETS; i++){
+		memcpy(plAcquire(&bullets, NULL), buf + i * sizeof(struct bullet), sizeof(struct bullet));
+	}
+	buf += count * sizeof(struct bullet);
+
+	memcpy(&count, buf, sizeof(unsigned int));
+	buf += sizeof(unsigned int);
+	rocks.count = count < rocks.capacity ? count : rocks.capacity;
+	#define LOAD_ROCKS(field, sz) memcpy(rocks.field, buf, rocks.count * sz); buf += count * sz;
+	LOAD_ROCKS(x, sizeof(float));
+	LOAD_ROCKS(y, sizeof(float));
+	LOAD_ROCKS(vx, sizeof(float));
+	LOAD_ROCKS(vy, sizeof(float));
+	LOAD_ROCKS(rot, sizeof(float));
+	LOAD_ROCKS(spin, sizeof(float));
+	LOAD_ROCKS(radius, sizeof(float));
+	LOAD_ROCKS(size, 1);
+	#undef LOAD_ROCKS
+
+}
+
+unsigned int game_random() {
+
+	game.rng ^= game.rng << 13;
+	game.rng ^= game.rng >> 17;
+	game.rng ^= game.rng << 5;
+	return game.rng;
+
+}
+
+double get_time_ms() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+
+}
+
+/*
+ * Everything a frame does apart from GL: replay IO, simulation and
+ * building the model matrices that draw_frame uploads.
+ */
+
+void step_frame(unsigned int input, struct renderFrame *frame) {
+
+	arnReset(&frame_arena);
+
+	if(replay_mode == REPLAY_RECORD){
+		if(game.tick % RPL_KEYFRAME_INTERVAL == 0){
+			unsigned char *state = (unsigned char*)arnAlloc(&frame_arena, GAME_STATE_MAX_SIZE);
+			rplWriteKeyframe(&replay, state, save_game(state));
+		}
+		rplWriteInput(&replay, input);
+	} else if(replay_mode == REPLAY_PLAYBACK){
+		input = rplReadInput(&replay, &input) ? input : 0;
+	}
+
+	update_game(input);
+	build_transforms(frame);
+
+}
+
+/*
+ * 2D affine model transforms for everything drawn this frame, written
+ * into frame. Rock transforms are built in parallel, then objects that
+ * overlap a screen edge get ghost copies appended after the rocks so
+ * the wrapped part shows on the far side. Bullets are too small to
+ * bother.
+ */
+
+void build_transforms(struct renderFrame *frame) {
+
+	unsigned int i, n, ships = 1;
+
+	frame->tick = game.tick;
+	frame->score = game.score;
+	frame->wave = game.wave;
+	frame->thrust = thrust;
+	frame->num_bursts = num_bursts;
+	memcpy(frame->bursts, bursts, num_bursts * 3 * sizeof(GLfloat));
+
+	mtxTransformObject2d(&game.player, frame->players);
+	n = append_ghosts(frame->players, 1, frame->players, game.player.pos[0], game.player.pos[1], player_radius);
+	for(i = 1; i < MAX_PLAYERS; i++) {
+		if(net_active[i]){
+			GLfloat *m = &frame->players[n * MODEL_FLOATS];
+			mtxTransformObject2d(&net_players[i], m);
+			n = append_ghosts(frame->players, n + 1, m, net_players[i].pos[0], net_players[i].pos[1], player_radius);
+			ships++;
+		}
+	}
+	frame->num_players = n;
+	frame->num_ghosts = n - ships;
+
+	for(i = 0; i < bullets.count; i++) {
+		struct bullet *b = PL_AT(&bullets, struct bullet, i);
+		mtxTransformObject2d(&b->obj, &frame->bullets[i * MODEL_FLOATS]);
+	}
+	frame->num_bullets = bullets.count;
+
+	jobParallelFor(rocks.count, ROCK_GRAIN, rock_matrix_job, frame);
+
+	n = rocks.count;
+	for(i = 0; i < rocks.count; i++) {
+		n = append_ghosts(frame->rocks, n, &frame->rocks[i * MODEL_FLOATS], rocks.x[i], rocks.y[i], rocks.radius[i]);
+	}
+	frame->num_ghosts += n - rocks.count;
+	frame->num_rocks = n;
+
+}
+
+/*
+ * Append the ghost copies of one object to an instance array that
+ * already holds count transforms, returns the new count.
+ */
+
+unsigned int append_ghosts(GLfloat *instances, unsigned int count, const GLfloat *model, float x, float y, float radius) {
+
+	GLfloat offsets[6];
+	unsigned int k, n;
+
+	n = rckWrapGhosts(x, y, radius, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, offsets);
+	for(k = 0; k < n; k++) {
+		GLfloat *m = &instances[(count + k) * MODEL_FLOATS];
+		memcpy(m, model, MODEL_FLOATS * sizeof(GLfloat));
+		m[A_02] += offsets[k * 2 + 0];
+		m[A_12] += offsets[k * 2 + 1];
+	}
+
+	return count + n;
+
+}
+
+void create_frame(struct renderFrame *frame, unsigned int max_rocks) {
+
+	memset(frame, 0, sizeof(struct renderFrame));
+	// room for up to three ghosts per rock
+	frame->rocks = (GLfloat*)malloc(max_rocks * 4 * MODEL_FLOATS * sizeof(GLfloat));
+
+}
+
+void destroy_frame(struct renderFrame *frame) {
+
+	free(frame->rocks);
+	frame->rocks = NULL;
+
+}
+
+/*
+ * Pipelined mode: this thread simulates frame N+1 into the back buffer
+ * while on_display submits frame N from the front buffer. on_display
+ * posts sim_go once per fresh frame it picks up, so the sim advances one
+ * tick per displayed frame just like the serial path.
+ */
+
+void* sim_thread_main(void *arg) {
+
+	double start;
+
+	while(1) {
+
+		sem_wait(&sim_go);
+		if(sim_quit){
+			break;
+		}
+
+		start = get_time_ms();
+		step_frame(sim_input, &frames[frame_exchange.back]);
+		sim_ms += get_time_ms() - start;
+		sim_frames++;
+
+		ppPublish(&frame_exchange);
+
+	}
+
+	return NULL;
+
+}
+
+/*
+ * Run frames without a window. Without a replay the input is scripted
+ * so the bullet pool sees traffic. Returns non-zero if the allocation
+ * guard saw a frame past warmup allocate.
+ */
+
+int run_headless(unsigned int num_frames) {
+
+	unsigned int f;
+	double start = get_time_ms();
+
+	for(f = 0; f < num_frames; f++) {
+		alcFrameBegin();
+		step_frame(headless_input(game.tick), &frames[0]);
+		emit_particles(&frames[0]);
+		ptlUpdate(&particles);
+		alcFrameEnd();
+		ghost_total += frames[0].num_ghosts;
+	}
+
+	fprintf(stderr, "Headless: %u frames in %.3f ms, %lu allocations, %u steady-state frames allocated\n",
+		num_frames, get_time_ms() - start, alc_allocs, alc_failed_frames);
+	fprintf(stderr, "Headless: %.2f wrap ghosts per frame\n", num_frames ? (double)ghost_total / num_frames : 0.0);
+
+	#ifndef ALLOC_GUARD
+	fprintf(stderr, "Headless: built without ALLOC_GUARD, allocations were not counted\n");
+	#endif
+
+	free_resources();
+	return alc_failed_frames ? 1 : 0;
+
+}
+
+unsigned int headless_input(unsigned int tick) {
+
+	unsigned int mask = GAMEPAD_BUTTON_A_MASK;
+
+	mask |= (tick / 90) % 2 ? GAMEPAD_BUTTON_L_MASK : GAMEPAD_BUTTON_R_MASK;
+	mask |= (tick / 45) % 2 ? GAMEPAD_LEFT_MASK : GAMEPAD_RIGHT_MASK;
+	mask |= (tick / 60) % 2 ? GAMEPAD_UP_MASK : GAMEPAD_DOWN_MASK;
+
+	return mask;
+
+}
+
+/*
+ * Time the simulation alone (no GL, no matrix building) as the field
+ * grows, doubling from 1000 rocks up to max_rocks, on however many
+ * threads the job system was started with.
+ */
+
+int run_stress(unsigned int max_rocks) {
+
+	unsigned int n, i, t;
+	double start, ms;
+
+	rckDestroy(&rocks);
+	rckCreate(&rocks, max_rocks * 2);
+	fprintf(stderr, "Stress: %u thread%s\n", jobs.num_threads, jobs.num_threads == 1 ? "" : "s");
+
+	for(n = 1000; ; n *= 2) {
+
+		n = n < max_rocks ? n : max_rocks;
+		rocks.count = 0;
+		plClear(&bullets);
+		for(i = 0; i < n; i++) {
+			rckSpawn(&rocks, rckRandom(&game.rng) * VIEWPORT_WIDTH, rckRandom(&game.rng) * VIEWPORT_HEIGHT,
+				1 + game_random() % 3, &game.rng);
+		}
+
+		start = get_time_ms();
+		for(t = 0; t < STRESS_TICKS; t++) {
+			arnReset(&frame_arena);
+			update_game(headless_input(game.tick));
+		}
+		ms = (get_time_ms() - start) / STRESS_TICKS;
+
+		fprintf(stderr, "Stress: %7u rocks  %8.3f ms/tick  %8.1f Hz  %s\n",
+			n, ms, 1000.0 / ms, ms < 1000.0 / 60.0 ? "ok" : "below 60 Hz");
+
+		if(n == max_rocks){
+			break;
+		}
+
+	}
+
+	free_resources();
+	return 0;
+
+}
+
+/*
+ * Time a simulated frame (update plus matrix building) over BENCH_ROCKS
+ * rocks with 1 to max_threads threads and report the speedup.
+ */
+
+int run_job_bench(unsigned int max_threads) {
+
+	unsigned int threads, i, t;
+	double start, ms, base = 0.0;
+	unsigned int seed;
+
+	rckDestroy(&rocks);
+	rckCreate(&rocks, BENCH_ROCKS * 2);
+	destroy_frame(&frames[0]);
+	create_frame(&frames[0], BENCH_ROCKS * 2);
+
+	for(threads = 1; threads <= max_threads; threads++) {
+
+		jobCreate(threads - 1);
+
+		seed = 0x2545f491;
+		rocks.count = 0;
+		plClear(&bullets);
+		for(i = 0; i < BENCH_ROCKS; i++) {
+			rckSpawn(&rocks, rckRandom(&seed) * VIEWPORT_WIDTH, rckRandom(&seed) * VIEWPORT_HEIGHT,
+				1 + (unsigned int)(rckRandom(&seed) * 3), &seed);
+		}
+
+		start = get_time_ms();
+		for(t = 0; t < STRESS_TICKS; t++) {
+			arnReset(&frame_arena);
+			update_game(headless_input(game.tick));
+			build_transforms(&frames[0]);
+		}
+		ms = (get_time_ms() - start) / STRESS_TICKS;
+		base = threads == 1 ? ms : base;
+
+		fprintf(stderr, "Jobs: %2u threads  %8.3f ms/frame  %5.2fx\n", threads, ms, base / ms);
+
+		jobDestroy();
+
+	}
+
+	free_resources();
+	return 0;
+
+}
+
+/*
+ * --bench cases. Each body runs ops operations, state lives in these
+ * globals so the runner can call them through one pointer type.
+ */
+
+GLfloat bench_a[16], bench_step[16];
+struct mtxObject bench_obj;
+GLfloat *bench_affine;
+unsigned char *bench_state;
+volatile float bench_sink;
+
+static void bench_multiply(unsigned int ops) {
+
+	unsigned int i;
+
+	for(i = 0; i < ops; i++) {
+		mtxMultiplyMatrix(bench_a, bench_step);
+	}
+	bench_sink += bench_a[M_03];
+
+}
+
+static void bench_transform_object(unsigned int ops) {
+
+	unsigned int i;
+
+	for(i = 0; i < ops; i++) {
+		bench_obj.rot[2] = i * 0.37f;
+		mtxTransformObject(&bench_obj);
+		bench_sink += bench_obj.matrix[M_00];
+	}
+
+}
+
+static void bench_rock_transforms(unsigned int ops) {
+
+	mtxAffine2dBatch(bench_affine, rocks.x, rocks.y, rocks.rot, rocks.radius, ops);
+	bench_sink += bench_affine[A_00];
+
+}
+
+// what glutJoystickFunc and the frame loop do with every poll
+static void bench_gamepad(unsigned int ops) {
+
+	unsigned int i;
+
+	for(i = 0; i < ops; i++) {
+		gamepad_callback(i & 0xff, (int)(i % 3) - 1, (int)(i % 5) - 2, 0);
+		bench_sink += gamepad_get_mask();
+	}
+
+}
+
+static void bench_sim_ticks(unsigned int ops) {
+
+	unsigned int i;
+
+	load_game(bench_state);
+	for(i = 0; i < ops; i++) {
+		step_frame(headless_input(game.tick), &frames[0]);
+	}
+	bench_sink += game.score;
+
+}
+
+static void bench_shader(unsigned int ops) {
+
+	unsigned int i;
+
+	for(i = 0; i < ops; i++) {
+		glDeleteProgram(mtxCreateProgram("shdr/vertex.glsl", "shdr/fragment.glsl"));
+	}
+	glFinish();
+
+}
+
+static int bench_compare(const void *a, const void *b) {
+
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+
+}
+
+/*
+ * Warm up, time BENCH_REPS repetitions of ops operations and write the
+ * per-operation statistics as one JSON object (after a comma unless it is
+ * the first).
+ */
+
+static void bench_case(FILE *fp, int first, const char *name, void (*body)(unsigned int), unsigned int ops) {
+
+	double samples[BENCH_REPS], start, mean = 0.0, var = 0.0;
+	unsigned int i;
+
+	for(i = 0; i < BENCH_WARMUP; i++) {
+		body(ops);
+	}
+
+	for(i = 0; i < BENCH_REPS; i++) {
+		start = get_time_ms();
+		body(ops);
+		samples[i] = (get_time_ms() - start) * 1e6 / ops;
+		mean += samples[i];
+	}
+
+	mean /= BENCH_REPS;
+	for(i = 0; i < BENCH_REPS; i++) {
+		var += (samples[i] - mean) * (samples[i] - mean);
+	}
+	qsort(samples, BENCH_REPS, sizeof(double), bench_compare);
+
+	fprintf(fp, "%s\n    {\"name\": \"%s\", \"unit\": \"ns/op\", \"ops\": %u, \"min\": %.3f, \"median\": %.3f, "
+		"\"mean\": %.3f, \"stddev\": %.3f, \"max\": %.3f}", first ? "" : ",", name, ops, samples[0],
+		samples[BENCH_REPS / 2], mean, sqrt(var / (BENCH_REPS - 1)), samples[BENCH_REPS - 1]);
+	fprintf(stderr, "Bench: %-24s median %12.3f ns/op  min %12.3f  stddev %10.3f\n", name,
+		samples[BENCH_REPS / 2], samples[0], sqrt(var / (BENCH_REPS - 1)));
+
+}
+
+/*
+ * Machine readable benchmark of the math, transform, input, simulation
+ * and shader paths for charting across commits. Runs single threaded on
+ * the first CPU it is allowed, each case warmed up BENCH_WARMUP times and
+ * timed BENCH_REPS times. filename "-" writes to stdout.
+ */
+
+int run_bench(const char *filename) {
+
+	FILE *fp = strcmp(filename, "-") == 0 ? stdout : fopen(filename, "w");
+	struct ofsContext ofs;
+	cpu_set_t set;
+	int cpu = -1, gl;
+	unsigned int i;
+
+	if(fp == NULL){
+		fprintf(stderr, "Could not open %s\n", filename);
+		return 1;
+	}
+
+	// one thread on one core so the scheduler doesn't move it mid-run
+	if(sched_getaffinity(0, sizeof(set), &set) == 0){
+		for(i = 0; i < CPU_SETSIZE && cpu < 0; i++) {
+			cpu = CPU_ISSET(i, &set) ? (int)i : -1;
+		}
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		cpu = sched_setaffinity(0, sizeof(set), &set) == 0 ? cpu : -1;
+	}
+	jobCreate(0);
+
+	mthMat4Identity(bench_a);
+	mthMat4Identity(bench_step);
+	mthMat4RotateZ(bench_step, cosf(0.001f), sinf(0.001f));
+	memset(&bench_obj, 0, sizeof(bench_obj));
+	bench_obj.pos[0] = 400.0f;
+	bench_obj.pos[1] = 240.0f;
+	bench_obj.scl[0] = bench_obj.scl[1] = bench_obj.scl[2] = 1.0f;
+	bench_affine = (GLfloat*)malloc(MAX_ROCKS * MODEL_FLOATS * sizeof(GLfloat));
+	bench_state = (unsigned char*)malloc(GAME_STATE_MAX_SIZE);
+
+	// a full field, saved so every step_frame repetition starts from it
+	for(i = rocks.count; i < MAX_ROCKS; i++) {
+		rckSpawn(&rocks, rckRandom(&game.rng) * VIEWPORT_WIDTH, rckRandom(&game.rng) * VIEWPORT_HEIGHT, 3, &game.rng);
+	}
+	save_game(bench_state);
+
+	gl = ofsCreate(&ofs, VIEWPORT_WIDTH, VIEWPORT_HEIGHT) == 0 && init_glew() == 0;
+
+	fprintf(fp, "{\n  \"benchmark\": \"11\",\n  \"compiler\": \"%s\",\n  \"cpu\": %d,\n  \"warmup\": %d,\n"
+		"  \"repetitions\": %d,\n  \"cases\": [", __VERSION__, cpu, BENCH_WARMUP, BENCH_REPS);
+
+	bench_case(fp, 1, "mtxMultiplyMatrix", bench_multiply, 100000);
+	bench_case(fp, 0, "mtxTransformObject", bench_transform_object, 100000);
+	bench_case(fp, 0, "mtxAffine2dBatch", bench_rock_transforms, MAX_ROCKS);
+	bench_case(fp, 0, "gamepad_callback", bench_gamepad, 100000);
+	bench_case(fp, 0, "step_frame", bench_sim_ticks, BENCH_SIM_TICKS);
+	if(gl){
+		bench_case(fp, 0, "mtxCreateProgram", bench_shader, 10);
+	} else {
+		fprintf(stderr, "Bench: no GL context, skipping mtxCreateProgram\n");
+	}
+
+	fprintf(fp, "\n  ]\n}\n");
+	if(fp != stdout){
+		fclose(fp);
+	}
+
+	if(gl){
+		ofsDestroy(&ofs);
+	}
+	free(bench_affine);
+	free(bench_state);
+	free_resources();
+	return 0;
+
+}
+
+/*
+ * Network play over libs/session_utils.h. Client 0 flies game.player and
+ * the rest fly net_players, sharing the rocks, bullets and score. World
+ * slots are the ships, then MAX_BULLETS bullet slots, then the rocks,
+ * and the snapshot status words are the score and the wave.
+ */
+
+static unsigned int build_world(struct snpEntity *world) {
+
+	unsigned int i;
+
+	for(i = 0; i < MAX_PLAYERS; i++) {
+		const struct mtxObject *ship = i == 0 ? &game.player : &net_players[i];
+		snpQuantize(&world[i], i == 0 || net_active[i] ? SNP_SHIP : SNP_EMPTY,
+			ship->pos[0], ship->pos[1], ship->rot[2], player_radius);
+	}
+
+	for(i = 0; i < MAX_BULLETS; i++) {
+		struct bullet *b = i < bullets.count ? PL_AT(&bullets, struct bullet, i) : NULL;
+		snpQuantize(&world[NET_SLOT_BULLETS + i], b != NULL ? SNP_BULLET : SNP_EMPTY,
+			b != NULL ? b->obj.pos[0] : 0.0f, b != NULL ? b->obj.pos[1] : 0.0f, b != NULL ? b->obj.rot[2] : 0.0f, 0.0f);
+	}
+
+	for(i = 0; i < rocks.count; i++) {
+		snpQuantize(&world[NET_SLOT_ROCKS + i], SNP_ROCK, rocks.x[i], rocks.y[i], rocks.rot[i], rocks.radius[i]);
+	}
+
+	return NET_SLOT_ROCKS + rocks.count;
+
+}
+
+/*
+ * Relevance of each slot to a client flying a ship at (x, y): its own
+ * and the other ships always matter most, bullets and rocks fall off
+ * with wrapped distance from the ship.
+ */
+
+static void relevance_weights(float *weight, const struct snpEntity *world, unsigned int count, float x, float y) {
+
+	const float r2 = NET_RELEVANCE_RADIUS * NET_RELEVANCE_RADIUS;
+	float ex, ey, ea, dx, dy;
+	unsigned int i;
+
+	for(i = 0; i < count; i++) {
+
+		if(i < NET_SLOT_BULLETS){
+			weight[i] = NET_SHIP_WEIGHT;
+			continue;
+		}
+
+		snpDequantize(&world[i], &ex, &ey, &ea);
+		dx = fabsf(ex - x);
+		dy = fabsf(ey - y);
+		dx = dx > VIEWPORT_WIDTH / 2 ? VIEWPORT_WIDTH - dx : dx;
+		dy = dy > VIEWPORT_HEIGHT / 2 ? VIEWPORT_HEIGHT - dy : dy;
+		weight[i] = (i < NET_SLOT_ROCKS ? NET_BULLET_WEIGHT : 1.0f) / (1.0f + (dx * dx + dy * dy) / r2);
+
+	}
+
+}
+
+/*
+ * Session hooks, see struct netServer.
+ */
+
+static uint32_t net_step(struct netServer *srv, const unsigned int *inputs) {
+
+	update_net_game(inputs);
+	return game.tick;
+
+}
+
+static unsigned int net_build(struct netServer *srv, struct snpEntity *world, uint32_t *status) {
+
+	status[0] = game.score;
+	status[1] = game.wave;
+	return build_world(world);
+
+}
+
+static void net_weigh(struct netServer *srv, int c, float *weight, const struct snpEntity *world, unsigned int count) {
+
+	const struct mtxObject *ship = c == 0 ? &game.player : &net_players[c];
+	relevance_weights(weight, world, count, ship->pos[0], ship->pos[1]);
+
+}
+
+/*
+ * Client 0 takes over game.player where it is, the others get a fresh
+ * ship along the bottom.
+ */
+
+static void net_join(struct netServer *srv, int c) {
+
+	struct mtxObject *ship = &net_players[c];
+
+	if(c == 0){
+		return;
+	}
+
+	memset(ship, 0, sizeof(struct mtxObject));
+	ship->pos[0] = 400.0 + (c % 2 ? -160.0 : 160.0) * ((c + 1) / 2);
+	ship->pos[1] = 100.0;
+	ship->scl[0] = PLAYER_SCALE;
+	ship->scl[1] = PLAYER_SCALE;
+	ship->scl[2] = PLAYER_SCALE;
+	net_cooldown[c] = 0;
+	net_active[c] = 1;
+
+}
+
+static void net_leave(struct netServer *srv, int c) {
+
+	net_active[c] = 0;
+
+}
+
+static int open_server(struct netServer *srv, int port) {
+
+	if(netServerOpen(srv, port, MAX_PLAYERS, NET_ENTITIES) < 0){
+		return -1;
+	}
+	netSetConditions(&srv->sock, net_latency, net_jitter, net_loss, 1);
+	srv->step = net_step;
+	srv->build = net_build;
+	srv->weigh = net_weigh;
+	srv->join = net_join;
+	srv->leave = net_leave;
+	return 0;
+
+}
+
+/*
+ * Copy a snapshot into the game state so build_transforms and the HUD
+ * draw it. Only the thin client does this, it never steps the game.
+ */
+
+void apply_view(const struct netView *view) {
+
+	unsigned int i;
+
+	game.tick = view->tick;
+	game.score = view->status[0];
+	game.wave = view->status[1];
+
+	for(i = 1; i < MAX_PLAYERS; i++) {
+		net_active[i] = 0;
+	}
+	for(i = 0; i < MAX_PLAYERS && i < view->count; i++) {
+		struct mtxObject *ship = i == 0 ? &game.player : &net_players[i];
+		if(view->entities[i].kind != SNP_SHIP){
+			continue;
+		}
+		snpDequantize(&view->entities[i], &ship->pos[0], &ship->pos[1], &ship->rot[2]);
+		ship->scl[0] = PLAYER_SCALE;
+		ship->scl[1] = PLAYER_SCALE;
+		net_active[i] = i > 0;
+	}
+
+	plClear(&bullets);
+	for(i = NET_SLOT_BULLETS; i < NET_SLOT_ROCKS && i < view->count; i++) {
+		struct bullet *b;
+		if(view->entities[i].kind != SNP_BULLET){
+			continue;
+		}
+		b = (struct bullet*)plAcquire(&bullets, NULL);
+		memset(b, 0, sizeof(struct bullet));
+		snpDequantize(&view->entities[i], &b->obj.pos[0], &b->obj.pos[1], &b->obj.rot[2]);
+		b->obj.scl[0] = 0.3;
+		b->obj.scl[1] = 0.3;
+	}
+
+	rocks.count = 0;
+	for(i = NET_SLOT_ROCKS; i < view->count && rocks.count < rocks.capacity; i++) {
+		unsigned int k = rocks.count;
+		if(view->entities[i].kind != SNP_ROCK){
+			continue;
+		}
+		snpDequantize(&view->entities[i], &rocks.x[k], &rocks.y[k], &rocks.rot[k]);
+		rocks.radius[k] = view->entities[i].radius;
+		rocks.count++;
+	}
+
+}
+
+/*
+ * Dedicated server at NET_TICK_MS per tick without a window, for
+ * num_ticks ticks or forever when it is negative. Stats every
+ * NET_STATS_MS.
+ */
+
+int run_server(int port, long num_ticks) {
+
+	struct netServer srv;
+
+	if(open_server(&srv, port) < 0){
+		return 1;
+	}
+	fprintf(stderr, "Server: port %d, %d players, %.0f ticks/s\n", netPort(&srv.sock), MAX_PLAYERS, 1000.0 / NET_TICK_MS);
+
+	netServerRun(&srv, num_ticks, NET_STATS_MS);
+
+	netServerReport(&srv, get_time_ms());
+	netServerClose(&srv);
+	free_resources();
+	return 0;
+
+}
+
+/*
+ * Server and num_clients clients in one process over 127.0.0.1 on a
+ * simulated clock, so a run under --latency, --jitter and --loss is
+ * repeatable. Client c plays headless_input 37 ticks after client c - 1.
+ * Every ship a client sees has to be on the snapshot grid point where
+ * the server had it on that tick. Fails if a client never gets a
+ * snapshot, sees a wrong ship, or on a clean network has an input
+ * arrive late.
+ */
+
+int run_net_test(unsigned int num_clients) {
+
+	struct netServer srv;
+	struct netLink *links;
+	float *history, *h;
+	unsigned int c, i, t, errors = 0, mismatches = 0;
+	double now = 0.0;
+	int clean = net_latency <= 0.0 && net_jitter <= 0.0 && net_loss <= 0.0f;
+
+	num_clients = num_clients < MAX_PLAYERS ? num_clients : MAX_PLAYERS;
+	links = (struct netLink*)malloc(num_clients * sizeof(struct netLink));
+	history = (float*)malloc(NET_HISTORY * MAX_PLAYERS * 2 * sizeof(float));
+
+	if(open_server(&srv, 0) < 0){
+		return 1;
+	}
+	for(c = 0; c < num_clients; c++) {
+		if(netLinkOpen(&links[c], "127.0.0.1", netPort(&srv.sock), NET_ENTITIES) < 0){
+			return 1;
+		}
+		netSetConditions(&links[c].sock, net_latency, net_jitter, net_loss, c + 2);
+	}
+
+	for(t = 0; t < NET_TEST_TICKS; t++) {
+
+		now = t * NET_TICK_MS;
+		for(c = 0; c < num_clients; c++) {
+			netLinkStep(&links[c], headless_input(t + c * 37), now);
+		}
+
+		netServerUpdate(&srv, now);
+
+		h = &history[(game.tick % NET_HISTORY) * MAX_PLAYERS * 2];
+		for(i = 0; i < MAX_PLAYERS; i++) {
+			const struct mtxObject *ship = i == 0 ? &game.player : &net_players[i];
+			h[i * 2 + 0] = ship->pos[0];
+			h[i * 2 + 1] = ship->pos[1];
+		}
+
+		for(c = 0; c < num_clients; c++) {
+			const struct netView *view = &links[c].view;
+			if(!links[c].have_view || game.tick - view->tick >= NET_HISTORY){
+				continue;
+			}
+			h = &history[(view->tick % NET_HISTORY) * MAX_PLAYERS * 2];
+			for(i = 0; i < MAX_PLAYERS && i < view->count; i++) {
+				struct snpEntity want;
+				if(view->entities[i].kind != SNP_SHIP){
+					continue;
+				}
+				snpQuantize(&want, SNP_SHIP, h[i * 2 + 0], h[i * 2 + 1], 0.0f, player_radius);
+				if(view->entities[i].x != want.x || view->entities[i].y != want.y){
+					mismatches++;
+				}
+			}
+		}
+
+	}
+
+	fprintf(stderr, "Net test: %u clients, %u ticks, latency %.0f ms, jitter %.0f ms, loss %.1f%%\n",
+		num_clients, NET_TEST_TICKS, net_latency, net_jitter, net_loss * 100.0);
+	netServerReport(&srv, now);
+
+	for(c = 0; c < num_clients; c++) {
+		struct netLink *link = &links[c];
+		struct netClient *cl = link->view.id >= 0 && link->view.id < MAX_PLAYERS ? &srv.clients[link->view.id] : NULL;
+		fprintf(stderr, "Net test: client %u is player %d, %lu snapshots, newest %u ticks old, input applied %d ticks after it was sent\n",
+			c, link->view.id, link->snapshots, game.tick - link->view.tick,
+			link->have_view ? (int)(link->tick - 1 - link->view.input_tick) : -1);
+		if(!link->have_view || cl == NULL || (clean && cl->missed > 0)){
+			errors++;
+		}
+	}
+
+	if(mismatches > 0){
+		fprintf(stderr, "Net test: %u ship positions did not match the server\n", mismatches);
+		errors++;
+	}
+
+	for(c = 0; c < num_clients; c++) {
+		netLinkClose(&links[c], now);
+	}
+	netServerReceive(&srv, now);
+	for(c = 0; c < MAX_PLAYERS; c++) {
+		if(clean && srv.clients[c].active){
+			fprintf(stderr, "Net test: client %u did not leave\n", c);
+			errors++;
+		}
+	}
+
+	fprintf(stderr, "Net test: %s\n", errors ? "FAILED" : "passed");
+
+	netServerClose(&srv);
+	free(links);
+	free(history);
+	free_resources();
+	return errors ? 1 : 0;
+
+}
+
+/*
+ * Snapshot sizes over fields of 1000 and 10000 rocks playing the
+ * scripted game for SNAP_BENCH_TICKS ticks, with acks coming back
+ * SNAP_BENCH_RTT ticks after a snapshot goes out and SNAP_BENCH_LOSS of
+ * them lost. Three encoders side by side: every slot quantized with no
+ * baseline, every change against the acked baseline, and what the
+ * server really sends, capped to one packet with relevance to the
+ * player's ship. Every decoded world must match what the server
+ * recorded for it.
+ */
+
+struct snapBenchLink {
+	struct snpHistory server;
+	struct snpHistory client;
+	unsigned char *buf;
+	unsigned int bytes;
+	int delta;
+	uint16_t delivered[SNP_RING];
+	unsigned char have_delivered[SNP_RING];
+	double bits;
+	double written;
+	double ms;
+	unsigned int failures;
+};
+
+static void snap_bench_send(struct snapBenchLink *link, uint16_t seq, const struct snpEntity *world, unsigned int count,
+	const float *weight, int lost) {
+
+	struct snpBits bits;
+	struct snpStats stats;
+	unsigned int k, n, m;
+	int baseline = -1;
+	double start;
+	const struct snpEntity *sent, *got;
+
+	// newest snapshot whose ack has had time to come back
+	for(k = SNAP_BENCH_RTT; link->delta && k < SNP_RING && k <= seq; k++) {
+		if(link->have_delivered[(seq - k) % SNP_RING] && link->delivered[(seq - k) % SNP_RING] == (uint16_t)(seq - k)){
+			baseline = (uint16_t)(seq - k);
+			break;
+		}
+	}
+
+	snpBitsInit(&bits, link->buf, link->bytes);
+	start = get_time_ms();
+	if(snpEncode(&link->server, seq, baseline, world, count, weight, &bits, &stats) < 0){
+		link->failures++;
+		return;
+	}
+	link->ms += get_time_ms() - start;
+	link->bits += bits.pos;
+	link->written += stats.written;
+
+	if(lost){
+		return;
+	}
+
+	snpBitsInit(&bits, link->buf, link->bytes);
+	sent = snpHistoryWorld(&link->server, seq, &n);
+	if(sent == NULL || snpDecode(&link->client, seq, &bits) < 0 || (got = snpHistoryWorld(&link->client, seq, &m)) == NULL ||
+		m != n || memcmp(sent, got, n * sizeof(struct snpEntity)) != 0){
+		link->failures++;
+		return;
+	}
+	link->delivered[seq % SNP_RING] = seq;
+	link->have_delivered[seq % SNP_RING] = 1;
+
+}
+
+int run_snapshot_bench() {
+
+	const unsigned int sizes[2] = { 1000, 10000 };
+	struct snapBenchLink links[3];
+	struct snpEntity *world;
+	float *weight;
+	unsigned int s, l, t, i, n, count, capacity, failures = 0;
+	unsigned int rng = 0x9e3779b9;
+	double floats, total_rocks, error, stale;
+
+	for(s = 0; s < 2; s++) {
+
+		n = sizes[s];
+		capacity = NET_SLOT_ROCKS + 2 * n;
+		rckDestroy(&rocks);
+		rckCreate(&rocks, 2 * n);
+		plClear(&bullets);
+		for(i = 0; i < n; i++) {
+			rckSpawn(&rocks, rckRandom(&game.rng) * VIEWPORT_WIDTH, rckRandom(&game.rng) * VIEWPORT_HEIGHT,
+				1 + game_random() % 3, &game.rng);
+		}
+
+		world = (struct snpEntity*)malloc(capacity * sizeof(struct snpEntity));
+		weight = (float*)malloc(capacity * sizeof(float));
+		for(l = 0; l < 3; l++) {
+			memset(&links[l], 0, sizeof(struct snapBenchLink));
+			snpHistoryCreate(&links[l].server, capacity);
+			snpHistoryCreate(&links[l].client, capacity);
+			// a slot is at most 61 bits
+			links[l].bytes = l < 2 ? capacity * 8 + 64 : NET_PACKET_SIZE - NET_HEADER_SIZE - NET_SNAPSHOT_HEADER;
+			links[l].buf = (unsigned char*)malloc(links[l].bytes);
+			links[l].delta = l > 0;
+		}
+
+		floats = total_rocks = error = stale = 0.0;
+		for(t = 0; t < SNAP_BENCH_TICKS; t++) {
+
+			arnReset(&frame_arena);
+			update_game(headless_input(game.tick));
+			count = build_world(world);
+			relevance_weights(weight, world, count, game.player.pos[0], game.player.pos[1]);
+
+			// the same losses for all three
+			rng ^= rng << 13;
+			rng ^= rng >> 17;
+			rng ^= rng << 5;
+			for(l = 0; l < 3; l++) {
+				snap_bench_send(&links[l], (uint16_t)t, world, count, l < 2 ? NULL : weight,
+					(rng >> 8) * (1.0 / 16777216.0) < SNAP_BENCH_LOSS);
+			}
+
+			// what the last snapshot to arrive shows against the truth
+			for(i = t + 1; i-- > 0 && t - i < SNP_RING; ) {
+				unsigned int m, k;
+				const struct snpEntity *got = snpHistoryWorld(&links[2].client, (uint16_t)i, &m);
+				if(got == NULL){
+					continue;
+				}
+				for(k = NET_SLOT_ROCKS; k < count; k++) {
+					float gx, gy, ga, wx, wy, wa;
+					if(k >= m || got[k].kind != SNP_ROCK){
+						stale++;
+						continue;
+					}
+					snpDequantize(&got[k], &gx, &gy, &ga);
+					snpDequantize(&world[k], &wx, &wy, &wa);
+					gx = fabsf(gx - wx);
+					gy = fabsf(gy - wy);
+					gx = gx > VIEWPORT_WIDTH / 2 ? VIEWPORT_WIDTH - gx : gx;
+					gy = gy > VIEWPORT_HEIGHT / 2 ? VIEWPORT_HEIGHT - gy : gy;
+					error += sqrtf(gx * gx + gy * gy);
+				}
+				break;
+			}
+
+			floats += NET_SNAPSHOT_HEADER + 1 + 13.0 * (1 + net_active[1] + net_active[2] + net_active[3]) +
+				1 + 12.0 * bullets.count + 3 + 16.0 * rocks.count;
+			total_rocks += rocks.count;
+
+		}
+
+		fprintf(stderr, "Snapshots: %u rocks (%.0f on average), bytes/tick: floats %.0f, quantized %.0f, delta %.0f\n",
+			n, total_rocks / SNAP_BENCH_TICKS, floats / SNAP_BENCH_TICKS,
+			links[0].bits / 8.0 / SNAP_BENCH_TICKS, links[1].bits / 8.0 / SNAP_BENCH_TICKS);
+		fprintf(stderr, "Snapshots: %u rocks, one packet: %.0f bytes/tick, %.0f slots/tick, %.2f px mean error, %.2f%% slots wrong, %.3f ms/encode\n",
+			n, links[2].bits / 8.0 / SNAP_BENCH_TICKS, links[2].written / SNAP_BENCH_TICKS,
+			total_rocks > stale ? error / (total_rocks - stale) : 0.0, total_rocks > 0.0 ? 100.0 * stale / total_rocks : 0.0,
+			links[2].ms / SNAP_BENCH_TICKS);
+
+		for(l = 0; l < 3; l++) {
+			failures += links[l].failures;
+			snpHistoryDestroy(&links[l].server);
+			snpHistoryDestroy(&links[l].client);
+			free(links[l].buf);
+		}
+		free(world);
+		free(weight);
+
+	}
+
+	if(failures > 0){
+		fprintf(stderr, "Snapshots: %u snapshots did not decode to what the server sent\n", failures);
+	}
+
+	free_resources();
+	return failures ? 1 : 0;
+
+}
+
+/*
+ * Run frames through the software rasterizer instead of GL. The sim and
+ * the rasterizer are timed separately so the fps reflects rasterizing
+ * only. The last frame can be written out with --capture and compared
+ * against a reference image with --golden; any differing pixel fails.
+ */
+
+int run_raster(unsigned int num_frames, const char *capture_file, const char *golden_file) {
+
+	struct rstContext ctx;
+	unsigned int f;
+	double start, sim = 0.0, raster = 0.0;
+	long diff = 0;
+
+	mtxSetIdentity(matrixOrtho2d);
+	mtxCreateOrtho2d(matrixOrtho2d, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+	rstCreate(&ctx, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, RASTER_MAX_PRIMS);
+
+	for(f = 0; f < num_frames; f++) {
+
+		start = get_time_ms();
+		step_frame(headless_input(game.tick), &frames[0]);
+		sim += get_time_ms() - start;
+
+		start = get_time_ms();
+		rstBegin(&ctx, matrixOrtho2d);
+		raster_frame(&ctx, &frames[0]);
+		raster += get_time_ms() - start;
+
+	}
+
+	fprintf(stderr, "Raster: %u frames, sim %.3f ms/frame, raster %.3f ms/frame (%.1f fps, %u threads)\n",
+		num_frames, num_frames ? sim / num_frames : 0.0, num_frames ? raster / num_frames : 0.0,
+		raster > 0.0 ? num_frames * 1000.0 / raster : 0.0, jobs.num_threads);
+
+	if(capture_file != NULL && rstWritePNG(&ctx, capture_file) == 0){
+		fprintf(stderr, "Raster: wrote tick %u to %s\n", game.tick, capture_file);
+	}
+
+	if(golden_file != NULL){
+		diff = rstComparePNG(&ctx, golden_file);
+		if(diff == 0){
+			fprintf(stderr, "Raster: tick %u matches %s\n", game.tick, golden_file);
+		} else if(diff > 0){
+			fprintf(stderr, "Raster: tick %u differs from %s in %ld pixels\n", game.tick, golden_file, diff);
+		}
+	}
+
+	rstDestroy(&ctx);
+	free_resources();
+	return diff != 0 ? 1 : 0;
+
+}
+
+/*
+ * Run frames through the real GL pipeline (same shaders and draw_frame as
+ * the window) in an offscreen EGL context, reading every frame back with
+ * glReadPixels into one reusable buffer. The readback waits for the GPU,
+ * so the fps is for finished frames. --capture writes the last one.
+ */
+
+int run_offscreen(unsigned int num_frames, const char *capture_file) {
+
+	struct ofsContext ofs;
+	unsigned char *readback;
+	unsigned int f;
+	double start, sim = 0.0, gl = 0.0;
+
+	if(ofsCreate(&ofs, VIEWPORT_WIDTH, VIEWPORT_HEIGHT) < 0 || init_glew() < 0 ||
+		ofsCreateTarget(&ofs) < 0 || init_resources() < 0){
+		fprintf(stderr, "Could not set up offscreen rendering\n");
+		ofsDestroy(&ofs);
+		return 1;
+	}
+
+	if(dump_file != NULL){
+		capturing = capCreate(&capture, dump_file, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, CAPTURE_FPS) == 0;
+	}
+
+	readback = (unsigned char*)malloc(VIEWPORT_WIDTH * VIEWPORT_HEIGHT * 4);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	for(f = 0; f < num_frames; f++) {
+
+		start = get_time_ms();
+		step_frame(headless_input(game.tick), &frames[0]);
+		sim += get_time_ms() - start;
+
+		start = get_time_ms();
+		draw_frame(&frames[0]);
+		gl += get_time_ms() - start;
+		capture_frame();
+
+		start = get_time_ms();
+		glReadPixels(0, 0, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, readback);
+		gl += get_time_ms() - start;
+
+	}
+
+	fprintf(stderr, "Offscreen: %u frames, sim %.3f ms/frame, draw + readback %.3f ms/frame (%.1f fps)\n",
+		num_frames, num_frames ? sim / num_frames : 0.0, num_frames ? gl / num_frames : 0.0,
+		gl > 0.0 ? num_frames * 1000.0 / gl : 0.0);
+
+	if(capture_file != NULL && rstWriteRGBA(capture_file, readback, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, 1) == 0){
+		fprintf(stderr, "Offscreen: wrote tick %u to %s\n", game.tick, capture_file);
+	}
+
+	if(capturing){
+		capFinish(&capture);
+	}
+
+	free(readback);
+	glDeleteProgram(program);
+	glDeleteBuffers(1, &vbo_triangle);
+	glDeleteProgram(line_program);
+	glDeleteProgram(text_program);
+	blmDestroy(&bloom);
+	ptlDestroy(&particles);
+	ofsDestroy(&ofs);
+	free_resources();
+	return 0;
+
+}
+
+void on_display() {
+
+	struct renderFrame *frame;
+	double start = get_time_ms();
+
+	alcFrameBegin();
+
+	if(pipelined){
+		if(ppAcquire(&frame_exchange)){
+			sim_input = gamepad_get_mask() | poll_gesture();
+			sem_post(&sim_go);
+		}
+		frame = &frames[frame_exchange.front];
+	} else if(net_client_on){
+		frame = &frames[0];
+		netLinkStep(&net_link, gamepad_get_mask() | poll_gesture(), start);
+		if(net_link.have_view){
+			apply_view(&net_link.view);
+		}
+		build_transforms(frame);
+	} else {
+		frame = &frames[0];
+		step_frame(gamepad_get_mask() | poll_gesture(), frame);
+	}
+
+	draw_frame(frame);
+
+	// capture size follows the window, which only settles once shown
+	if(dump_file != NULL && !capturing && render_frames == 0){
+		capturing = capCreate(&capture, dump_file, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT), CAPTURE_FPS) == 0;
+	}
+	capture_frame();
+
+	glutSwapBuffers();
+	ghost_total += frame->num_ghosts;
+
+	render_ms += get_time_ms() - start;
+	render_frames++;
+	alcFrameEnd();
+
+}
+
+/*
+ * Ship triangles for count affine transforms, MODEL_BATCH per upload and
+ * draw call. Expects program and vbo_triangle to be set up.
+ */
+
+void draw_triangles(const GLfloat *models, unsigned int count) {
+
+	unsigned int i, n;
+
+	for(i = 0; i < count; i += n) {
+		n = count - i < MODEL_BATCH ? count - i : MODEL_BATCH;
+		glUniform3fv(uniform_modelRows, n * 2, &models[i * MODEL_FLOATS]);
+		glDrawArrays(GL_TRIANGLES, 0, n * 3);
+	}
+
+}
+
+void draw_frame(struct renderFrame *frame) {
+
+	unsigned int i;
+	GLint viewport[4];
+
+	double start;
+
+	// particles advance once per sim tick, not per displayed frame, and
+	// outside the bloom scene pass so their timer queries don't nest
+	if(particles_on && frame->tick != particle_tick){
+		emit_particles(frame);
+		ptlUpdate(&particles);
+		particle_tick = frame->tick;
+	}
+
+	blmBeginScene(&bloom);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glUseProgram(program);
+	glEnableVertexAttribArray(attribute_coord2d);
+	glEnableVertexAttribArray(attribute_instance);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_triangle);
+	glVertexAttribPointer(
+		attribute_coord2d,
+		2,
+		GL_FLOAT,
+		GL_FALSE,
+		3 * sizeof(GLfloat),
+		0
+	);
+	glVertexAttribPointer(attribute_instance, 1, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat),
+		(const GLvoid*)(2 * sizeof(GLfloat)));
+
+	draw_triangles(frame->players, frame->num_players);
+	draw_triangles(frame->bullets, frame->num_bullets);
+
+	glDisableVertexAttribArray(attribute_coord2d);
+	glDisableVertexAttribArray(attribute_instance);
+
+	// every rock outline in one draw call
+	start = get_time_ms();
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	lnBegin(&lines, (float)viewport[2] / VIEWPORT_WIDTH, (float)viewport[3] / VIEWPORT_HEIGHT);
+	for(i = 0; i < frame->num_rocks; i++) {
+		lnLoop(&lines, &frame->rocks[i * MODEL_FLOATS], rock_vertices, ROCK_VERTICES);
+	}
+	lnFlush(&lines, matrixOrtho2d);
+	line_ms += get_time_ms() - start;
+
+	if(particles_on){
+		ptlDraw(&particles, matrixOrtho2d);
+	}
+
+	blmComposite(&bloom);
+
+	draw_hud(frame);
+
+}
+
+/*
+ * Score, wave and frame time over the composited image. Labels never
+ * change and the numbers only change on a score or a stats refresh, so
+ * most frames lay out and upload nothing.
+ */
+
+void draw_hud(struct renderFrame *frame) {
+
+	char text[TXT_MAX_LEN];
+	float top = VIEWPORT_HEIGHT - HUD_MARGIN;
+	float column = HUD_MARGIN + 6 * HUD_SIZE;
+
+	txtBegin(&hud);
+
+	txtPrint(&hud, HUD_MARGIN, top, HUD_SIZE, "SCORE");
+	snprintf(text, sizeof(text), "%06u", frame->score);
+	txtPrint(&hud, column, top, HUD_SIZE, text);
+
+	txtPrint(&hud, HUD_MARGIN, top - HUD_SIZE * 1.5f, HUD_SIZE, "WAVE");
+	snprintf(text, sizeof(text), "%u", frame->wave);
+	txtPrint(&hud, column, top - HUD_SIZE * 1.5f, HUD_SIZE, text);
+
+	// averaged so the readout is legible and stays cached in between;
+	// only on_display times frames, so offscreen captures leave it out
+	// and stay the same run to run
+	if(render_frames == 0){
+		snprintf(hud_stats, sizeof(hud_stats), "%u ROCKS", frame->num_rocks);
+	} else if(render_frames % HUD_STATS_FRAMES == 0){
+		snprintf(hud_stats, sizeof(hud_stats), "%.2f MS %u ROCKS", render_ms / render_frames, frame->num_rocks);
+	}
+	txtPrint(&hud, HUD_MARGIN, HUD_MARGIN + HUD_SIZE * 0.75f, HUD_SIZE * 0.75f, hud_stats);
+
+	txtFlush(&hud, matrixOrtho2d);
+
+}
+
+/*
+ * Same draw calls as draw_frame, submitted to the software rasterizer.
+ */
+
+void raster_frame(struct rstContext *ctx, struct renderFrame *frame) {
+
+	unsigned int i;
+
+	for(i = 0; i < frame->num_players; i++) {
+		rstTriangles(ctx, &frame->players[i * MODEL_FLOATS], triangle_vertices, 3);
+	}
+
+	for(i = 0; i < frame->num_bullets; i++) {
+		rstTriangles(ctx, &frame->bullets[i * MODEL_FLOATS], triangle_vertices, 3);
+	}
+
+	for(i = 0; i < frame->num_rocks; i++) {
+		rstLineLoop(ctx, &frame->rocks[i * MODEL_FLOATS], rock_vertices, ROCK_VERTICES);
+	}
+
+	rstFlush(ctx);
+
+}
+
+/*
+ * Queue the frame just drawn for --dump, timing what it costs the
+ * render thread.
+ */
+
+void capture_frame() {
+
+	double start;
+
+	if(!capturing){
+		return;
+	}
+
+	start = get_time_ms();
+	capFrame(&capture);
+	capture_ms += get_time_ms() - start;
+
+}
+
+/*
+ * Window is about to go away, last chance to read back with its context.
+ */
+
+void on_close() {
+
+	if(capturing){
+		capFinish(&capture);
+	}
+
+}
+
+/*
+ * Explosions for rocks destroyed this tick, sized by the rock, and a
+ * thrust trail behind the ship while it moves. Uses its own random
+ * stream so effects never touch the replayed game state.
+ */
+
+void emit_particles(struct renderFrame *frame) {
+
+	unsigned int i;
+	const GLfloat *m = frame->players;
+
+	for(i = 0; i < frame->num_bursts; i++) {
+		const GLfloat *b = &frame->bursts[i * 3];
+		ptlSpawn(&particles, b[0], b[1], BURST_PARTICLES << ((unsigned int)b[2] - 1), 3.0, 45.0, &fx_rng);
+	}
+
+	// the nose is model (0, 10), so the tail is 10 units back along y
+	if(frame->thrust){
+		ptlSpawn(&particles, m[A_02] - m[A_01] * 10.0, m[A_12] - m[A_11] * 10.0,
+			THRUST_PARTICLES, 1.5, 20.0, &fx_rng);
+	}
+
+}
+
+/*
+ * Gesture input for this frame, the last mask until a new depth frame
+ * arrives (the camera runs slower than the display).
+ */
+
+unsigned int poll_gesture() {
+
+	if(!kinect_on){
+		return 0;
+	}
+
+	if(kiSourceAcquire(&depth_source)){
+		kiGestureUpdate(&gesture, kiSourceFrame(&depth_source)->depth);
+	}
+	return gesture.mask;
+
+}
+
+void on_timer(int value) {
+	
+	glutPostRedisplay();
+	glutTimerFunc(30, on_timer, 0);
+
+}
+
+int free_resources(){
+
+	int i;
+
+	if(pipelined && render_frames > 0){
+		sim_quit = 1;
+		sem_post(&sim_go);
+		pthread_join(sim_thread, NULL);
+		sem_destroy(&sim_go);
+	}
+
+	if(render_frames > 0){
+		fprintf(stderr, "Frames: %u displayed, %s, sim %.3f ms/frame, main thread %.3f ms/frame, %.2f wrap ghosts/frame\n",
+			render_frames, pipelined ? "pipelined" : "serial",
+			pipelined ? (sim_frames ? sim_ms / sim_frames : 0.0) : 0.0, render_ms / render_frames,
+			(double)ghost_total / render_frames);
+	}
+
+	if(lines.draw_calls > 0){
+		fprintf(stderr, "Lines: %.0f segments/frame in one draw call, %.3f ms/frame, %.1f M segments/s\n",
+			(double)lines.total_segments / lines.draw_calls, line_ms / lines.draw_calls,
+			line_ms > 0.0 ? lines.total_segments / (line_ms * 1000.0) : 0.0);
+	}
+	lnDestroy(&lines);
+
+	if(hud.layouts > 0){
+		fprintf(stderr, "Text: %lu string layouts, %lu cached draws (%.1f%% hit rate)\n",
+			hud.layouts, hud.hits, 100.0 * hud.hits / (hud.hits + hud.layouts));
+	}
+	txtDestroy(&hud);
+
+	if(particles.timed_updates > 0){
+		fprintf(stderr, "Particles: %s, %u slots, %.3f ms/update, %.0f particles/ms\n",
+			particles.backend == PTL_FEEDBACK ? "transform feedback" : (particles.backend == PTL_TEXTURE ? "float textures" : "CPU SIMD"),
+			particles.capacity, particles.update_ms / particles.timed_updates,
+			particles.update_ms > 0.0 ? particles.capacity * particles.timed_updates / particles.update_ms : 0.0);
+	}
+	ptlDestroy(&particles);
+
+	if(bloom.timed_frames > 0){
+		fprintf(stderr, "Bloom: %d levels, GPU ms/frame: scene %.3f, bright %.3f, blur %.3f, upsample %.3f, composite %.3f\n",
+			bloom.levels, bloom.pass_ms[BLM_PASS_SCENE] / bloom.timed_frames,
+			bloom.pass_ms[BLM_PASS_BRIGHT] / bloom.timed_frames, bloom.pass_ms[BLM_PASS_BLUR] / bloom.timed_frames,
+			bloom.pass_ms[BLM_PASS_UPSAMPLE] / bloom.timed_frames, bloom.pass_ms[BLM_PASS_COMPOSITE] / bloom.timed_frames);
+	}
+	blmDestroy(&bloom);
+
+	if(capturing){
+		capDestroy(&capture);
+		fprintf(stderr, "Capture: %u frames to %s, %.3f ms/frame on the render thread, %u writer stalls, %.1f MB\n",
+			capture.retired, dump_file, capture.retired ? capture_ms / capture.retired : 0.0,
+			capture.stalls, capture.bytes_written / (1024.0 * 1024.0));
+		capturing = 0;
+	}
+
+	if(kinect_on){
+		fprintf(stderr, "Kinect: %lu depth frames, %lu dropped, gesture %.3f ms/frame (max %.3f)\n",
+			depth_source.acquired, depth_source.published - depth_source.acquired,
+			gesture.frames ? gesture.total_ms / gesture.frames : 0.0, gesture.max_ms);
+		kiSourceClose(&depth_source);
+		kiGestureDestroy(&gesture);
+		kinect_on = 0;
+	}
+
+	if(net_client_on){
+		fprintf(stderr, "Net: client %d, %lu snapshots, rtt %.1f ms, %lu of %lu inputs acked, %.1f kB/s down\n",
+			net_link.view.id, net_link.snapshots, net_link.peer.rtt_ms, net_link.peer.acked_count, net_link.peer.sent,
+			net_link.peer.bytes_received / (get_time_ms() - net_link.start_ms));
+		netLinkClose(&net_link, get_time_ms());
+		net_client_on = 0;
+	}
+
+	if(replay_mode == REPLAY_RECORD){
+		fprintf(stderr, "Replay: %u ticks, %lu input bytes, %lu keyframe bytes (%lu raw, %.1f%% overhead)\n",
+			replay.tick, replay.input_bytes, replay.keyframe_bytes, replay.raw_state_bytes,
+			replay.input_bytes ? 100.0 * replay.keyframe_bytes / replay.input_bytes : 0.0);
+	}
+	rplClose(&replay);
+	arnDestroy(&frame_arena);
+	plDestroy(&bullets);
+	rckDestroy(&rocks);
+	jobDestroy();
+	for(i = 0; i < 3; i++){
+		destroy_frame(&frames[i]);
+	}
 	
 	return 0;
 
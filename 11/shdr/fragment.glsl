@@ -3,5 +3,6 @@ void main(void) {
 	gl_FragColor[0] = 0.0;
 	gl_FragColor[1] = 0.0;
 	gl_FragColor[2] = 1.0;
+	gl_FragColor[3] = 1.0;
 
 }
@@ -0,0 +1,12 @@
+uniform float halfWidth;
+varying float v_edge;
+
+void main(void) {
+
+	// edge is the distance in pixels from the line center, fade the
+	// last pixel out instead of cutting it off
+	float alpha = clamp(halfWidth + 0.5 - abs(v_edge), 0.0, 1.0);
+
+	gl_FragColor = vec4(0.0, 0.0, 1.0, alpha);
+
+}
@@ -0,0 +1,11 @@
+attribute vec2 coord2d;
+attribute float edge;
+uniform mat4 matrixOrtho2d;
+varying float v_edge;
+
+void main(void) {
+
+	v_edge = edge;
+	gl_Position = matrixOrtho2d * vec4(coord2d, 0.0, 1.0);
+
+}
@@ -0,0 +1,10 @@
+varying float fade;
+
+void main(void) {
+
+	vec2 d = gl_PointCoord - vec2(0.5, 0.5);
+	float alpha = fade * clamp(1.0 - 4.0 * dot(d, d), 0.0, 1.0);
+
+	gl_FragColor = vec4(0.6, 0.8, 1.0, 1.0) * alpha;
+
+}
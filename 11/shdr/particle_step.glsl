@@ -0,0 +1,11 @@
+uniform sampler2D stateMap;
+uniform float drag;
+varying vec2 uv;
+
+void main(void) {
+
+	vec4 state = texture2D(stateMap, uv);
+
+	gl_FragColor = vec4(state.xy + state.zw, state.zw * drag);
+
+}
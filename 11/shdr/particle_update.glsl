@@ -0,0 +1,11 @@
+attribute vec4 state;
+uniform float drag;
+varying vec4 outState;
+
+void main(void) {
+
+	// state is position in xy, velocity in zw
+	outState = vec4(state.xy + state.zw, state.zw * drag);
+	gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+
+}
@@ -0,0 +1,16 @@
+attribute vec4 state;
+attribute vec2 life;
+uniform mat4 matrixOrtho2d;
+uniform float now;
+varying float fade;
+
+void main(void) {
+
+	// life is birth time and time to live, in frames
+	float age = now - life.x;
+	fade = age >= 0.0 && age < life.y ? 1.0 - age / life.y : 0.0;
+
+	gl_PointSize = 1.0 + 3.0 * fade;
+	gl_Position = fade > 0.0 ? matrixOrtho2d * vec4(state.xy, 0.0, 1.0) : vec4(2.0, 2.0, 2.0, 1.0);
+
+}
@@ -0,0 +1,16 @@
+uniform sampler2D source;
+uniform vec2 direction;
+varying vec2 uv;
+
+void main(void) {
+
+	// 9 tap gaussian in 5 fetches, bilinear filtering blends the pairs
+	vec3 sum = texture2D(source, uv).rgb * 0.2270270270;
+	sum += texture2D(source, uv + direction * 1.3846153846).rgb * 0.3162162162;
+	sum += texture2D(source, uv - direction * 1.3846153846).rgb * 0.3162162162;
+	sum += texture2D(source, uv + direction * 3.2307692308).rgb * 0.0702702703;
+	sum += texture2D(source, uv - direction * 3.2307692308).rgb * 0.0702702703;
+
+	gl_FragColor = vec4(sum, 1.0);
+
+}
@@ -0,0 +1,13 @@
+uniform sampler2D source;
+uniform float threshold;
+varying vec2 uv;
+
+void main(void) {
+
+	vec4 color = texture2D(source, uv);
+	float brightness = max(color.r, max(color.g, color.b));
+	float keep = max(brightness - threshold, 0.0) / max(brightness, 0.0001);
+
+	gl_FragColor = vec4(color.rgb * keep, 1.0);
+
+}
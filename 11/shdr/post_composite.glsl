@@ -0,0 +1,12 @@
+uniform sampler2D scene;
+uniform sampler2D bloom;
+uniform float intensity;
+varying vec2 uv;
+
+void main(void) {
+
+	vec3 color = texture2D(scene, uv).rgb + texture2D(bloom, uv).rgb * intensity;
+
+	gl_FragColor = vec4(color, 1.0);
+
+}
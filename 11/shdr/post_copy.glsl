@@ -0,0 +1,9 @@
+uniform sampler2D source;
+uniform float scale;
+varying vec2 uv;
+
+void main(void) {
+
+	gl_FragColor = vec4(texture2D(source, uv).rgb * scale, 1.0);
+
+}
@@ -0,0 +1,9 @@
+attribute vec2 coord2d;
+varying vec2 uv;
+
+void main(void) {
+
+	uv = coord2d * 0.5 + 0.5;
+	gl_Position = vec4(coord2d, 0.0, 1.0);
+
+}
@@ -0,0 +1,14 @@
+uniform sampler2D atlas;
+varying vec2 v_texcoord;
+
+void main(void) {
+
+	// 0.5 in the distance field is the glyph outline, fade over about a
+	// pixel of screen space whatever the text size
+	float d = texture2D(atlas, v_texcoord).r;
+	float w = fwidth(d) * 0.75;
+	float alpha = smoothstep(0.5 - w, 0.5 + w, d);
+
+	gl_FragColor = vec4(0.8, 0.9, 1.0, alpha);
+
+}
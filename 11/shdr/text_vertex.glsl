@@ -0,0 +1,11 @@
+attribute vec2 coord2d;
+attribute vec2 texcoord;
+uniform mat4 matrixOrtho2d;
+varying vec2 v_texcoord;
+
+void main(void) {
+
+	v_texcoord = texcoord;
+	gl_Position = matrixOrtho2d * vec4(coord2d, 0.0, 1.0);
+
+}
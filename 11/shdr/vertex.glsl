@@ -1,10 +1,13 @@
 attribute vec2 coord2d;
+attribute float instance;
 uniform mat4 matrixOrtho2d;
-uniform mat4 matrixModel;
+uniform vec3 modelRows[2 * 32];
 
 void main(void) {
-	
-	vec4 modelPos = matrixModel * vec4(coord2d, 0.0, 1.0);
-	gl_Position = matrixOrtho2d * modelPos;
+
+	int i = int(instance) * 2;
+	vec3 p = vec3(coord2d, 1.0);
+	vec2 modelPos = vec2(dot(modelRows[i], p), dot(modelRows[i + 1], p));
+	gl_Position = matrixOrtho2d * vec4(modelPos, 0.0, 1.0);
 
 }
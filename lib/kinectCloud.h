@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Depth frame to point cloud. Each valid depth pixel is unprojected with
+ * the camera intrinsics (camera space: x right, y down, z forward, in
+ * metres) and then moved into world space by a column-major 4x4 matrix,
+ * indexed with the same M_xx macros as kiMatrixMultiply in kinectGL.h.
+ * Pixels outside [min_mm, max_mm], including the 0 the sensor reports for
+ * no reading, are dropped.
+ *
+ * The converter works four pixels at a time with SSE2 (scalar fallback
+ * otherwise) on tiles of KI_CLOUD_TILE_ROWS rows. Every tile writes into
+ * its own region of the output so tiles can run in parallel: set
+ * parallel_for to a parallel loop such as jobParallelFor and the tiles
+ * are spread over its threads, leave it NULL and they run in order. The
+ * regions are packed together afterwards. kiCloudConvertScalar is the
+ * plain per-pixel reference the fast path is checked against.
+ *
+ * kiCloudVoxelize optionally thins the cloud to one point (the centroid)
+ * per leaf sized cube. The hash table only maps voxel keys to a dense
+ * array of sums and is stamped per call instead of cleared, so the cost
+ * follows the number of points, not the table size.
+ **/
+
+#define KI_CLOUD_TILE_ROWS 		16
+#define KI_CLOUD_SLACK 			4
+#define KI_VOXEL_BIAS 			1048576.0
+
+struct kiIntrinsics {
+	float fx;
+	float fy;
+	float cx;
+	float cy;
+	float min_mm;
+	float max_mm;
+};
+
+struct kiVoxel {
+	uint64_t key;
+	unsigned int stamp;
+	unsigned int index;
+};
+
+struct kiCloud {
+	int width;
+	int height;
+	struct kiIntrinsics intr;
+	GLfloat matrix[16];
+	float *ray_x;
+	float *ray_y;
+	float *points;
+	unsigned int count;
+	unsigned int num_tiles;
+	unsigned int *tile_count;
+	const uint16_t *depth;
+	void (*parallel_for)(unsigned int count, unsigned int grain, void (*func)(void*, unsigned int, unsigned int), void *data);
+
+	struct kiVoxel *voxels;
+	unsigned int voxel_mask;
+	unsigned int stamp;
+	float *voxel_sums;
+	float *voxel_points;
+	unsigned int voxel_count;
+};
+
+void kiDefaultIntrinsics(struct kiIntrinsics *intr, int width, int height);
+void kiCloudCreate(struct kiCloud *cloud, int width, int height, const struct kiIntrinsics *intr);
+void kiCloudDestroy(struct kiCloud *cloud);
+unsigned int kiCloudConvert(struct kiCloud *cloud, const uint16_t *depth);
+unsigned int kiCloudConvertScalar(struct kiCloud *cloud, const uint16_t *depth, float *out);
+unsigned int kiCloudVoxelize(struct kiCloud *cloud, float leaf);
+
+/*
+ * ki default intrinsics (typical Kinect v1 depth camera, scaled to the
+ * frame size, 0.4 to 4.5 m usable range)
+ */
+
+void kiDefaultIntrinsics(struct kiIntrinsics *intr, int width, int height) {
+
+	intr->fx = 580.0f * width / 640.0f;
+	intr->fy = 580.0f * height / 480.0f;
+	intr->cx = (width - 1) * 0.5f;
+	intr->cy = (height - 1) * 0.5f;
+	intr->min_mm = 400.0f;
+	intr->max_mm = 4500.0f;
+
+}
+
+/*
+ * ki cloud create (matrix starts as identity, points stay in camera space
+ * until it is set)
+ */
+
+void kiCloudCreate(struct kiCloud *cloud, int width, int height, const struct kiIntrinsics *intr) {
+
+	unsigned int hash_size = 1;
+	int i;
+
+	memset(cloud, 0, sizeof(struct kiCloud));
+	cloud->width = width;
+	cloud->height = height;
+	cloud->intr = *intr;
+	cloud->num_tiles = (height + KI_CLOUD_TILE_ROWS - 1) / KI_CLOUD_TILE_ROWS;
+
+	for(i = 0; i < 16; i++){
+		cloud->matrix[i] = (i % 5) == 0 ? 1.0f : 0.0f;
+	}
+
+	cloud->ray_x = (float*)malloc(width * sizeof(float));
+	cloud->ray_y = (float*)malloc(height * sizeof(float));
+	for(i = 0; i < width; i++){
+		cloud->ray_x[i] = (i - intr->cx) / intr->fx;
+	}
+	for(i = 0; i < height; i++){
+		cloud->ray_y[i] = (i - intr->cy) / intr->fy;
+	}
+
+	// one region per tile, plus room for the 4th float of the last
+	// unaligned store so neighbouring tiles never share a float
+	cloud->points = (float*)malloc(((size_t)width * height * 3 + cloud->num_tiles * KI_CLOUD_SLACK) * sizeof(float));
+	cloud->tile_count = (unsigned int*)calloc(cloud->num_tiles, sizeof(unsigned int));
+
+	while(hash_size < (unsigned int)(width * height) * 2){
+		hash_size <<= 1;
+	}
+	cloud->voxel_mask = hash_size - 1;
+	cloud->voxels = (struct kiVoxel*)calloc(hash_size, sizeof(struct kiVoxel));
+	cloud->voxel_sums = (float*)malloc((size_t)width * height * 4 * sizeof(float));
+	cloud->voxel_points = (float*)malloc((size_t)width * height * 3 * sizeof(float));
+
+	if(!cloud->ray_x || !cloud->ray_y || !cloud->points || !cloud->tile_count || !cloud->voxels || !cloud->voxel_sums || !cloud->voxel_points){
+		fprintf(stderr, "kiCloudCreate out of memory\n");
+		exit(1);
+	}
+
+}
+
+/*
+ * ki cloud destroy
+ */
+
+void kiCloudDestroy(struct kiCloud *cloud) {
+
+	free(cloud->ray_x);
+	free(cloud->ray_y);
+	free(cloud->points);
+	free(cloud->tile_count);
+	free(cloud->voxels);
+	free(cloud->voxel_sums);
+	free(cloud->voxel_points);
+	memset(cloud, 0, sizeof(struct kiCloud));
+
+}
+
+/*
+ * ki cloud point (one pixel, shared by the scalar reference and the
+ * row tails of the fast path so both round the same way)
+ */
+
+static inline int kiCloudPoint(const struct kiCloud *cloud, float d, float rx, float ry, float *out) {
+
+	const GLfloat *m = cloud->matrix;
+	float x, y, z;
+
+	if(d < cloud->intr.min_mm || d > cloud->intr.max_mm){
+		return 0;
+	}
+
+	z = d * 0.001f;
+	x = rx * z;
+	y = ry * z;
+	out[0] = m[M_00] * x + m[M_01] * y + m[M_02] * z + m[M_03];
+	out[1] = m[M_10] * x + m[M_11] * y + m[M_12] * z + m[M_13];
+	out[2] = m[M_20] * x + m[M_21] * y + m[M_22] * z + m[M_23];
+	return 1;
+
+}
+
+/*
+ * ki cloud tiles (job, converts tiles [begin, end) into their regions)
+ */
+
+static void kiCloudTiles(void *data, unsigned int begin, unsigned int end) {
+
+	struct kiCloud *cloud = (struct kiCloud*)data;
+	int w = cloud->width, u, v, v_end;
+	unsigned int t, n;
+	const uint16_t *row;
+	float *out;
+
+	#ifdef __SSE2__
+	const GLfloat *m = cloud->matrix;
+	__m128 m00 = _mm_set1_ps(m[M_00]), m01 = _mm_set1_ps(m[M_01]), m02 = _mm_set1_ps(m[M_02]), m03 = _mm_set1_ps(m[M_03]);
+	__m128 m10 = _mm_set1_ps(m[M_10]), m11 = _mm_set1_ps(m[M_11]), m12 = _mm_set1_ps(m[M_12]), m13 = _mm_set1_ps(m[M_13]);
+	__m128 m20 = _mm_set1_ps(m[M_20]), m21 = _mm_set1_ps(m[M_21]), m22 = _mm_set1_ps(m[M_22]), m23 = _mm_set1_ps(m[M_23]);
+	__m128 lo = _mm_set1_ps(cloud->intr.min_mm), hi = _mm_set1_ps(cloud->intr.max_mm);
+	__m128 mm = _mm_set1_ps(0.001f), zero = _mm_setzero_ps();
+	__m128i izero = _mm_setzero_si128();
+	__m128 d, x, y, z, ry, wx, wy, wz, ww;
+	float px[4], py[4], pz[4];
+	int mask, lane;
+	#endif
+
+	for(t = begin; t < end; t++) {
+
+		out = cloud->points + ((size_t)t * KI_CLOUD_TILE_ROWS * w * 3 + t * KI_CLOUD_SLACK);
+		n = 0;
+		v = t * KI_CLOUD_TILE_ROWS;
+		v_end = v + KI_CLOUD_TILE_ROWS < cloud->height ? v + KI_CLOUD_TILE_ROWS : cloud->height;
+
+		for(; v < v_end; v++) {
+
+			row = cloud->depth + (size_t)v * w;
+			u = 0;
+
+			#ifdef __SSE2__
+			ry = _mm_set1_ps(cloud->ray_y[v]);
+			for(; u + 4 <= w; u += 4) {
+
+				d = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)&row[u]), izero));
+				mask = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(d, lo), _mm_cmple_ps(d, hi)));
+				if(mask == 0){
+					continue;
+				}
+
+				z = _mm_mul_ps(d, mm);
+				x = _mm_mul_ps(_mm_loadu_ps(&cloud->ray_x[u]), z);
+				y = _mm_mul_ps(ry, z);
+				wx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m01, y)), _mm_mul_ps(m02, z)), m03);
+				wy = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, x), _mm_mul_ps(m11, y)), _mm_mul_ps(m12, z)), m13);
+				wz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, x), _mm_mul_ps(m21, y)), _mm_mul_ps(m22, z)), m23);
+
+				if(mask == 0xf){
+					// xyz_ per register, each store's 4th float is
+					// overwritten by the next point
+					ww = zero;
+					_MM_TRANSPOSE4_PS(wx, wy, wz, ww);
+					_mm_storeu_ps(&out[n * 3 + 0], wx);
+					_mm_storeu_ps(&out[n * 3 + 3], wy);
+					_mm_storeu_ps(&out[n * 3 + 6], wz);
+					_mm_storeu_ps(&out[n * 3 + 9], ww);
+					n += 4;
+					continue;
+				}
+
+				_mm_storeu_ps(px, wx);
+				_mm_storeu_ps(py, wy);
+				_mm_storeu_ps(pz, wz);
+				for(lane = 0; lane < 4; lane++) {
+					if(mask & (1 << lane)){
+						out[n * 3 + 0] = px[lane];
+						out[n * 3 + 1] = py[lane];
+						out[n * 3 + 2] = pz[lane];
+						n++;
+					}
+				}
+
+			}
+			#endif
+
+			for(; u < w; u++) {
+				n += kiCloudPoint(cloud, row[u], cloud->ray_x[u], cloud->ray_y[v], &out[n * 3]);
+			}
+
+		}
+
+		cloud->tile_count[t] = n;
+
+	}
+
+}
+
+/*
+ * ki cloud convert (points and count end up in cloud->points and
+ * cloud->count, returns the count)
+ */
+
+unsigned int kiCloudConvert(struct kiCloud *cloud, const uint16_t *depth) {
+
+	unsigned int t;
+	float *src, *dst;
+
+	cloud->depth = depth;
+	if(cloud->parallel_for != NULL){
+		cloud->parallel_for(cloud->num_tiles, 1, kiCloudTiles, cloud);
+	} else {
+		kiCloudTiles(cloud, 0, cloud->num_tiles);
+	}
+
+	// tile 0 is already in place, the rest slide down behind it
+	cloud->count = cloud->tile_count[0];
+	for(t = 1; t < cloud->num_tiles; t++) {
+		src = cloud->points + ((size_t)t * KI_CLOUD_TILE_ROWS * cloud->width * 3 + t * KI_CLOUD_SLACK);
+		dst = cloud->points + (size_t)cloud->count * 3;
+		memmove(dst, src, cloud->tile_count[t] * 3 * sizeof(float));
+		cloud->count += cloud->tile_count[t];
+	}
+
+	return cloud->count;
+
+}
+
+/*
+ * ki cloud convert scalar (reference, row by row into out, which needs
+ * room for width * height points)
+ */
+
+unsigned int kiCloudConvertScalar(struct kiCloud *cloud, const uint16_t *depth, float *out) {
+
+	unsigned int n = 0;
+	int u, v;
+
+	for(v = 0; v < cloud->height; v++) {
+		for(u = 0; u < cloud->width; u++) {
+			n += kiCloudPoint(cloud, depth[(size_t)v * cloud->width + u], cloud->ray_x[u], cloud->ray_y[v], &out[n * 3]);
+		}
+	}
+
+	return n;
+
+}
+
+/*
+ * ki cloud voxelize (centroid per leaf sized cube of the last converted
+ * cloud into cloud->voxel_points, in first seen order)
+ */
+
+unsigned int kiCloudVoxelize(struct kiCloud *cloud, float leaf) {
+
+	double inv = 1.0 / leaf;
+	unsigned int i, h, idx = 0, n = 0;
+	uint64_t key, last = ~0ull;
+	struct kiVoxel *vx;
+	const float *p;
+	float *acc;
+
+	cloud->stamp++;
+	if(cloud->stamp == 0){
+		memset(cloud->voxels, 0, (cloud->voxel_mask + 1) * sizeof(struct kiVoxel));
+		cloud->stamp = 1;
+	}
+
+	for(i = 0; i < cloud->count; i++) {
+
+		p = &cloud->points[i * 3];
+
+		// biased so truncation floors, floorf is a libm call without SSE4.1
+		key = (((uint64_t)(int64_t)(p[0] * inv + KI_VOXEL_BIAS) & 0x1fffff) << 42) |
+			(((uint64_t)(int64_t)(p[1] * inv + KI_VOXEL_BIAS) & 0x1fffff) << 21) |
+			((uint64_t)(int64_t)(p[2] * inv + KI_VOXEL_BIAS) & 0x1fffff);
+
+		// neighbouring pixels mostly land in the same voxel
+		if(key != last){
+			h = (unsigned int)((key * 0x9e3779b97f4a7c15ull) >> 40) & cloud->voxel_mask;
+			while(1) {
+				vx = &cloud->voxels[h];
+				if(vx->stamp != cloud->stamp){
+					vx->stamp = cloud->stamp;
+					vx->key = key;
+					vx->index = n;
+					memset(&cloud->voxel_sums[n * 4], 0, 4 * sizeof(float));
+					n++;
+					break;
+				}
+				if(vx->key == key){
+					break;
+				}
+				h = (h + 1) & cloud->voxel_mask;
+			}
+			idx = vx->index;
+			last = key;
+		}
+
+		acc = &cloud->voxel_sums[idx * 4];
+		acc[0] += p[0];
+		acc[1] += p[1];
+		acc[2] += p[2];
+		acc[3] += 1.0f;
+
+	}
+
+	for(i = 0; i < n; i++) {
+		acc = &cloud->voxel_sums[i * 4];
+		cloud->voxel_points[i * 3 + 0] = acc[0] / acc[3];
+		cloud->voxel_points[i * 3 + 1] = acc[1] / acc[3];
+		cloud->voxel_points[i * 3 + 2] = acc[2] / acc[3];
+	}
+
+	cloud->voxel_count = n;
+	return n;
+
+}
@@ -0,0 +1,470 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * Depth and color frames from a Kinect style camera. A kiSource hands out
+ * frames through a grab callback; the recorded file source below memory
+ * maps a recording and points each frame straight into the mapping, so
+ * nothing is copied on the way in. A live driver plugs in by providing
+ * its own grab.
+ *
+ * With kiSourceStart(src, 1) a capture thread grabs at the recorded frame
+ * rate and publishes through a lock-free triple buffer; kiSourceAcquire
+ * on the render thread picks up the newest frame and never waits. Frames
+ * the renderer was too slow to see are counted as dropped. Without the
+ * thread kiSourceAcquire grabs the next frame itself, so every frame is
+ * seen once and in order (tests, benchmarks, offline processing).
+ *
+ * kiSourceUpload streams the current frame into GL textures through
+ * orphaned pixel buffer objects: the frame is written once into the
+ * mapped PBO and glTexSubImage2D returns without waiting for the copy.
+ **/
+
+#define KI_DEPTH_WIDTH 			640
+#define KI_DEPTH_HEIGHT 		480
+#define KI_RECORD_MAGIC 		"KIR1"
+#define KI_RECORD_COLOR 		0x1
+#define KI_FRESH 				0x4
+#define KI_INDEX 				0x3
+
+struct kiRecordHeader {
+	char magic[4];
+	uint32_t width;
+	uint32_t height;
+	uint32_t fps;
+	uint32_t frames;
+	uint32_t flags;
+};
+
+struct kiFrame {
+	const uint16_t *depth;
+	const uint8_t *color;
+	unsigned int number;
+	double time_ms;
+};
+
+struct kiSource {
+	int width;
+	int height;
+	int fps;
+	int has_color;
+	int (*grab)(struct kiSource *src, struct kiFrame *frame);
+	void (*close)(struct kiSource *src);
+
+	// recorded file
+	int fd;
+	uint8_t *map;
+	size_t map_size;
+	unsigned int num_frames;
+	unsigned int next;
+	int loop;
+
+	// triple buffer exchange, same scheme as the pp pipe
+	struct kiFrame frames[3];
+	int front;
+	int back;
+	int middle;
+	int threaded;
+	int eof;
+	volatile int quit;
+	pthread_t thread;
+	unsigned long published;
+	unsigned long acquired;
+
+	// GL upload
+	GLuint depth_tex;
+	GLuint color_tex;
+	GLuint pbo[2];
+	unsigned long uploads;
+};
+
+struct kiRecorder {
+	FILE *fp;
+	struct kiRecordHeader header;
+};
+
+int kiRecordCreate(struct kiRecorder *rec, const char *filename, int width, int height, int fps, int has_color);
+void kiRecordFrame(struct kiRecorder *rec, const uint16_t *depth, const uint8_t *color);
+void kiRecordClose(struct kiRecorder *rec);
+
+int kiSourceOpenFile(struct kiSource *src, const char *filename, int loop);
+void kiSourceStart(struct kiSource *src, int threaded);
+int kiSourceAcquire(struct kiSource *src);
+const struct kiFrame* kiSourceFrame(struct kiSource *src);
+void kiSourceUpload(struct kiSource *src);
+void kiSourceClose(struct kiSource *src);
+
+/*
+ * ki record create (frame count is patched in by kiRecordClose)
+ */
+
+int kiRecordCreate(struct kiRecorder *rec, const char *filename, int width, int height, int fps, int has_color) {
+
+	memset(rec, 0, sizeof(struct kiRecorder));
+	rec->fp = fopen(filename, "wb");
+	if(rec->fp == NULL){
+		fprintf(stderr, "Could not open %s\n", filename);
+		return -1;
+	}
+
+	memcpy(rec->header.magic, KI_RECORD_MAGIC, 4);
+	rec->header.width = width;
+	rec->header.height = height;
+	rec->header.fps = fps;
+	rec->header.flags = has_color ? KI_RECORD_COLOR : 0;
+	fwrite(&rec->header, sizeof(struct kiRecordHeader), 1, rec->fp);
+	return 0;
+
+}
+
+/*
+ * ki record frame (depth in millimetres, 0 for no reading, color RGB8)
+ */
+
+void kiRecordFrame(struct kiRecorder *rec, const uint16_t *depth, const uint8_t *color) {
+
+	size_t pixels = (size_t)rec->header.width * rec->header.height;
+
+	fwrite(depth, sizeof(uint16_t), pixels, rec->fp);
+	if(rec->header.flags & KI_RECORD_COLOR){
+		fwrite(color, 3, pixels, rec->fp);
+	}
+	rec->header.frames++;
+
+}
+
+/*
+ * ki record close
+ */
+
+void kiRecordClose(struct kiRecorder *rec) {
+
+	if(rec->fp == NULL){
+		return;
+	}
+
+	fseek(rec->fp, 0, SEEK_SET);
+	fwrite(&rec->header, sizeof(struct kiRecordHeader), 1, rec->fp);
+	fclose(rec->fp);
+	rec->fp = NULL;
+
+}
+
+/*
+ * ki file grab (points the frame into the mapping, no copy)
+ */
+
+static int kiFileGrab(struct kiSource *src, struct kiFrame *frame) {
+
+	size_t pixels = (size_t)src->width * src->height;
+	size_t stride = pixels * (2 + (src->has_color ? 3 : 0));
+	const uint8_t *p;
+
+	if(src->next == src->num_frames){
+		if(!src->loop || src->num_frames == 0){
+			return 0;
+		}
+		src->next = 0;
+	}
+
+	p = src->map + sizeof(struct kiRecordHeader) + stride * src->next;
+	frame->depth = (const uint16_t*)p;
+	frame->color = src->has_color ? p + pixels * 2 : NULL;
+	frame->number = src->next++;
+	return 1;
+
+}
+
+/*
+ * ki file close
+ */
+
+static void kiFileClose(struct kiSource *src) {
+
+	munmap(src->map, src->map_size);
+	close(src->fd);
+
+}
+
+/*
+ * ki source open file (recording written by kiRecordCreate, loop restarts
+ * it at the end instead of reporting eof)
+ */
+
+int kiSourceOpenFile(struct kiSource *src, const char *filename, int loop) {
+
+	struct kiRecordHeader header;
+	struct stat st;
+	size_t stride;
+
+	memset(src, 0, sizeof(struct kiSource));
+
+	src->fd = open(filename, O_RDONLY);
+	if(src->fd < 0 || fstat(src->fd, &st) != 0 || (size_t)st.st_size < sizeof(header)){
+		fprintf(stderr, "Could not open %s\n", filename);
+		if(src->fd >= 0){
+			close(src->fd);
+		}
+		return -1;
+	}
+
+	src->map_size = st.st_size;
+	src->map = (uint8_t*)mmap(NULL, src->map_size, PROT_READ, MAP_PRIVATE, src->fd, 0);
+	if(src->map == MAP_FAILED){
+		fprintf(stderr, "Could not map %s\n", filename);
+		close(src->fd);
+		return -1;
+	}
+
+	memcpy(&header, src->map, sizeof(header));
+	stride = (size_t)header.width * header.height * (2 + ((header.flags & KI_RECORD_COLOR) ? 3 : 0));
+	if(memcmp(header.magic, KI_RECORD_MAGIC, 4) != 0 || stride == 0 ||
+		sizeof(header) + stride * header.frames > src->map_size){
+		fprintf(stderr, "%s is not a depth recording\n", filename);
+		munmap(src->map, src->map_size);
+		close(src->fd);
+		return -1;
+	}
+
+	// frames are read front to back, once or in a loop
+	madvise(src->map, src->map_size, MADV_SEQUENTIAL);
+
+	src->width = header.width;
+	src->height = header.height;
+	src->fps = header.fps ? header.fps : 30;
+	src->has_color = (header.flags & KI_RECORD_COLOR) != 0;
+	src->num_frames = header.frames;
+	src->loop = loop;
+	src->grab = kiFileGrab;
+	src->close = kiFileClose;
+	return 0;
+
+}
+
+static double kiTimeMs() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+
+}
+
+/*
+ * ki publish (producer side of the triple buffer)
+ */
+
+static void kiPublish(struct kiSource *src) {
+
+	int prev = __atomic_exchange_n(&src->middle, src->back | KI_FRESH, __ATOMIC_ACQ_REL);
+	src->back = prev & KI_INDEX;
+	src->published++;
+
+}
+
+/*
+ * ki capture (thread, grabs on the source's frame clock until quit or
+ * the end of a non looping source)
+ */
+
+static void* kiCapture(void *arg) {
+
+	struct kiSource *src = (struct kiSource*)arg;
+	double period = 1000.0 / src->fps, due = kiTimeMs();
+	struct timespec ts;
+	double wait;
+
+	while(!src->quit) {
+
+		if(!src->grab(src, &src->frames[src->back])){
+			__atomic_store_n(&src->eof, 1, __ATOMIC_RELEASE);
+			break;
+		}
+		src->frames[src->back].time_ms = kiTimeMs();
+		kiPublish(src);
+
+		due += period;
+		wait = due - kiTimeMs();
+		if(wait > 0.0){
+			ts.tv_sec = (time_t)(wait / 1000.0);
+			ts.tv_nsec = (long)((wait - ts.tv_sec * 1000.0) * 1000000.0);
+			nanosleep(&ts, NULL);
+		} else {
+			due = kiTimeMs();
+		}
+
+	}
+
+	return NULL;
+
+}
+
+/*
+ * ki source start (threaded follows the source's frame rate, otherwise
+ * each kiSourceAcquire grabs the next frame in order)
+ */
+
+void kiSourceStart(struct kiSource *src, int threaded) {
+
+	src->front = 0;
+	src->middle = 1;
+	src->back = 2;
+	src->threaded = threaded;
+
+	if(threaded){
+		pthread_create(&src->thread, NULL, kiCapture, src);
+	}
+
+}
+
+/*
+ * ki source acquire (returns 1 if the front frame changed, 0 if nothing
+ * new arrived or the source ended, check src->eof)
+ */
+
+int kiSourceAcquire(struct kiSource *src) {
+
+	int prev;
+
+	if(!src->threaded){
+		if(src->eof || !src->grab(src, &src->frames[src->front])){
+			src->eof = 1;
+			return 0;
+		}
+		src->frames[src->front].time_ms = kiTimeMs();
+		src->published++;
+		src->acquired++;
+		return 1;
+	}
+
+	if(!(__atomic_load_n(&src->middle, __ATOMIC_ACQUIRE) & KI_FRESH)){
+		return 0;
+	}
+
+	prev = __atomic_exchange_n(&src->middle, src->front, __ATOMIC_ACQ_REL);
+	src->front = prev & KI_INDEX;
+	src->acquired++;
+	return 1;
+
+}
+
+/*
+ * ki source frame (the last acquired frame, valid until the next
+ * kiSourceAcquire)
+ */
+
+const struct kiFrame* kiSourceFrame(struct kiSource *src) {
+
+	return &src->frames[src->front];
+
+}
+
+/*
+ * ki upload plane (orphan, write through the mapping, texture from the
+ * PBO; the driver schedules the transfer and we don't wait for it)
+ */
+
+static void kiUploadPlane(GLuint pbo, GLuint tex, int width, int height, GLenum format, GLenum type, const void *pixels, size_t size) {
+
+	void *dst;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+	dst = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+	if(dst == NULL){
+		return;
+	}
+	memcpy(dst, pixels, size);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, 0);
+
+}
+
+static GLuint kiCreateTexture(int width, int height, GLint internal, GLenum format, GLenum type) {
+
+	GLuint tex;
+
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, internal, width, height, 0, format, type, NULL);
+	return tex;
+
+}
+
+/*
+ * ki source upload (front frame into depth_tex, 16 bit luminance in
+ * millimetres, and color_tex if recorded; textures are created on the
+ * first call, GL context must be current)
+ */
+
+void kiSourceUpload(struct kiSource *src) {
+
+	const struct kiFrame *frame = &src->frames[src->front];
+	size_t pixels = (size_t)src->width * src->height;
+
+	if(frame->depth == NULL){
+		return;
+	}
+
+	if(src->depth_tex == 0){
+		src->depth_tex = kiCreateTexture(src->width, src->height, GL_LUMINANCE16, GL_LUMINANCE, GL_UNSIGNED_SHORT);
+		if(src->has_color){
+			src->color_tex = kiCreateTexture(src->width, src->height, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE);
+		}
+		glGenBuffers(2, src->pbo);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	kiUploadPlane(src->pbo[0], src->depth_tex, src->width, src->height, GL_LUMINANCE, GL_UNSIGNED_SHORT, frame->depth, pixels * 2);
+	if(frame->color != NULL){
+		kiUploadPlane(src->pbo[1], src->color_tex, src->width, src->height, GL_RGB, GL_UNSIGNED_BYTE, frame->color, pixels * 3);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	src->uploads++;
+
+}
+
+/*
+ * ki source close (stops the capture thread, deletes GL objects if any
+ * were created, so the context must still be current in that case)
+ */
+
+void kiSourceClose(struct kiSource *src) {
+
+	if(src->grab == NULL){
+		return;
+	}
+
+	if(src->threaded){
+		src->quit = 1;
+		pthread_join(src->thread, NULL);
+	}
+
+	if(src->depth_tex){
+		glDeleteTextures(1, &src->depth_tex);
+		if(src->color_tex){
+			glDeleteTextures(1, &src->color_tex);
+		}
+		glDeleteBuffers(2, src->pbo);
+	}
+
+	if(src->close != NULL){
+		src->close(src);
+	}
+	src->grab = NULL;
+
+}
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Body steering from a depth stream. Every frame the depth image is
+ * sampled on a KI_GESTURE_STEP grid and a histogram finds the nearest
+ * surface that is more than noise. Grid cells within band_mm behind it
+ * are split into 4-connected blobs and the largest one is the player
+ * (usually a hand or the whole body, whichever is in front).
+ *
+ * Its centroid is smoothed with an exponential filter and mapped onto
+ * the same masks as gamepad_utils.h: leaving the dead zone left, right,
+ * up or down holds GAMEPAD_LEFT/RIGHT/UP/DOWN, and pushing towards the
+ * camera by push_mm past the slowly adapting rest depth holds button A.
+ * Each state is released only once the position falls back to release
+ * times its threshold, so a hand resting on the edge doesn't flicker.
+ * Losing the blob for KI_GESTURE_LOST frames releases everything.
+ *
+ * The image is mirrored by default so moving your right hand steers
+ * right when facing the camera.
+ **/
+
+#define KI_GESTURE_STEP 		2
+#define KI_GESTURE_BIN_MM 		50
+#define KI_GESTURE_MAX_MM 		4500
+#define KI_GESTURE_BINS 		(KI_GESTURE_MAX_MM / KI_GESTURE_BIN_MM + 1)
+#define KI_GESTURE_NOISE 		16
+#define KI_GESTURE_LOST 		10
+
+// same bits as the GAMEPAD_*_MASK values in gamepad_utils.h
+#define KI_GESTURE_LEFT 		0x100
+#define KI_GESTURE_RIGHT 		0x200
+#define KI_GESTURE_UP 			0x400
+#define KI_GESTURE_DOWN 		0x800
+#define KI_GESTURE_BUTTON_A 	0x01
+
+struct kiGesture {
+	int width;
+	int height;
+	int gw;
+	int gh;
+	float min_mm;
+	float band_mm;
+	unsigned int min_pixels;
+	float dead_zone;
+	float release;
+	float smoothing;
+	float push_mm;
+	float rest_rate;
+	int mirror;
+
+	uint16_t *grid;
+	uint8_t *visited;
+	int *stack;
+	unsigned int hist[KI_GESTURE_BINS];
+
+	int tracking;
+	unsigned int lost;
+	float x;
+	float y;
+	float depth;
+	float rest_depth;
+	unsigned int blob_pixels;
+	unsigned int mask;
+
+	unsigned long frames;
+	double total_ms;
+	double max_ms;
+};
+
+void kiGestureCreate(struct kiGesture *g, int width, int height);
+void kiGestureDestroy(struct kiGesture *g);
+unsigned int kiGestureUpdate(struct kiGesture *g, const uint16_t *depth);
+
+/*
+ * ki gesture create (defaults suit a player 1 to 3 m from the camera)
+ */
+
+void kiGestureCreate(struct kiGesture *g, int width, int height) {
+
+	memset(g, 0, sizeof(struct kiGesture));
+	g->width = width;
+	g->height = height;
+	g->gw = width / KI_GESTURE_STEP;
+	g->gh = height / KI_GESTURE_STEP;
+	g->min_mm = 400.0f;
+	g->band_mm = 200.0f;
+	g->min_pixels = 200;
+	g->dead_zone = 0.2f;
+	g->release = 0.7f;
+	g->smoothing = 0.5f;
+	g->push_mm = 250.0f;
+	g->rest_rate = 0.02f;
+	g->mirror = 1;
+
+	g->grid = (uint16_t*)malloc(g->gw * g->gh * sizeof(uint16_t));
+	g->visited = (uint8_t*)malloc(g->gw * g->gh);
+	g->stack = (int*)malloc(g->gw * g->gh * sizeof(int));
+
+	if(g->grid == NULL || g->visited == NULL || g->stack == NULL){
+		fprintf(stderr, "kiGestureCreate out of memory\n");
+		exit(1);
+	}
+
+	// fault the pages in now rather than in the first timed frame
+	memset(g->grid, 0, g->gw * g->gh * sizeof(uint16_t));
+	memset(g->stack, 0, g->gw * g->gh * sizeof(int));
+
+}
+
+/*
+ * ki gesture destroy
+ */
+
+void kiGestureDestroy(struct kiGesture *g) {
+
+	free(g->grid);
+	free(g->visited);
+	free(g->stack);
+	memset(g, 0, sizeof(struct kiGesture));
+
+}
+
+/*
+ * ki gesture axis (hysteresis on one signed axis, returns neg_mask,
+ * pos_mask or 0)
+ */
+
+static unsigned int kiGestureAxis(const struct kiGesture *g, float v, unsigned int neg_mask, unsigned int pos_mask) {
+
+	float hold = g->dead_zone * g->release;
+
+	if(v < -g->dead_zone || ((g->mask & neg_mask) && v < -hold)){
+		return neg_mask;
+	}
+	if(v > g->dead_zone || ((g->mask & pos_mask) && v > hold)){
+		return pos_mask;
+	}
+	return 0;
+
+}
+
+/*
+ * ki gesture update (one depth frame in, packed gamepad mask out)
+ */
+
+unsigned int kiGestureUpdate(struct kiGesture *g, const uint16_t *depth) {
+
+	struct timespec t0, t1;
+	unsigned int i, sum, best = 0, size, top;
+	float near_mm = 0.0f, far_mm, cx, cy, cd, push, ms;
+	double su, sv, sd, best_u = 0.0, best_v = 0.0, best_d = 0.0;
+	int u, v, k, n = g->gw * g->gh;
+	uint16_t d;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	memset(g->hist, 0, sizeof(g->hist));
+	for(v = 0; v < g->gh; v++) {
+		const uint16_t *row = depth + (size_t)v * KI_GESTURE_STEP * g->width;
+		for(u = 0; u < g->gw; u++) {
+			d = row[u * KI_GESTURE_STEP];
+			if(d < g->min_mm || d >= KI_GESTURE_MAX_MM){
+				d = 0;
+			} else {
+				g->hist[d / KI_GESTURE_BIN_MM]++;
+			}
+			g->grid[v * g->gw + u] = d;
+		}
+	}
+
+	// nearest bin that isn't a few stray pixels
+	for(i = 0, sum = 0; i < KI_GESTURE_BINS; i++) {
+		sum += g->hist[i];
+		if(sum >= KI_GESTURE_NOISE){
+			near_mm = (float)(i * KI_GESTURE_BIN_MM);
+			break;
+		}
+	}
+	far_mm = near_mm + KI_GESTURE_BIN_MM + g->band_mm;
+
+	// largest 4-connected blob in the near band
+	memset(g->visited, 0, n);
+	for(i = 0; sum >= KI_GESTURE_NOISE && i < (unsigned int)n; i++) {
+
+		if(g->visited[i] || g->grid[i] == 0 || g->grid[i] > far_mm){
+			continue;
+		}
+
+		size = 0;
+		su = sv = sd = 0.0;
+		top = 0;
+		g->stack[top++] = i;
+		g->visited[i] = 1;
+
+		while(top > 0) {
+
+			k = g->stack[--top];
+			u = k % g->gw;
+			v = k / g->gw;
+			size++;
+			su += u;
+			sv += v;
+			sd += g->grid[k];
+
+			#define KI_VISIT(j) if(!g->visited[j] && g->grid[j] != 0 && g->grid[j] <= far_mm){ g->visited[j] = 1; g->stack[top++] = j; }
+			if(u > 0) { KI_VISIT(k - 1); }
+			if(u < g->gw - 1) { KI_VISIT(k + 1); }
+			if(v > 0) { KI_VISIT(k - g->gw); }
+			if(v < g->gh - 1) { KI_VISIT(k + g->gw); }
+			#undef KI_VISIT
+
+		}
+
+		if(size > best){
+			best = size;
+			best_u = su / size;
+			best_v = sv / size;
+			best_d = sd / size;
+		}
+
+	}
+
+	g->blob_pixels = best;
+
+	if(best >= g->min_pixels){
+
+		cx = (float)(best_u / (g->gw - 1)) * 2.0f - 1.0f;
+		cy = (float)(best_v / (g->gh - 1)) * 2.0f - 1.0f;
+		cd = (float)best_d;
+		cx = g->mirror ? -cx : cx;
+
+		if(!g->tracking){
+			g->x = cx;
+			g->y = cy;
+			g->depth = cd;
+			g->rest_depth = cd;
+			g->tracking = 1;
+		} else {
+			g->x += g->smoothing * (cx - g->x);
+			g->y += g->smoothing * (cy - g->y);
+			g->depth += g->smoothing * (cd - g->depth);
+		}
+		g->lost = 0;
+
+		push = g->rest_depth - g->depth;
+		if(push < g->push_mm * g->release){
+			g->rest_depth += g->rest_rate * (g->depth - g->rest_depth);
+		}
+
+		// image y grows downwards
+		g->mask = kiGestureAxis(g, g->x, KI_GESTURE_LEFT, KI_GESTURE_RIGHT) |
+			kiGestureAxis(g, g->y, KI_GESTURE_UP, KI_GESTURE_DOWN) |
+			((push > g->push_mm || ((g->mask & KI_GESTURE_BUTTON_A) && push > g->push_mm * g->release)) ? KI_GESTURE_BUTTON_A : 0);
+
+	} else if(g->tracking && ++g->lost >= KI_GESTURE_LOST){
+		g->tracking = 0;
+		g->mask = 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ms = (t1.tv_sec - t0.tv_sec) * 1000.0f + (t1.tv_nsec - t0.tv_nsec) / 1000000.0f;
+	g->total_ms += ms;
+	g->max_ms = ms > g->max_ms ? ms : g->max_ms;
+	g->frames++;
+
+	return g->mask;
+
+}
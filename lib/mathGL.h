@@ -0,0 +1,691 @@
+#ifndef MATH_GL_H
+#define MATH_GL_H
+
+#include <string.h>
+#include <math.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Shared vector, matrix and quaternion math for every stage. Matrices are
+ * column-major float[16] (or float[9] for mat3) indexed with the M_xx
+ * macros, so they go straight to glUniformMatrix4fv and mix freely with
+ * GLfloat arrays from mtx_utils.h and kinectGL.h. The mat4 functions take
+ * plain float pointers for that reason; struct mthMat4 is there when a
+ * 16 byte aligned matrix of your own is wanted.
+ *
+ * mthMat4Multiply does one column per SSE register and adds the four
+ * products in the same order as the scalar code, so both give the same
+ * bits (no FMA contraction at the default -O2). The translate, scale and
+ * rotate helpers post-multiply in place like their mtx counterparts but
+ * only touch the columns that change instead of building and multiplying
+ * a whole matrix. Small vector operations are static inline.
+ *
+ * For flat 2D work there is also a six float affine transform stored as
+ * two rows (a b tx) (c d ty), indexed with the A_xx macros. That is the
+ * layout a vertex shader reads as two vec3 uniforms, so an array of them
+ * uploads with a single glUniform3fv, 6 floats per object instead of 16.
+ *
+ * Rotations come in degrees, so the float sincos functions take degrees
+ * too. Reducing by whole quarter turns in degrees is exact, after which a
+ * minimax polynomial on +-45 degrees gives sin and cos to within a few
+ * float ulps (mthSinCosDeg, four at a time with SSE2 in
+ * mthSinCosDegBatch). mthSinCosDegTable interpolates a MTH_SIN_TABLE
+ * entry table instead, a little cheaper per call but only good to about
+ * 1e-6.
+ **/
+
+#ifndef M_00
+#define M_00 0x00
+#define M_10 0x01
+#define M_20 0x02
+#define M_30 0x03
+#define M_01 0x04
+#define M_11 0x05
+#define M_21 0x06
+#define M_31 0x07
+#define M_02 0x08
+#define M_12 0x09
+#define M_22 0x0a
+#define M_32 0x0b
+#define M_03 0x0c
+#define M_13 0x0d
+#define M_23 0x0e
+#define M_33 0x0f
+#endif
+
+#define MTH_SIN_TABLE 1024
+
+#define A_00 0x00
+#define A_01 0x01
+#define A_02 0x02
+#define A_10 0x03
+#define A_11 0x04
+#define A_12 0x05
+
+struct mthVec2 {
+	float x;
+	float y;
+};
+
+struct mthVec3 {
+	float x;
+	float y;
+	float z;
+};
+
+struct mthQuat {
+	float x;
+	float y;
+	float z;
+	float w;
+};
+
+struct mthMat3 {
+	float m[9];
+};
+
+struct mthMat4 {
+	float m[16];
+} __attribute__((aligned(16)));
+
+void mthMat3Identity(float *m);
+void mthMat3Multiply(float *out, const float *a, const float *b);
+void mthMat3FromMat4(float *out, const float *m);
+void mthMat4Identity(float *m);
+void mthMat4Ortho(float *m, float left, float right, float bottom, float top, float near_z, float far_z);
+int mthMat4InvertAffine(float *out, const float *m);
+void mthSinCosDegBatch(const float *degrees, float *s, float *c, unsigned int count);
+void mthSinCosTableInit();
+void mthAffine2Identity(float *m);
+void mthAffine2Compose(float *out, const float *a, const float *b);
+int mthAffine2Invert(float *out, const float *m);
+void mthAffine2ToMat4(float *out, const float *m);
+void mthMat4FromQuat(float *m, struct mthQuat q);
+struct mthQuat mthQuatFromAxisAngle(struct mthVec3 axis, float radians);
+struct mthQuat mthQuatMultiply(struct mthQuat a, struct mthQuat b);
+struct mthQuat mthQuatSlerp(struct mthQuat a, struct mthQuat b, float t);
+
+static float mth_sin_table[MTH_SIN_TABLE + 1];
+
+/*
+ * vec2
+ */
+
+static inline struct mthVec2 mthVec2Make(float x, float y) {
+	struct mthVec2 v = { x, y };
+	return v;
+}
+
+static inline struct mthVec2 mthVec2Add(struct mthVec2 a, struct mthVec2 b) {
+	return mthVec2Make(a.x + b.x, a.y + b.y);
+}
+
+static inline struct mthVec2 mthVec2Sub(struct mthVec2 a, struct mthVec2 b) {
+	return mthVec2Make(a.x - b.x, a.y - b.y);
+}
+
+static inline struct mthVec2 mthVec2Scale(struct mthVec2 a, float s) {
+	return mthVec2Make(a.x * s, a.y * s);
+}
+
+static inline float mthVec2Dot(struct mthVec2 a, struct mthVec2 b) {
+	return a.x * b.x + a.y * b.y;
+}
+
+static inline float mthVec2Length(struct mthVec2 a) {
+	return sqrtf(a.x * a.x + a.y * a.y);
+}
+
+// rotate by the angle whose cosine and sine are c and s
+static inline struct mthVec2 mthVec2Rotate(struct mthVec2 a, float c, float s) {
+	return mthVec2Make(a.x * c - a.y * s, a.x * s + a.y * c);
+}
+
+/*
+ * vec3
+ */
+
+static inline struct mthVec3 mthVec3Make(float x, float y, float z) {
+	struct mthVec3 v = { x, y, z };
+	return v;
+}
+
+static inline struct mthVec3 mthVec3Add(struct mthVec3 a, struct mthVec3 b) {
+	return mthVec3Make(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+static inline struct mthVec3 mthVec3Sub(struct mthVec3 a, struct mthVec3 b) {
+	return mthVec3Make(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static inline struct mthVec3 mthVec3Scale(struct mthVec3 a, float s) {
+	return mthVec3Make(a.x * s, a.y * s, a.z * s);
+}
+
+static inline float mthVec3Dot(struct mthVec3 a, struct mthVec3 b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline struct mthVec3 mthVec3Cross(struct mthVec3 a, struct mthVec3 b) {
+	return mthVec3Make(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+static inline float mthVec3Length(struct mthVec3 a) {
+	return sqrtf(mthVec3Dot(a, a));
+}
+
+static inline struct mthVec3 mthVec3Normalize(struct mthVec3 a) {
+	float len = mthVec3Length(a);
+	return len > 0.0f ? mthVec3Scale(a, 1.0f / len) : a;
+}
+
+/*
+ * mth sincos deg (quarter turn q = rint(degrees / 90), remainder in
+ * radians through the cephes sinf / cosf minimax polynomials, then
+ * rotated back by q)
+ */
+
+#define MTH_SIN_P0 -1.6666654611e-1f
+#define MTH_SIN_P1 8.3321608736e-3f
+#define MTH_SIN_P2 -1.9515295891e-4f
+#define MTH_COS_P0 4.166664568298827e-2f
+#define MTH_COS_P1 -1.388731625493765e-3f
+#define MTH_COS_P2 2.443315711809948e-5f
+#define MTH_DEG_TO_RAD 0.017453292519943295f
+
+static inline void mthSinCosDeg(float degrees, float *s, float *c) {
+
+	float k = rintf(degrees * (1.0f / 90.0f));
+	float r = (degrees - k * 90.0f) * MTH_DEG_TO_RAD;
+	float r2 = r * r;
+	float ps = r + r * r2 * (MTH_SIN_P0 + r2 * (MTH_SIN_P1 + r2 * MTH_SIN_P2));
+	float pc = 1.0f - 0.5f * r2 + r2 * r2 * (MTH_COS_P0 + r2 * (MTH_COS_P1 + r2 * MTH_COS_P2));
+	int q = (int)k & 3;
+
+	*s = q == 0 ? ps : q == 1 ? pc : q == 2 ? -ps : -pc;
+	*c = q == 0 ? pc : q == 1 ? -ps : q == 2 ? -pc : ps;
+
+}
+
+/*
+ * mth sincos deg batch (count angles, four lanes at a time with the same
+ * rounding and polynomial as mthSinCosDeg so results match it bit for
+ * bit, the quadrant handled with masks instead of branches)
+ */
+
+void mthSinCosDegBatch(const float *degrees, float *s, float *c, unsigned int count) {
+
+	unsigned int i = 0;
+
+	#ifdef __SSE2__
+	const __m128 inv90 = _mm_set1_ps(1.0f / 90.0f), ninety = _mm_set1_ps(90.0f);
+	const __m128 to_rad = _mm_set1_ps(MTH_DEG_TO_RAD), one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+	const __m128i one_i = _mm_set1_epi32(1), two_i = _mm_set1_epi32(2);
+
+	for(; i + 4 <= count; i += 4) {
+
+		__m128 d = _mm_loadu_ps(&degrees[i]);
+		__m128i q = _mm_cvtps_epi32(_mm_mul_ps(d, inv90));
+		__m128 r = _mm_mul_ps(_mm_sub_ps(d, _mm_mul_ps(_mm_cvtepi32_ps(q), ninety)), to_rad);
+		__m128 r2 = _mm_mul_ps(r, r);
+		__m128 ps, pc, swap, sin_sign, cos_sign, vs, vc;
+
+		ps = _mm_add_ps(_mm_set1_ps(MTH_SIN_P1), _mm_mul_ps(r2, _mm_set1_ps(MTH_SIN_P2)));
+		ps = _mm_add_ps(_mm_set1_ps(MTH_SIN_P0), _mm_mul_ps(r2, ps));
+		ps = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), ps));
+		pc = _mm_add_ps(_mm_set1_ps(MTH_COS_P1), _mm_mul_ps(r2, _mm_set1_ps(MTH_COS_P2)));
+		pc = _mm_add_ps(_mm_set1_ps(MTH_COS_P0), _mm_mul_ps(r2, pc));
+		pc = _mm_add_ps(_mm_sub_ps(one, _mm_mul_ps(half, r2)), _mm_mul_ps(_mm_mul_ps(r2, r2), pc));
+
+		// odd quadrants swap sin and cos, bit 1 of q (q + 1 for cos) flips the sign
+		swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one_i), one_i));
+		sin_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two_i), 30));
+		cos_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one_i), two_i), 30));
+		vs = _mm_or_ps(_mm_and_ps(swap, pc), _mm_andnot_ps(swap, ps));
+		vc = _mm_or_ps(_mm_and_ps(swap, ps), _mm_andnot_ps(swap, pc));
+		_mm_storeu_ps(&s[i], _mm_xor_ps(vs, sin_sign));
+		_mm_storeu_ps(&c[i], _mm_xor_ps(vc, cos_sign));
+
+	}
+	#endif
+
+	for(; i < count; i++) {
+		mthSinCosDeg(degrees[i], &s[i], &c[i]);
+	}
+
+}
+
+/*
+ * mth sincos table init (fills the table mthSinCosDegTable reads, call
+ * once before using it)
+ */
+
+void mthSinCosTableInit() {
+
+	int i;
+
+	for(i = 0; i <= MTH_SIN_TABLE; i++) {
+		mth_sin_table[i] = (float)sin(i * (2.0 * M_PI / MTH_SIN_TABLE));
+	}
+
+}
+
+/*
+ * mth sincos deg table (linear interpolation, cos read a quarter turn on)
+ */
+
+static inline void mthSinCosDegTable(float degrees, float *s, float *c) {
+
+	float t = degrees * (MTH_SIN_TABLE / 360.0f);
+	float k = floorf(t);
+	float f = t - k;
+	unsigned int i = (unsigned int)(int)k & (MTH_SIN_TABLE - 1);
+	unsigned int j = (i + MTH_SIN_TABLE / 4) & (MTH_SIN_TABLE - 1);
+
+	*s = mth_sin_table[i] + f * (mth_sin_table[i + 1] - mth_sin_table[i]);
+	*c = mth_sin_table[j] + f * (mth_sin_table[j + 1] - mth_sin_table[j]);
+
+}
+
+/*
+ * mat3 (column-major, element (row r, column c) at c * 3 + r)
+ */
+
+void mthMat3Identity(float *m) {
+
+	memset(m, 0, 9 * sizeof(float));
+	m[0] = m[4] = m[8] = 1.0f;
+
+}
+
+void mthMat3Multiply(float *out, const float *a, const float *b) {
+
+	float p[9];
+	int r, c;
+
+	for(c = 0; c < 3; c++) {
+		for(r = 0; r < 3; r++) {
+			p[c * 3 + r] = a[r] * b[c * 3] + a[3 + r] * b[c * 3 + 1] + a[6 + r] * b[c * 3 + 2];
+		}
+	}
+	memcpy(out, p, sizeof(p));
+
+}
+
+static inline struct mthVec3 mthMat3Transform(const float *m, struct mthVec3 v) {
+	return mthVec3Make(m[0] * v.x + m[3] * v.y + m[6] * v.z,
+		m[1] * v.x + m[4] * v.y + m[7] * v.z,
+		m[2] * v.x + m[5] * v.y + m[8] * v.z);
+}
+
+/*
+ * mth mat3 from mat4 (upper left 3x3)
+ */
+
+void mthMat3FromMat4(float *out, const float *m) {
+
+	out[0] = m[M_00]; out[1] = m[M_10]; out[2] = m[M_20];
+	out[3] = m[M_01]; out[4] = m[M_11]; out[5] = m[M_21];
+	out[6] = m[M_02]; out[7] = m[M_12]; out[8] = m[M_22];
+
+}
+
+/*
+ * mat4
+ */
+
+void mthMat4Identity(float *m) {
+
+	memset(m, 0, 16 * sizeof(float));
+	m[M_00] = m[M_11] = m[M_22] = m[M_33] = 1.0f;
+
+}
+
+/*
+ * mth mat4 multiply (out = a * b, out may be a or b, no alignment needed,
+ * inline so chains of multiplies keep the columns in registers)
+ */
+
+#ifdef __SSE__
+#define MTH_COLUMN(bj) _mm_add_ps(_mm_add_ps(_mm_add_ps( \
+	_mm_mul_ps(a0, _mm_shuffle_ps(bj, bj, 0x00)), \
+	_mm_mul_ps(a1, _mm_shuffle_ps(bj, bj, 0x55))), \
+	_mm_mul_ps(a2, _mm_shuffle_ps(bj, bj, 0xaa))), \
+	_mm_mul_ps(a3, _mm_shuffle_ps(bj, bj, 0xff)))
+#endif
+
+static inline void mthMat4Multiply(float *out, const float *a, const float *b) {
+
+	#ifdef __SSE__
+	__m128 a0 = _mm_loadu_ps(&a[0]), a1 = _mm_loadu_ps(&a[4]);
+	__m128 a2 = _mm_loadu_ps(&a[8]), a3 = _mm_loadu_ps(&a[12]);
+	__m128 b0 = _mm_loadu_ps(&b[0]), b1 = _mm_loadu_ps(&b[4]);
+	__m128 b2 = _mm_loadu_ps(&b[8]), b3 = _mm_loadu_ps(&b[12]);
+	__m128 c0 = MTH_COLUMN(b0), c1 = MTH_COLUMN(b1), c2 = MTH_COLUMN(b2), c3 = MTH_COLUMN(b3);
+
+	_mm_storeu_ps(&out[0], c0);
+	_mm_storeu_ps(&out[4], c1);
+	_mm_storeu_ps(&out[8], c2);
+	_mm_storeu_ps(&out[12], c3);
+	#else
+	float p[16];
+	int r, j;
+
+	for(j = 0; j < 4; j++) {
+		for(r = 0; r < 4; r++) {
+			p[j * 4 + r] = a[r] * b[j * 4 + 0] + a[4 + r] * b[j * 4 + 1] + a[8 + r] * b[j * 4 + 2] + a[12 + r] * b[j * 4 + 3];
+		}
+	}
+	memcpy(out, p, sizeof(p));
+	#endif
+
+}
+
+/*
+ * mth mat4 translate / scale / rotate (m = m * T, S or R, only the
+ * affected columns are recomputed; c and s are the cosine and sine of the
+ * angle so the caller picks the trig)
+ */
+
+static inline void mthMat4Translate(float *m, float x, float y, float z) {
+
+	int r;
+
+	for(r = 0; r < 4; r++) {
+		m[12 + r] = m[r] * x + m[4 + r] * y + m[8 + r] * z + m[12 + r];
+	}
+
+}
+
+static inline void mthMat4Scale(float *m, float x, float y, float z) {
+
+	int r;
+
+	for(r = 0; r < 4; r++) {
+		m[r] *= x;
+		m[4 + r] *= y;
+		m[8 + r] *= z;
+	}
+
+}
+
+#define MTH_ROTATE_COLUMNS(m, i, j, c, s) { \
+	int r_; float u_, v_; \
+	for(r_ = 0; r_ < 4; r_++) { \
+		u_ = m[i * 4 + r_]; v_ = m[j * 4 + r_]; \
+		m[i * 4 + r_] = u_ * (c) + v_ * (s); \
+		m[j * 4 + r_] = u_ * -(s) + v_ * (c); \
+	} \
+}
+
+static inline void mthMat4RotateX(float *m, float c, float s) {
+	MTH_ROTATE_COLUMNS(m, 1, 2, c, s);
+}
+
+static inline void mthMat4RotateY(float *m, float c, float s) {
+	MTH_ROTATE_COLUMNS(m, 2, 0, c, s);
+}
+
+static inline void mthMat4RotateZ(float *m, float c, float s) {
+	MTH_ROTATE_COLUMNS(m, 0, 1, c, s);
+}
+
+static inline struct mthVec3 mthMat4TransformPoint(const float *m, struct mthVec3 p) {
+	return mthVec3Make(m[M_00] * p.x + m[M_01] * p.y + m[M_02] * p.z + m[M_03],
+		m[M_10] * p.x + m[M_11] * p.y + m[M_12] * p.z + m[M_13],
+		m[M_20] * p.x + m[M_21] * p.y + m[M_22] * p.z + m[M_23]);
+}
+
+/*
+ * mth mat4 ortho (glOrtho)
+ */
+
+void mthMat4Ortho(float *m, float left, float right, float bottom, float top, float near_z, float far_z) {
+
+	const float inv_x = 1.0f / (right - left);
+	const float inv_y = 1.0f / (top - bottom);
+	const float inv_z = 1.0f / (far_z - near_z);
+
+	memset(m, 0, 16 * sizeof(float));
+	m[M_00] = 2.0f * inv_x;
+	m[M_11] = 2.0f * inv_y;
+	m[M_22] = -2.0f * inv_z;
+	m[M_03] = -(right + left) * inv_x;
+	m[M_13] = -(top + bottom) * inv_y;
+	m[M_23] = -(far_z + near_z) * inv_z;
+	m[M_33] = 1.0f;
+
+}
+
+/*
+ * mth mat4 invert affine (bottom row 0 0 0 1, returns -1 and leaves out
+ * alone if the 3x3 part is singular)
+ */
+
+int mthMat4InvertAffine(float *out, const float *m) {
+
+	float a[9], inv[9], det, id;
+	float tx = m[M_03], ty = m[M_13], tz = m[M_23];
+
+	mthMat3FromMat4(a, m);
+	inv[0] = a[4] * a[8] - a[7] * a[5];
+	inv[1] = a[7] * a[2] - a[1] * a[8];
+	inv[2] = a[1] * a[5] - a[4] * a[2];
+	det = a[0] * inv[0] + a[3] * inv[1] + a[6] * inv[2];
+	if(fabsf(det) < 1e-12f){
+		return -1;
+	}
+
+	id = 1.0f / det;
+	inv[3] = a[6] * a[5] - a[3] * a[8];
+	inv[4] = a[0] * a[8] - a[6] * a[2];
+	inv[5] = a[3] * a[2] - a[0] * a[5];
+	inv[6] = a[3] * a[7] - a[6] * a[4];
+	inv[7] = a[6] * a[1] - a[0] * a[7];
+	inv[8] = a[0] * a[4] - a[3] * a[1];
+
+	out[M_00] = inv[0] * id; out[M_10] = inv[1] * id; out[M_20] = inv[2] * id; out[M_30] = 0.0f;
+	out[M_01] = inv[3] * id; out[M_11] = inv[4] * id; out[M_21] = inv[5] * id; out[M_31] = 0.0f;
+	out[M_02] = inv[6] * id; out[M_12] = inv[7] * id; out[M_22] = inv[8] * id; out[M_32] = 0.0f;
+	out[M_03] = -(out[M_00] * tx + out[M_01] * ty + out[M_02] * tz);
+	out[M_13] = -(out[M_10] * tx + out[M_11] * ty + out[M_12] * tz);
+	out[M_23] = -(out[M_20] * tx + out[M_21] * ty + out[M_22] * tz);
+	out[M_33] = 1.0f;
+	return 0;
+
+}
+
+/*
+ * 2D affine (rows (a b tx) (c d ty), acts on (x, y, 1))
+ */
+
+void mthAffine2Identity(float *m) {
+
+	m[A_00] = 1.0f; m[A_01] = 0.0f; m[A_02] = 0.0f;
+	m[A_10] = 0.0f; m[A_11] = 1.0f; m[A_12] = 0.0f;
+
+}
+
+/*
+ * mth affine2 make (translate, then rotate by the angle whose cosine and
+ * sine are c and s, then scale, the same as the mat4 helper chain)
+ */
+
+static inline void mthAffine2Make(float *m, float x, float y, float c, float s, float sx, float sy) {
+
+	m[A_00] = c * sx; m[A_01] = -s * sy; m[A_02] = x;
+	m[A_10] = s * sx; m[A_11] = c * sy; m[A_12] = y;
+
+}
+
+static inline struct mthVec2 mthAffine2Transform(const float *m, struct mthVec2 p) {
+	return mthVec2Make(m[A_00] * p.x + m[A_01] * p.y + m[A_02],
+		m[A_10] * p.x + m[A_11] * p.y + m[A_12]);
+}
+
+/*
+ * mth affine2 compose (out = a * b, b applied first, out may be a or b)
+ */
+
+void mthAffine2Compose(float *out, const float *a, const float *b) {
+
+	float p[6];
+
+	p[A_00] = a[A_00] * b[A_00] + a[A_01] * b[A_10];
+	p[A_01] = a[A_00] * b[A_01] + a[A_01] * b[A_11];
+	p[A_02] = a[A_00] * b[A_02] + a[A_01] * b[A_12] + a[A_02];
+	p[A_10] = a[A_10] * b[A_00] + a[A_11] * b[A_10];
+	p[A_11] = a[A_10] * b[A_01] + a[A_11] * b[A_11];
+	p[A_12] = a[A_10] * b[A_02] + a[A_11] * b[A_12] + a[A_12];
+	memcpy(out, p, sizeof(p));
+
+}
+
+/*
+ * mth affine2 invert (returns -1 and leaves out alone if singular)
+ */
+
+int mthAffine2Invert(float *out, const float *m) {
+
+	float det = m[A_00] * m[A_11] - m[A_01] * m[A_10];
+	float id, a, b, c, d;
+
+	if(fabsf(det) < 1e-12f){
+		return -1;
+	}
+
+	id = 1.0f / det;
+	a = m[A_11] * id;
+	b = -m[A_01] * id;
+	c = -m[A_10] * id;
+	d = m[A_00] * id;
+	out[A_02] = -(a * m[A_02] + b * m[A_12]);
+	out[A_12] = -(c * m[A_02] + d * m[A_12]);
+	out[A_00] = a; out[A_01] = b;
+	out[A_10] = c; out[A_11] = d;
+	return 0;
+
+}
+
+/*
+ * mth affine2 to mat4 (z passes through unchanged)
+ */
+
+void mthAffine2ToMat4(float *out, const float *m) {
+
+	mthMat4Identity(out);
+	out[M_00] = m[A_00]; out[M_01] = m[A_01]; out[M_03] = m[A_02];
+	out[M_10] = m[A_10]; out[M_11] = m[A_11]; out[M_13] = m[A_12];
+
+}
+
+/*
+ * quaternions (x, y, z vector part, w scalar, unit length for rotations)
+ */
+
+static inline struct mthQuat mthQuatIdentity() {
+	struct mthQuat q = { 0.0f, 0.0f, 0.0f, 1.0f };
+	return q;
+}
+
+static inline struct mthQuat mthQuatNormalize(struct mthQuat q) {
+	float len = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+	float inv = len > 0.0f ? 1.0f / len : 0.0f;
+	struct mthQuat r = { q.x * inv, q.y * inv, q.z * inv, q.w * inv };
+	return r;
+}
+
+struct mthQuat mthQuatFromAxisAngle(struct mthVec3 axis, float radians) {
+
+	struct mthVec3 n = mthVec3Normalize(axis);
+	float s = sinf(radians * 0.5f);
+	struct mthQuat q = { n.x * s, n.y * s, n.z * s, cosf(radians * 0.5f) };
+	return q;
+
+}
+
+/*
+ * mth quat multiply (rotation b followed by a)
+ */
+
+struct mthQuat mthQuatMultiply(struct mthQuat a, struct mthQuat b) {
+
+	struct mthQuat q;
+
+	q.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+	q.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+	q.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+	q.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+	return q;
+
+}
+
+static inline struct mthVec3 mthQuatRotate(struct mthQuat q, struct mthVec3 v) {
+	struct mthVec3 u = mthVec3Make(q.x, q.y, q.z);
+	struct mthVec3 t = mthVec3Scale(mthVec3Cross(u, v), 2.0f);
+	return mthVec3Add(mthVec3Add(v, mthVec3Scale(t, q.w)), mthVec3Cross(u, t));
+}
+
+/*
+ * mth quat slerp (shortest arc, falls back to a normalized lerp when the
+ * two are nearly parallel)
+ */
+
+struct mthQuat mthQuatSlerp(struct mthQuat a, struct mthQuat b, float t) {
+
+	float d = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+	float th, s, wa, wb;
+	struct mthQuat q;
+
+	if(d < 0.0f){
+		d = -d;
+		b.x = -b.x; b.y = -b.y; b.z = -b.z; b.w = -b.w;
+	}
+
+	if(d > 0.9995f){
+		wa = 1.0f - t;
+		wb = t;
+	} else {
+		th = acosf(d);
+		s = 1.0f / sinf(th);
+		wa = sinf((1.0f - t) * th) * s;
+		wb = sinf(t * th) * s;
+	}
+
+	q.x = a.x * wa + b.x * wb;
+	q.y = a.y * wa + b.y * wb;
+	q.z = a.z * wa + b.z * wb;
+	q.w = a.w * wa + b.w * wb;
+	return mthQuatNormalize(q);
+
+}
+
+/*
+ * mth mat4 from quat (rotation only, unit quaternion)
+ */
+
+void mthMat4FromQuat(float *m, struct mthQuat q) {
+
+	float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+	mthMat4Identity(m);
+	m[M_00] = 1.0f - 2.0f * (yy + zz);
+	m[M_10] = 2.0f * (xy + wz);
+	m[M_20] = 2.0f * (xz - wy);
+	m[M_01] = 2.0f * (xy - wz);
+	m[M_11] = 1.0f - 2.0f * (xx + zz);
+	m[M_21] = 2.0f * (yz + wx);
+	m[M_02] = 2.0f * (xz + wy);
+	m[M_12] = 2.0f * (yz - wx);
+	m[M_22] = 1.0f - 2.0f * (xx + yy);
+
+}
+
+#endif